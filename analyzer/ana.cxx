@@ -4,32 +4,50 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <iostream>
 #include <time.h>
+#include <string.h>
+#include <vector>
 
 #include "TRootanaEventLoop.hxx"
 //#include "TAnaManager.hxx"
 #include <iostream>
 #include <fstream>
 
+#include "ljCompress.h"
+#include "ljBankFormat.h"
+#include "ljProfile.h"
+
 
 class Analyzer: public TRootanaEventLoop {
 
   
   ofstream myfile;
 
+  // Layout of the data banks, from the LBHD bank (see ljBankFormat.h)
+  LJBankLayout layout;
+  bool haveLayout;
+
+  // Values of an LBJZ bank, decoded
+  std::vector<double> decoded;
+
 public:
 
   
   Analyzer() {
     UseBatchMode();
-    
+    haveLayout = false;
   };
 
   virtual ~Analyzer() {};
 
   void Initialize(){
     myfile.open ("run01242.txt");
+
+    // In a build with the per-stage timers, LJ_TRACE_FILE names a file for
+    // a Chrome trace of the events (see ljProfile.h)
+    if(getenv("LJ_TRACE_FILE")) LJProfiler::SetTraceEvents(100000);
   }
 
   void InitManager(){
@@ -39,36 +57,110 @@ public:
   
   
   void BeginRun(int transition,int run,int time){
-        
+    // Every run starts with its own header
+    haveLayout = false;
   }
 
   void EndRun(int transition,int run,int time){
     
     myfile.close();
+
+    if(LJProfiler::Enabled()){
+      LJProfiler::Collect().Print(stdout);
+
+      const char *trace = getenv("LJ_TRACE_FILE");
+      if(trace && !LJProfiler::WriteTrace(trace))
+        printf("Cannot write %s\n", trace);
+    }
   }
 
 
   bool ProcessMidasEvent(TDataContainer& dataContainer){
 
+    LJ_PROFILE_SCOPE("event");
+
+    // The layout header comes with the first event of every run
+    TGenericData *header = dataContainer.GetEventData<TGenericData>("LBHD");
+    if(header){
+      LJ_PROFILE_SCOPE("header");
+      if(LJBankHeaderDecode((const uint8_t*)header->GetChar(), header->GetSize(), layout)){
+        haveLayout = true;
+        printf("Bank layout %08x: %d channels, %d slices per event, %.1f Hz\n",
+               layout.layoutId, layout.nChannels, layout.slicesPerEvent, layout.scanRate);
+      } else {
+        printf("Cannot decode the LBHD bank\n");
+      }
+    }
+
     // Use the sequence bank to see when a new run starts:
     TGenericData *data = dataContainer.GetEventData<TGenericData>("LBJK");
+
+    // With compression enabled the frontend sends LBJZ instead of LBJK
+    TGenericData *zdata = dataContainer.GetEventData<TGenericData>("LBJZ");
     
-    if(!data) return false;
+    if(!data && !zdata) return false;
+
+    // The values of LBJK are used in place; LBJZ is decoded first. Both
+    // are time, ch0 mean, ch0 std, ch1 mean, ...
+    const double *values;
+    int nValues;
+
+    if(data){
+      values = data->GetDouble();
+      nValues = data->GetSize();
+    } else {
+      // LBJZ is the time as a double, then the means and stds encoded 
+      // as two series (see ljCompress.h).
+      LJ_PROFILE_SCOPE("decode");
+      const uint8_t *p = (const uint8_t*)zdata->GetChar();
+      int size = zdata->GetSize();
+      int nSeries, length;
+
+      if(size < 8) return false;
+      if(!LJZDecode(p + 8, size - 8, decoded, nSeries, length)) return false;
+      decoded.insert(decoded.begin(), 0.0);
+      memcpy(&decoded[0], p, 8);
+
+      values = &decoded[0];
+      nValues = decoded.size();
+    }
+
+    // Files written before the header was added have one slice of 
+    // mean and std per channel.
+    if(!haveLayout){
+      layout.nChannels = (nValues - 1) / 2;
+      layout.slicesPerEvent = 1;
+      layout.valuesPerSlice = 2;
+    }
+
+    // LBHR says which layout the event was written with
+    TGenericData *ref = dataContainer.GetEventData<TGenericData>("LBHR");
+    if(ref && haveLayout && ref->GetData32()[0] != layout.layoutId){
+      printf("Event written with layout %08x, but the header is for %08x\n",
+             ref->GetData32()[0], layout.layoutId);
+      return false;
+    }
+
+    LJStatsView view(layout, values, nValues);
+    if(!view.Valid()){
+      printf("Bank has %d values, but the layout needs %d\n",
+             nValues, layout.EventValues());
+      return false;
+    }
     
+    LJ_PROFILE_SCOPE("write");
+
     // Save the unix timestamp
     int timestamp = dataContainer.GetMidasData().GetTimeStamp();
     
     myfile << timestamp;
-    int channels = 15;
-    int reads_per_sec = 30;   // Hz
-    //for(int i = 0; i < 7; i++){   // For 3 channels every 1 second
-    for(int i = 0; i < (1+reads_per_sec*channels*2); i++){   //1 time value, 2 values per channel (val and std), 3 channels, 20 values per second
-      double data2 =  data->GetDouble()[i];
-      myfile << ", " << data2;
+    myfile << ", " << view.Time();
+    for(int slice = 0; slice < view.Slices(); slice++){
+      for(int channel = 0; channel < view.Channels(); channel++){
+        myfile << ", " << view.Mean(channel, slice) << ", " << view.Std(channel, slice);
+      }
     }
     myfile << std::endl;
-    
-
 
     return true;
   }
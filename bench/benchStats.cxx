@@ -0,0 +1,316 @@
+/********************************************************************\
+ Labjack statistics and bank packing benchmarks
+
+ Times the per-block work of read_labjack_event over the channel counts
+ the frontend runs with and a range of block sizes (ScansPerRead):
+
+   meanstd/interleaved/double	LJMeanStd on interleaved scans
+   meanstd/interleaved/float	the same kernel on float scans
+   meanstd/channel_major/...	the same on channel-major blocks (all
+				scans of channel 0, then channel 1, ...)
+   meanstd/block/double		LJMeanStd on an LJChannelBlock, as run
+				by the frontend since the de-interleave
+   meanstd/kernel		the kernel LJStatsKernelFor picks for the
+				channel count, de-interleaving included
+   robust			LJRobustStats::Compute on an LJChannelBlock
+   deinterleave			LJChannelBlock::Load
+   bank/LBJK			bk_create, the time and the kernel's mean/std
+				of the block written straight into the
+				bank, bk_close
+   bank/LBRW			bk_create, memcpy of the raw block, bk_close
+				(the copy the frontend saves by reading the
+				stream into the bank)
+   bank/LBRZ			bk_create, LJZEncode of the raw block, bk_close
+
+ The bytes per second are those of the scans read. Run with "make bench", which writes bench/results.json;
+ see ljBench.h for the options.
+\********************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "midas.h"
+#include "ljStats.h"
+#include "ljChannels.h"
+#include "ljCompress.h"
+#include "ljBench.h"
+
+static const int CHANNELS[] = {3, 15, 30, 32};
+static const int SCANS[] = {10, 100, 1000, 10000};
+
+static const int N_CHANNELS = sizeof(CHANNELS) / sizeof(CHANNELS[0]);
+static const int N_SCANS = sizeof(SCANS) / sizeof(SCANS[0]);
+
+// The compression LSB, 1 uV as in the frontend's default.
+static const double LSB = 1e-6;
+
+/*-- Data ----------------------------------------------------------*/
+
+// Fills a block of interleaved scans with something like magnetometer
+// output: a per-channel offset of some 100 mV with ~100 uV of noise.
+static void FillScans(std::vector<double> &data, int nChannels, int nScans)
+{
+	data.resize((size_t)nChannels * nScans);
+
+	uint32_t state = 12345;
+	for (int i = 0; i < nScans; i++) {
+
+		for (int c = 0; c < nChannels; c++) {
+
+			state = state * 1664525u + 1013904223u;
+			double noise = ((state >> 8) / 16777216.0 - 0.5) * 2e-4;
+			data[c + nChannels * i] = 0.1 * (c % 7) - 0.3 + noise;
+
+		}
+
+	}
+}
+
+// Converts interleaved scans to channel-major ones of type T.
+template <class T>
+static void ToChannelMajor(const std::vector<double> &data, int nChannels,
+			   int nScans, std::vector<T> &out)
+{
+	out.resize(data.size());
+
+	for (int i = 0; i < nScans; i++)
+		for (int c = 0; c < nChannels; c++)
+			out[(size_t)c * nScans + i] = data[c + nChannels * i];
+}
+
+/*-- Kernels -------------------------------------------------------*/
+
+// LJMeanStd for another scan type.
+template <class T>
+static void MeanStdInterleaved(const T *data, int nChannels, int nScans,
+			       T *mean, T *std)
+{
+	for (int channel = 0; channel < nChannels; channel++) {
+
+		T sum = 0;
+		for (int i = 0; i < nScans; i++)
+			sum += data[channel + nChannels * i];
+
+		mean[channel] = sum / nScans;
+
+		T sum2 = 0;
+		for (int i = 0; i < nScans; i++) {
+
+			T d = data[channel + nChannels * i] - mean[channel];
+			sum2 += d * d;
+
+		}
+
+		std[channel] = sqrt(sum2 / nScans);
+
+	}
+}
+
+template <class T>
+static void MeanStdChannelMajor(const T *data, int nChannels, int nScans,
+				T *mean, T *std)
+{
+	for (int channel = 0; channel < nChannels; channel++) {
+
+		const T *x = data + (size_t)channel * nScans;
+
+		T sum = 0;
+		for (int i = 0; i < nScans; i++) sum += x[i];
+
+		mean[channel] = sum / nScans;
+
+		T sum2 = 0;
+		for (int i = 0; i < nScans; i++) {
+
+			T d = x[i] - mean[channel];
+			sum2 += d * d;
+
+		}
+
+		std[channel] = sqrt(sum2 / nScans);
+
+	}
+}
+
+/*-- Benchmarks ----------------------------------------------------*/
+
+static std::string Name(const char *prefix, int nChannels, int nScans)
+{
+	char name[128];
+
+	if (nScans > 0)
+		snprintf(name, sizeof(name), "%s/ch:%d/scans:%d", prefix,
+			 nChannels, nScans);
+	else
+		snprintf(name, sizeof(name), "%s/ch:%d", prefix, nChannels);
+
+	return name;
+}
+
+static void BenchMeanStd(LJBench &bench, int nChannels, int nScans)
+{
+	std::vector<double> data;
+	FillScans(data, nChannels, nScans);
+
+	std::vector<float> dataFloat(data.begin(), data.end());
+	std::vector<double> major;
+	std::vector<float> majorFloat;
+	ToChannelMajor(data, nChannels, nScans, major);
+	ToChannelMajor(data, nChannels, nScans, majorFloat);
+
+	std::vector<double> mean(nChannels), sigma(nChannels);
+	std::vector<float> meanFloat(nChannels), sigmaFloat(nChannels);
+
+	double values = (double)nChannels * nScans;
+
+	bench.Run(Name("meanstd/interleaved/double", nChannels, nScans),
+		  values * sizeof(double), values, [&]() {
+		LJMeanStd(&data[0], nChannels, nScans, &mean[0], &sigma[0]);
+		LJBenchKeep(mean[0]);
+	});
+
+	bench.Run(Name("meanstd/interleaved/float", nChannels, nScans),
+		  values * sizeof(float), values, [&]() {
+		MeanStdInterleaved(&dataFloat[0], nChannels, nScans,
+				   &meanFloat[0], &sigmaFloat[0]);
+		LJBenchKeep(meanFloat[0]);
+	});
+
+	bench.Run(Name("meanstd/channel_major/double", nChannels, nScans),
+		  values * sizeof(double), values, [&]() {
+		MeanStdChannelMajor(&major[0], nChannels, nScans,
+				    &mean[0], &sigma[0]);
+		LJBenchKeep(mean[0]);
+	});
+
+	bench.Run(Name("meanstd/channel_major/float", nChannels, nScans),
+		  values * sizeof(float), values, [&]() {
+		MeanStdChannelMajor(&majorFloat[0], nChannels, nScans,
+				    &meanFloat[0], &sigmaFloat[0]);
+		LJBenchKeep(meanFloat[0]);
+	});
+
+	LJChannelBlock block;
+	block.Load(&data[0], nChannels, nScans);
+
+	bench.Run(Name("meanstd/block/double", nChannels, nScans),
+		  values * sizeof(double), values, [&]() {
+		LJMeanStd(block, &mean[0], &sigma[0]);
+		LJBenchKeep(mean[0]);
+	});
+
+	const LJStatsKernel &kernel = LJStatsKernelFor(nChannels);
+	LJChannelBlock kernelBlock;
+
+	bench.Run(Name("meanstd/kernel", nChannels, nScans),
+		  values * sizeof(double), values, [&]() {
+		kernel.meanStd(&data[0], nChannels, nScans, kernelBlock,
+			       &mean[0], &sigma[0], 1);
+		LJBenchKeep(mean[0]);
+	});
+
+	LJRobustStats robust;
+	std::vector<double> robustValues(LJRobustStats::VALUES * nChannels);
+
+	bench.Run(Name("robust", nChannels, nScans),
+		  values * sizeof(double), values, [&]() {
+		robust.Compute(block, &robustValues[0]);
+		LJBenchKeep(robustValues[0]);
+	});
+
+	bench.Run(Name("deinterleave", nChannels, nScans),
+		  values * sizeof(double), values, [&]() {
+		block.Load(&data[0], nChannels, nScans);
+		LJBenchKeep(block.Channel(0)[0]);
+	});
+}
+
+// The event buffer the banks are packed into, as big as the frontend's
+// max_event_size.
+static std::vector<char> Event(3 * 1024 * 1024);
+
+static void BenchBankStats(LJBench &bench, int nChannels, int nScans)
+{
+	std::vector<double> data;
+	FillScans(data, nChannels, nScans);
+
+	const LJStatsKernel &kernel = LJStatsKernelFor(nChannels);
+	LJChannelBlock block;
+
+	char *pevent = &Event[0];
+
+	bench.Run(Name("bank/LBJK", nChannels, nScans), 
+		  sizeof(double) * data.size(), data.size(), [&]() {
+		bk_init32(pevent);
+
+		double *pdata;
+		bk_create(pevent, "LBJK", TID_DOUBLE, (void **)&pdata);
+		*pdata = 1e9;
+		kernel.meanStd(&data[0], nChannels, nScans, block, pdata + 1,
+			       pdata + 2, 2);
+		pdata += 1 + 2 * nChannels;
+		bk_close(pevent, pdata);
+
+		LJBenchKeep(bk_size(pevent));
+	});
+}
+
+static void BenchBankRaw(LJBench &bench, int nChannels, int nScans)
+{
+	std::vector<double> data;
+	FillScans(data, nChannels, nScans);
+
+	char *pevent = &Event[0];
+	size_t size = sizeof(double) * data.size();
+
+	// The compressed bank has to fit into the event, as in the frontend.
+	if (LJZMaxSize(nChannels, nScans) > Event.size() - 1024) return;
+
+	bench.Run(Name("bank/LBRW", nChannels, nScans), size, 1, [&]() {
+		bk_init32(pevent);
+
+		double *praw;
+		bk_create(pevent, "LBRW", TID_DOUBLE, (void **)&praw);
+		memcpy(praw, &data[0], size);
+		praw += data.size();
+		bk_close(pevent, praw);
+
+		LJBenchKeep(bk_size(pevent));
+	});
+
+	bench.Run(Name("bank/LBRZ", nChannels, nScans), size, 1, [&]() {
+		bk_init32(pevent);
+
+		uint8_t *pdata;
+		bk_create(pevent, "LBRZ", TID_BYTE, (void **)&pdata);
+		pdata += LJZEncode(&data[0], nChannels, nScans, LSB, pdata);
+		bk_close(pevent, pdata);
+
+		LJBenchKeep(bk_size(pevent));
+	});
+}
+
+/*-- Main ----------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+	LJBench bench(argc, argv);
+
+	for (int c = 0; c < N_CHANNELS; c++)
+		for (int s = 0; s < N_SCANS; s++)
+			BenchMeanStd(bench, CHANNELS[c], SCANS[s]);
+
+	for (int c = 0; c < N_CHANNELS; c++)
+		for (int s = 0; s < N_SCANS; s++)
+			BenchBankStats(bench, CHANNELS[c], SCANS[s]);
+
+	for (int c = 0; c < N_CHANNELS; c++)
+		for (int s = 0; s < N_SCANS; s++)
+			BenchBankRaw(bench, CHANNELS[c], SCANS[s]);
+
+	return bench.Finish();
+}
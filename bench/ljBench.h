@@ -0,0 +1,277 @@
+/********************************************************************\
+ Labjack benchmark harness
+
+ A small header-only harness in the style of Google Benchmark, so that
+ the benchmarks build wherever the frontend does without another
+ dependency. A benchmark is a name and a function doing one iteration:
+
+   LJBench bench(argc, argv);
+   bench.Run("meanstd/ch:15/scans:1000", bytes, [&]() { ... });
+   return bench.Finish();
+
+ Every benchmark is first run with a growing number of iterations until
+ a batch takes --min-time, and then timed for --repetitions batches of
+ that many iterations. The reported time per iteration is the median of
+ the batches, with the fastest and slowest batch alongside it.
+
+ Options:
+
+   --filter=<text>	  only run benchmarks with text in their name
+   --min-time=<s>	  minimum time of a batch (default 0.1 s)
+   --repetitions=<n>	  batches timed per benchmark (default 5)
+   --json=<file>	  write the results to file
+
+ The JSON has the layout of Google Benchmark's --benchmark_out, with a
+ "context" and a "benchmarks" list, so its compare.py can be used to
+ compare two result files.
+\********************************************************************/
+
+#ifndef LJBENCH_H
+#define LJBENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Keeps the compiler from optimizing away value, or the computation of
+// the memory it points to.
+template <class T>
+inline void LJBenchKeep(const T &value)
+{
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Makes the compiler assume all memory has been read and written.
+inline void LJBenchClobber()
+{
+	asm volatile("" : : : "memory");
+}
+
+struct LJBenchResult {
+
+	std::string name;
+	uint64_t iterations;
+	int repetitions;
+
+	// Per iteration, in ns.
+	double realTime;
+	double realTimeMin;
+	double realTimeMax;
+	double cpuTime;
+
+	double bytesPerSecond;
+	double itemsPerSecond;
+};
+
+class LJBench {
+
+public:
+
+	LJBench(int argc, char **argv)
+		: fMinTime(0.1), fRepetitions(5)
+	{
+		for (int i = 1; i < argc; i++) {
+
+			const char *arg = argv[i];
+
+			if (strncmp(arg, "--filter=", 9) == 0)
+				fFilter = arg + 9;
+			else if (strncmp(arg, "--min-time=", 11) == 0)
+				fMinTime = atof(arg + 11);
+			else if (strncmp(arg, "--repetitions=", 14) == 0)
+				fRepetitions = atoi(arg + 14);
+			else if (strncmp(arg, "--json=", 7) == 0)
+				fJson = arg + 7;
+			else
+				fprintf(stderr, "Unknown option %s\n", arg);
+
+		}
+
+		if (fMinTime <= 0) fMinTime = 0.1;
+		if (fRepetitions < 1) fRepetitions = 1;
+
+		printf("%-48s %14s %14s %14s %12s\n", "Benchmark", "Time (ns)",
+		       "Min (ns)", "Iterations", "GB/s");
+	}
+
+	// Times fn, which does one iteration. bytes and items are what one
+	// iteration processes, for the throughput; either can be 0.
+	template <class F>
+	void Run(const std::string &name, double bytes, double items, F fn)
+	{
+		if (!fFilter.empty() && name.find(fFilter) == std::string::npos)
+			return;
+
+		// Grows the batch until it takes the minimum time.
+		uint64_t n = 1;
+		for (;;) {
+
+			double t = Batch(fn, n, NULL);
+			if (t >= fMinTime || n >= (1ull << 40)) break;
+
+			// Aims a little over the minimum time, at most 10x at once.
+			double scale = t > 0 ? 1.4 * fMinTime / t : 10;
+			if (scale > 10) scale = 10;
+			if (scale < 2) scale = 2;
+			n = (uint64_t)(n * scale);
+
+		}
+
+		std::vector<double> real, cpu;
+		for (int r = 0; r < fRepetitions; r++) {
+
+			double c;
+			real.push_back(Batch(fn, n, &c) * 1e9 / n);
+			cpu.push_back(c * 1e9 / n);
+
+		}
+
+		LJBenchResult result;
+		result.name = name;
+		result.iterations = n;
+		result.repetitions = fRepetitions;
+		result.realTime = Median(real);
+		result.realTimeMin = *std::min_element(real.begin(), real.end());
+		result.realTimeMax = *std::max_element(real.begin(), real.end());
+		result.cpuTime = Median(cpu);
+		result.bytesPerSecond = bytes * 1e9 / result.realTime;
+		result.itemsPerSecond = items * 1e9 / result.realTime;
+		fResults.push_back(result);
+
+		printf("%-48s %14.1f %14.1f %14llu %12.3f\n", name.c_str(),
+		       result.realTime, result.realTimeMin,
+		       (unsigned long long)n, result.bytesPerSecond / 1e9);
+		fflush(stdout);
+	}
+
+	template <class F>
+	void Run(const std::string &name, double bytes, F fn)
+	{
+		Run(name, bytes, 0, fn);
+	}
+
+	const std::vector<LJBenchResult> &Results() const { return fResults; }
+
+	// Writes the JSON file if one was asked for. Returns the exit status
+	// for main().
+	int Finish()
+	{
+		if (fJson.empty()) return 0;
+
+		FILE *f = fopen(fJson.c_str(), "w");
+		if (!f) {
+
+			fprintf(stderr, "Can't write %s\n", fJson.c_str());
+			return 1;
+
+		}
+
+		char date[64] = "";
+		time_t now = time(NULL);
+		strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z",
+			 localtime(&now));
+
+		char host[256] = "";
+		gethostname(host, sizeof(host) - 1);
+
+		fprintf(f, "{\n  \"context\": {\n");
+		fprintf(f, "    \"date\": \"%s\",\n", date);
+		fprintf(f, "    \"host_name\": \"%s\",\n", host);
+		fprintf(f, "    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+#ifdef __VERSION__
+		fprintf(f, "    \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+#ifdef NDEBUG
+		fprintf(f, "    \"library_build_type\": \"release\",\n");
+#else
+		fprintf(f, "    \"library_build_type\": \"debug\",\n");
+#endif
+		fprintf(f, "    \"min_time\": %g,\n", fMinTime);
+		fprintf(f, "    \"repetitions\": %d\n", fRepetitions);
+		fprintf(f, "  },\n  \"benchmarks\": [\n");
+
+		for (size_t i = 0; i < fResults.size(); i++) {
+
+			const LJBenchResult &r = fResults[i];
+
+			fprintf(f, "    {\n");
+			fprintf(f, "      \"name\": \"%s\",\n", r.name.c_str());
+			fprintf(f, "      \"run_name\": \"%s\",\n", r.name.c_str());
+			fprintf(f, "      \"run_type\": \"iteration\",\n");
+			fprintf(f, "      \"repetitions\": %d,\n", r.repetitions);
+			fprintf(f, "      \"iterations\": %llu,\n",
+				(unsigned long long)r.iterations);
+			fprintf(f, "      \"real_time\": %.6g,\n", r.realTime);
+			fprintf(f, "      \"real_time_min\": %.6g,\n", r.realTimeMin);
+			fprintf(f, "      \"real_time_max\": %.6g,\n", r.realTimeMax);
+			fprintf(f, "      \"cpu_time\": %.6g,\n", r.cpuTime);
+			fprintf(f, "      \"time_unit\": \"ns\",\n");
+			fprintf(f, "      \"bytes_per_second\": %.6g,\n",
+				r.bytesPerSecond);
+			fprintf(f, "      \"items_per_second\": %.6g\n",
+				r.itemsPerSecond);
+			fprintf(f, "    }%s\n", i + 1 < fResults.size() ? "," : "");
+
+		}
+
+		fprintf(f, "  ]\n}\n");
+		fclose(f);
+
+		printf("Results written to %s\n", fJson.c_str());
+
+		return 0;
+	}
+
+private:
+
+	static double Now(clockid_t clock)
+	{
+		struct timespec ts;
+		clock_gettime(clock, &ts);
+		return ts.tv_sec + 1e-9 * ts.tv_nsec;
+	}
+
+	static double Median(std::vector<double> v)
+	{
+		std::sort(v.begin(), v.end());
+		size_t n = v.size();
+		return n % 2 ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+	}
+
+	// Runs n iterations, and returns the wall time they took in s. The
+	// CPU time goes into *cpu if it isn't NULL.
+	template <class F>
+	static double Batch(F &fn, uint64_t n, double *cpu)
+	{
+		double c0 = Now(CLOCK_PROCESS_CPUTIME_ID);
+		double t0 = Now(CLOCK_MONOTONIC);
+
+		for (uint64_t i = 0; i < n; i++) {
+
+			fn();
+			LJBenchClobber();
+
+		}
+
+		double t1 = Now(CLOCK_MONOTONIC);
+		if (cpu) *cpu = Now(CLOCK_PROCESS_CPUTIME_ID) - c0;
+
+		return t1 - t0;
+	}
+
+	std::string fFilter;
+	std::string fJson;
+	double fMinTime;
+	int fRepetitions;
+
+	std::vector<LJBenchResult> fResults;
+};
+
+#endif
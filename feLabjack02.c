@@ -22,6 +22,27 @@ worked on by novice students working with the TUCAN collaboration.
 #include <math.h>
 #include <LabJackM.h>
 #include "LJM_Utilities.h"
+#include "ljStreamConfig.h"
+#include "ljFlightRecorder.h"
+#include "ljTrigger.h"
+#include "ljFilter.h"
+#include "ljBlockBus.h"
+#include "ljTap.h"
+#include "ljCompress.h"
+#include "ljBankFormat.h"
+#include "ljDerived.h"
+#include "ljRateControl.h"
+#include "ljStreamSource.h"
+#include "ljLabjack.h"
+#include "ljReplay.h"
+#include "ljSimSource.h"
+#include "ljCycle.h"
+#include "ljRunSummary.h"
+#include "ljStats.h"
+#include "ljChannels.h"
+#include "ljProfile.h"
+#include "ljAllan.h"
+#include "ljRealtime.h"
 #include <iomanip>
 #include <iostream>
 #include <fstream>
@@ -60,6 +81,20 @@ HNDLE hDB;
 /* handle for labjack device*/
 INT handle;
 
+// The stream is started, read and stopped through Source, which is either
+// the Labjack itself (LJMSource, see ljLabjack.h, which the Python 
+// LabJackT7 class streams through too), a replay of a recording if 
+// Replay/File is set in the ODB (see ljReplay.h), or a simulated T7 if
+// Simulation/Enable is (see ljSimSource.h). The rest of the frontend then
+// runs exactly as it does on live data.
+LJMStreamSource LJMSource;
+LJReplay Replay;
+LJSimSource Simulation;
+LJStreamSource *Source = &LJMSource;
+BOOL ReplayEnabled = FALSE;
+BOOL ReplayReported = FALSE;
+BOOL SimulationEnabled = FALSE;
+
 
 /*
 // FOR OLD DAQ BOARD, SINGLE 
@@ -79,6 +114,7 @@ const char *CHANNEL_NAMES[] = {
 
 // For Fluxgate Input Orientation (x, y, z) in order: 2, 3, 6, 7, 10
 // These channel names are assigned to LabJack addresses in frontend_init()
+// The wiring of all the inputs is in LJ_FLUXGATE_CHANNELS (ljLabjack.h).
 const char *CHANNEL_NAMES[] = {
 	"AIN72", "AIN74", "AIN76", 
 	"AIN79", "AIN81", "AIN83",
@@ -131,6 +167,42 @@ online GUI. These are then reset in this program every time the program is resta
 // be updated globally. (!!!) Is this necessary?
 double ScanRate;
 int ScansPerRead;
+
+// The ScanRate as it was requested in the ODB. ScanRate itself is
+// overwritten by LJM with the actual rate, and may be clamped to what the
+// stream configuration allows, so the request is kept separately.
+double RequestedScanRate;
+
+// Per-channel range and negative channel, and the stream-wide resolution
+// index and settling time. These are read from the ODB when the frontend
+// starts and again at the beginning of every run, see ReadStreamSettings().
+LJStreamConfig StreamConfig;
+
+// What to do if ScanRate is faster than the T7 can sample the configured
+// channels: TRUE lowers it to the maximum, FALSE refuses to start the stream.
+BOOL ClampScanRate = TRUE;
+
+// With rate control enabled, the scan rate is stepped down when the host
+// or the network to the Labjack can't keep up (skipped scans, growing 
+// backlogs), and back up towards the requested rate when they can again.
+// See ljRateControl.h. ControlledScanRate is the rate the controller has
+// chosen, 0 for the requested rate. A change is applied at the start of
+// the next read, so that every event is read at a single rate.
+BOOL RateControlEnabled = FALSE;
+LJRateController RateController;
+double ControlledScanRate = 0;
+BOOL RateChangePending = FALSE;
+
+// ScansPerRead is scaled with the rate, so that a read takes as long at
+// any rate as at StartScanRate, the rate the run started at. The rate is
+// never raised above that, so the buffers sized for RequestedScansPerRead
+// are always large enough.
+int RequestedScansPerRead = 0;
+double StartScanRate = 0;
+
+// Set when the stream couldn't be restarted after a rate change, which
+// stops the run. Nothing is read until the next run starts the stream.
+BOOL StreamFailed = FALSE;
 //int streamDataSize;
 // double * streamData;
 
@@ -162,8 +234,8 @@ INT err, iteration, channel;
   //INT deviceScanBacklog = 0;
   //INT LJMScanBacklog = 0; 
 
-// The address list.
-INT * aScanList = (INT *) malloc(sizeof(int) * NumAddresses);
+// The address list, with room for the digital input after the channels.
+INT * aScanList = (INT *) malloc(sizeof(int) * (NumAddresses + 1));
 
 // streamData is the array buffer within which LabJack will place data from
 // the device, before it is read by eStreamRead. This just needs to be large
@@ -171,6 +243,163 @@ INT * aScanList = (INT *) malloc(sizeof(int) * NumAddresses);
 INT streamDataSize = NumAddresses * ScansPerRead;
 double * streamData = (double *) malloc(sizeof(double) * streamDataSize);
 
+// The flight recorder keeps the last FlightRecorderSeconds of raw scans, 
+// so that the full waveform around an excursion or a quench is available
+// afterwards. A dump is triggered when a raw sample goes beyond the
+// channel's threshold, or on request (ODB or RPC), and is sent as a
+// separate event by the Labjack02Dump equipment. See ljFlightRecorder.h.
+LJFlightRecorder FlightRecorder;
+double FlightRecorderSeconds = 10;
+double FlightRecorderThreshold[NumAddresses];
+double FlightRecorderPostTrigger = 1;
+double FlightRecorderHoldoff = 60;
+
+// Information about the most recent trigger, sent along with the dump.
+// The channel is -1 for dumps which were requested rather than triggered.
+double FlightRecorderTriggerTime = 0;
+int FlightRecorderTriggerChannel = -1;
+
+// The stream is cut into the cycles of an external trigger on a digital
+// line, which is streamed after the channels (see ljCycle.h), and every
+// completed cycle is sent by the Labjack02Cycle equipment. The digital
+// states are split off into DigitalStates as soon as a block is read, so
+// the rest of the frontend only sees the channels.
+BOOL CycleEnabled = FALSE;
+LJCycleBuilder Cycles;
+std::vector<double> DigitalStates;
+
+// Totals over the current run (see ljRunSummary.h). When the run ends 
+// they are written to /Equipment/Labjack02/Summary, and sent in an LBSM
+// bank by the Labjack02Summary equipment.
+LJRunSummary RunSummary;
+BOOL RunSummaryPending = FALSE;
+
+// The CPU, SCHED_FIFO priority and memory locking of the acquisition 
+// thread (see ljRealtime.h). frontend_loop() waits at most LoopWaitMs for
+// the next periodic readout.
+LJRealtimeConfig Realtime;
+INT LoopWaitMs = 100;
+
+// The sensors are x/y/z triplets of consecutive channels.
+enum { NumSensors = NumAddresses / 3 };
+
+// In the default periodic mode an LBJK event is sent every period. In the
+// triggered mode, each block is checked for thresholds, slew rates and
+// changes of the field magnitude (see ljTrigger.h). Only when one of them
+// fires is an event sent, and it then also carries the raw scans of the
+// block. Otherwise an event is only sent every TriggerHeartbeat seconds.
+enum { TRIGGER_MODE_PERIODIC = 0, TRIGGER_MODE_TRIGGERED = 1 };
+INT TriggerMode = TRIGGER_MODE_PERIODIC;
+LJTrigger Trigger;
+double TriggerHeartbeat = 60;
+time_t LastEventTime = 0;
+
+// The optional filter chain (mains notches and CIC decimation, see 
+// ljFilter.h) is applied to every channel before the mean and std are
+// taken. The decimated scans are placed in filteredData. The raw scans
+// are still what goes to the flight recorder, trigger and LBRW bank.
+BOOL FilterEnabled = FALSE;
+LJFilter Filter;
+std::vector<double> filteredData;
+
+// The scans the statistics are taken from (raw or filtered) are 
+// de-interleaved into StatsChannels, one contiguous array per channel
+// (see ljChannels.h), which is what the statistics and the compression of
+// the raw bank work on. With the filter on, the raw scans go into
+// RawChannels when an LBRZ bank needs them.
+LJChannelBlock StatsChannels;
+LJChannelBlock RawChannels;
+
+// The statistics and LBJK packing kernel for NumAddresses channels, from
+// the table in ljStats.h. Some kernels work on the interleaved scans
+// directly, in which case StatsChannels isn't loaded; StatsInBlock says
+// whether it holds the scans of the current event.
+const LJStatsKernel *StatsKernel = NULL;
+bool StatsInBlock = false;
+
+// Every block read from the Labjack is published on the block bus, which
+// hands it to consumers running on their own threads (see ljBlockBus.h).
+// Processing that doesn't need to be in the event itself should subscribe
+// to the bus in frontend_init(), rather than be added to read_labjack_event.
+LJBlockBus BlockBus;
+
+// The data tap subscribes to the block bus and publishes the live blocks
+// through shared memory and, optionally, a local socket, so diagnostics
+// (e.g. src/LabJackTap.py) can see the data without opening the Labjack.
+// It drops its oldest blocks rather than ever holding up acquisition.
+LJTap Tap;
+
+// The Allan deviation monitor subscribes to the block bus and keeps the
+// overlapping Allan deviation and drift of every channel over the raw 
+// scans (see ljAllan.h), for averaging times of up to AllanMaxTau s. The
+// results are written to /Equipment/Labjack02/Allan every AllanPeriod s.
+// It carries on across runs, and only starts afresh when the frontend is
+// restarted or the scan rate changes.
+BOOL AllanEnabled = FALSE;
+double AllanMaxTau = 86400;
+double AllanPeriod = 60;
+time_t AllanLastReport = 0;
+LJAllanMonitor Allan;
+
+// With compression enabled, the LBJK and LBRW banks are replaced by LBJZ
+// and LBRZ banks, in which the values are quantized to CompressionLSB 
+// volts and delta/Rice coded (see ljCompress.h). This takes several times
+// less disk and network than the doubles, at a loss of at most LSB/2.
+BOOL CompressionEnabled = FALSE;
+double CompressionLSB = 1e-6;
+
+// The layout of the data banks is described by an LBHD header bank, sent
+// with the first event after it changes (at the start of every run), and
+// every event carries the id of the layout in an LBHR bank. Consumers 
+// then don't need to hard-code the number of channels. See ljBankFormat.h.
+LJBankLayout BankLayout;
+BOOL BankHeaderPending = TRUE;
+
+// The channel means are calibrated, e.g. to nT, as CalibrationGain * V +
+// CalibrationOffset before the derived quantities and the history are
+// taken from them. LBJK and the raw banks stay in volts.
+double CalibrationGain[NumAddresses];
+double CalibrationOffset[NumAddresses];
+
+// The derived quantities (field magnitude and direction of every sensor, 
+// and gradients between up to MaxGradientPairs configured pairs of 
+// sensors, see ljDerived.h) are computed from the calibrated channel 
+// means and sent in an LBDV bank when enabled.
+enum { MaxGradientPairs = 8 };
+BOOL DerivedEnabled = FALSE;
+LJDerived Derived;
+
+// The robust statistics (median, MAD and sigma-clipped mean and STD of 
+// every channel, see ljStats.h) are taken from the same scans as the mean
+// and STD and sent in an LBRS bank when enabled. With RobustReplaceMean,
+// the clipped mean and STD also replace the plain ones in LBJK, the 
+// history and the derived quantities.
+BOOL RobustEnabled = FALSE;
+BOOL RobustReplaceMean = FALSE;
+LJRobustStats Robust;
+double RobustValues[LJRobustStats::VALUES * NumAddresses];
+
+// For the MIDAS history, the calibrated channel means are averaged over 
+// HistoryPeriod seconds and written to /Equipment/Labjack02/Variables/Mean
+// in one db_set_data call. The readout rate is not affected.
+BOOL HistoryEnabled = FALSE;
+double HistoryPeriod = 10;
+double HistorySum[NumAddresses];
+int HistoryCount = 0;
+time_t HistoryLastUpdate = 0;
+HNDLE hHistoryKey = 0;
+
+// In a build with the per-stage timers (make PROFILE=1, see ljProfile.h),
+// the percentiles of every stage of read_labjack_event over the last
+// ProfilePeriod seconds are written to /Equipment/Labjack02/Profile. The
+// latest ProfileTraceEvents events of every thread are kept, and written
+// as a Chrome trace to ProfileTraceFile at the end of every run.
+double ProfilePeriod = 10;
+char ProfileTraceFile[256] = "";
+INT ProfileTraceEvents = 0;
+time_t ProfileLastReport = 0;
+LJProfileSnapshot ProfileLast;
+
 /*-- Function declarations -----------------------------------------*/
 
 // These two functions are executed every time this program is started or 
@@ -185,10 +414,30 @@ INT end_of_run(INT run_number, char *error);
 INT pause_run(INT run_number, char *error);
 INT resume_run(INT run_number, char *error);
 
-// The Labjack stream configuration is hardcoded within this program. Instead
-// of using a standard stream type from Labjack, this just gives the program
-// behaviour so custom functionality.
-INT HardcodedConfigureStream(INT handle);
+// The stream settings (range and negative channel per channel, resolution
+// index and settling time) are read from the ODB into StreamConfig, and 
+// then written to the Labjack before the stream is started.
+INT ReadStreamSettings();
+INT ConfigureStream(INT handle);
+
+// Starting and stopping of the stream. StartStream() checks the ScanRate 
+// against the maximum the stream configuration allows before starting.
+INT StartStream();
+INT StopStream();
+
+// Reads the replay settings and, if a replay file is set, opens it and
+// makes it the stream source.
+INT SetupReplay();
+INT SetupSimulation();
+
+// Reads the rate control settings and starts the controller at the 
+// current ScanRate. ApplyScanRateChange() restarts the stream at the
+// ControlledScanRate with RestartStream(), which also sets up again what
+// depends on the rate. If that fails, the stream goes back to the rate
+// it had, and if that fails too the run is stopped.
+INT SetupRateControl();
+INT RestartStream(double rate);
+void ApplyScanRateChange();
 
 // (!!!) It is not clear what this function does or when it is called.
 INT frontend_loop();
@@ -198,6 +447,101 @@ INT frontend_loop();
 // MIDAS.
 INT read_labjack_event(char *pevent, INT iter);
 
+// The flight recorder settings are read, and the ring allocated, by
+// SetupFlightRecorder(). TriggerFlightRecorder() arms a dump, which is sent
+// by read_flight_recorder_event() once the post-trigger time has passed.
+INT SetupFlightRecorder();
+BOOL TriggerFlightRecorder(int triggerChannel);
+void CheckFlightRecorderTriggers(const double *data, int nScans);
+INT read_flight_recorder_event(char *pevent, INT iter);
+
+// Cycle events, see ljCycle.h.
+INT SetupCycle();
+void SplitDigitalStates(double *scans);
+INT read_cycle_event(char *pevent, INT iter);
+
+// The run summary, see ljRunSummary.h. WriteRunSummary() writes it to the
+// ODB, read_summary_event() sends it.
+void WriteRunSummary();
+INT read_summary_event(char *pevent, INT iter);
+
+// The trigger mode and conditions are read by SetupTrigger().
+INT SetupTrigger();
+
+// The filter settings are read, and the filter state cleared, by
+// SetupFilter().
+INT SetupFilter();
+
+// Copies the block just read into a block from the bus pool and publishes
+// it to the bus consumers.
+void PublishBlock(const double *scans, double readTime, int deviceScanBacklog,
+		  int LJMScanBacklog);
+
+// Reads the tap settings and, if it is enabled, opens it and subscribes
+// it to the block bus.
+INT SetupTap();
+
+// Reads the Allan deviation settings and, if it is enabled, subscribes the
+// monitor to the block bus. ReportAllan() writes its results to the ODB 
+// once AllanPeriod has passed.
+INT SetupAllan();
+void ReportAllan();
+
+// Reads the realtime settings, and applies them to the frontend thread.
+// Called last in frontend_init(), so that the block bus threads aren't
+// pinned along with it.
+INT SetupRealtime();
+
+// How long frontend_loop() can wait before a periodic equipment is due.
+INT LoopWait();
+
+// Reads the compression settings.
+INT SetupCompression();
+
+// Encodes nSeries interleaved series of length values into a new TID_BYTE
+// bank, with nPrefix doubles (e.g. the time) stored ahead of them as they
+// are.
+void CreateCompressedBank(char *pevent, const char *name, 
+			  const double *prefix, int nPrefix,
+			  const double *data, int nSeries, int length);
+
+// The same for the channels of a de-interleaved block, without a prefix.
+void CreateCompressedChannelBank(char *pevent, const char *name, 
+				 const LJChannelBlock &block);
+
+// Reads the calibration of the channel means. CalibrateMeans() writes
+// the calibrated means, from the mean/STD pairs of the LBJK values, to
+// means.
+INT SetupCalibration();
+void CalibrateMeans(const double *stats, double *means);
+
+// Reads the derived quantity settings.
+INT SetupDerived();
+
+// Reads the robust statistics settings.
+INT SetupRobust();
+
+// Reads the history settings and creates the Variables for it.
+// UpdateHistory() adds the calibrated means of a read, and writes the
+// Variables once the history period has passed.
+INT SetupHistory();
+void UpdateHistory(const double *means);
+
+// Fills BankLayout from the current settings. Called after everything 
+// that changes the layout has been set up.
+void SetupBankLayout();
+
+// Reads the profiling settings, before any timing is done. ReportProfile()
+// writes the timings since the last report to the ODB once ProfilePeriod
+// has passed, and WriteProfileTrace() writes the trace file, if one is set.
+INT SetupProfile();
+void ReportProfile();
+void WriteProfileTrace();
+
+// Handles JSON-RPC requests sent to this frontend, for example from the
+// MIDAS web pages. See the definition for the commands understood.
+INT rpc_callback(INT index, void *prpc_param[]);
+
 /*-- Equipment list ------------------------------------------------*/
 
 // https://midas.triumf.ca/MidasWiki/index.php/Equipment_List_Parameters
@@ -230,6 +574,62 @@ EQUIPMENT equipment[] = {
      	"", "", "",
     	},
    read_labjack_event,      	// readout routine 
+   },
+
+	// This equipment only sends an event when a flight recorder dump is
+	// ready, so it is checked often but is usually silent.
+	{"Labjack02Dump",         // equipment name 
+		{2, 0,            // event ID, trigger mask 
+     	"SYSTEM",                 // event buffer 
+     	EQ_PERIODIC,              // equipment type (see MIDAS docs)
+     	LAM_SOURCE(0, 0xFFFFFF),  // event source crate 0, all stations 
+     	"MIDAS",                  // format 
+     	TRUE,                     // enabled 
+     	RO_ALWAYS,                // read only when running 
+     	100,                      // period: check for a dump every 100ms
+     	0,                        // stop run after this event limit 
+     	0,                        // number of sub events 
+     	0,                        // don't log history 
+     	"", "", "",
+    	},
+   read_flight_recorder_event,	// readout routine 
+   },
+
+	// An event for every completed cycle of the external trigger, sent
+	// soon after the cycle's last block has been read.
+	{"Labjack02Cycle",        // equipment name 
+		{3, 0,            // event ID, trigger mask 
+     	"SYSTEM",                 // event buffer 
+     	EQ_PERIODIC,              // equipment type (see MIDAS docs)
+     	LAM_SOURCE(0, 0xFFFFFF),  // event source crate 0, all stations 
+     	"MIDAS",                  // format 
+     	TRUE,                     // enabled 
+     	RO_ALWAYS,                // read only when running 
+     	100,                      // period: check for a cycle every 100ms
+     	0,                        // stop run after this event limit 
+     	0,                        // number of sub events 
+     	0,                        // don't log history 
+     	"", "", "",
+    	},
+   read_cycle_event,		// readout routine 
+   },
+
+	// The run summary, which is only read once, at the end of a run.
+	{"Labjack02Summary",      // equipment name 
+		{4, 0,            // event ID, trigger mask 
+     	"SYSTEM",                 // event buffer 
+     	EQ_PERIODIC,              // equipment type (see MIDAS docs)
+     	LAM_SOURCE(0, 0xFFFFFF),  // event source crate 0, all stations 
+     	"MIDAS",                  // format 
+     	TRUE,                     // enabled 
+     	RO_EOR,                   // read only at the end of a run 
+     	60000,                    // period: not read periodically
+     	0,                        // stop run after this event limit 
+     	0,                        // number of sub events 
+     	0,                        // don't log history 
+     	"", "", "",
+    	},
+   read_summary_event,		// readout routine 
    },
 
    {""}
@@ -298,6 +698,7 @@ INT frontend_init()
         db_get_value(hDB,0,"/Equipment/Labjack02/Settings/ScanRate",&ScanRate,\
 			&ScanRate_size,TID_DOUBLE,1);
         printf("ScanRate is set to %.2f\n",ScanRate); 	
+	RequestedScanRate = ScanRate;
 
 	// ScansPerRead is treated analogously.
 	extern int ScansPerRead;
@@ -306,11 +707,14 @@ INT frontend_init()
         db_get_value(hDB,0,"/Equipment/Labjack02/Settings/ScansPerRead",\
 			&ScansPerRead,&ScansPerRead_size,TID_INT,1);
         printf("ScansPerRead is set to %d\n",ScansPerRead); 
+	RequestedScansPerRead = ScansPerRead;
 
 	// The streamData array is reconfigured to be appropriately sized for
-	// the new ScansPerRead value.
+	// the new ScansPerRead value, with the digital input if it is streamed.
+	// Every source is started with ScansPerRead (see StartStream()), so a
+	// read writes no more than that.
 	extern INT streamDataSize;
-	streamDataSize = NumAddresses * ScansPerRead;
+	streamDataSize = (NumAddresses + 1) * ScansPerRead;
 	extern double * streamData;
 	streamData = (double *) malloc(sizeof(double) * streamDataSize);
  
@@ -321,6 +725,27 @@ INT frontend_init()
         // ********************************************
 	// STARTING A STREAM
 
+	// The profiler is set up before anything is timed.
+	INT status = SetupProfile();
+	if (status != SUCCESS) return status;
+
+	StatsKernel = &LJStatsKernelFor(NumAddresses);
+	if (StatsKernel->nChannels == 0)
+		cm_msg(MINFO, "frontend_init", 
+		       "No statistics kernel for %d channels, using the generic one",
+		       NumAddresses);
+
+	// With a replay file set, the recording is played back instead and
+	// the Labjack isn't opened at all.
+	status = SetupReplay();
+	if (status != SUCCESS) return status;
+
+	// The same goes for the simulation.
+	status = SetupSimulation();
+	if (status != SUCCESS) return status;
+
+	if (!ReplayEnabled && !SimulationEnabled) {
+
   	// Connect to the labjack
 	printf("Connecting to %s...\n",device);
   
@@ -330,11 +755,14 @@ INT frontend_init()
   	// The IP address is specified in the third, 'Identifier' option
   	handle = OpenOrDie(LJM_dtANY, LJM_ctANY, "142.90.151.7");
  	printf("opening 142.90.151.7.\n");
+	LJMSource.SetHandle(handle);
   
 	// The Labjack Device information is printed to the console.
   	PrintDeviceInfoFromHandle(handle);
   	printf("\n");
 
+	}
+
 	// (!!!) It is not clear why any of the below * comment encapsulated
 	// code is necessary, nor why it is currently commented.
   	/*
@@ -363,34 +791,77 @@ INT frontend_init()
 	printf("\nNumber of channels: %d\n", NumAddresses);
 	ErrorCheck(err, "Getting positive channel addresses");
 
-	// (!!!) This is a major issue that should be resolved. Sometimes, 
-	// depending on how the program exits, the Labjack stream is left 
-	// running in the background. Then if one tries to restart the 
-	// program, it will throw an error. By simply uncommenting the
-	// following line, and thus stopping the stream first, this problem
-	// appears to be mitigated. This is a poor, and temporary solution.
-	err = LJM_eStreamStop(handle);
+	// The digital input goes after the channels when it is streamed.
+	int digitalType;
+	err = LJM_NameToAddress(LJ_DIGITAL_STATE, &aScanList[NumAddresses],
+				&digitalType);
+	ErrorCheck(err, "Getting the %s address", LJ_DIGITAL_STATE);
 
-	// Sets the stream configuration, see definition
-	printf("Configuring the stream...\n");	
-	HardcodedConfigureStream(handle);
+	// The range, negative channel, resolution and settling settings are
+	// retrieved from the ODB, and the stream is started with them.
+	status = ReadStreamSettings();
+	if (status != SUCCESS) return status;
 
+	status = StartStream();
+	if (status != SUCCESS) return status;
 
-	// Initializes a stream object and begins streaming (data from LabJack). 
-	// A Labjack error check is performed.
-	printf("Starting stream...\n");
-	// (!!!) This is another major issue to be resolved. At present, the
-	// ScansPerRead variable is increased by 5 here to avoid an overflow
-	// of the LJMBuffer. Some thought is required in order to see how to 
-	// perform this adjustment systematically and automatically.
-	err = LJM_eStreamStart(handle, ScansPerRead + 5, NumAddresses, aScanList,
-				 &ScanRate);
-	ErrorCheck(err, "LJM_eStreamStart");
+	// The flight recorder ring is sized from the actual ScanRate.
+	status = SetupFlightRecorder();
+	if (status != SUCCESS) return status;
 
-	// Once the stream is started, some infromation on its rates are
-	// printed.
-	printf("Stream started. Actual scan rate: %.02f Hz (%.02f sample rate)\n",
-		 ScanRate, ScanRate * NumAddresses);
+	// The triggered mode needs the actual ScanRate to convert slew limits.
+	status = SetupTrigger();
+	if (status != SUCCESS) return status;
+
+	// The filter coefficients depend on the actual ScanRate too.
+	status = SetupFilter();
+	if (status != SUCCESS) return status;
+
+	status = SetupTap();
+	if (status != SUCCESS) return status;
+
+	status = SetupAllan();
+	if (status != SUCCESS) return status;
+
+	status = SetupRateControl();
+	if (status != SUCCESS) return status;
+
+	status = SetupCompression();
+	if (status != SUCCESS) return status;
+
+	status = SetupCalibration();
+	if (status != SUCCESS) return status;
+
+	status = SetupDerived();
+	if (status != SUCCESS) return status;
+
+	status = SetupRobust();
+	if (status != SUCCESS) return status;
+
+	status = SetupHistory();
+	if (status != SUCCESS) return status;
+
+	status = SetupCycle();
+	if (status != SUCCESS) return status;
+
+	SetupBankLayout();
+
+	// The consumers have to be subscribed to the block bus before it is
+	// started here. The pool blocks are sized for ScansPerRead scans.
+	if (BlockBus.Subscribers() > 0) {
+
+		BlockBus.Start(NumAddresses, ScansPerRead);
+		printf("Block bus started with %d consumers\n", 
+		       BlockBus.Subscribers());
+
+	}
+
+	// JSON-RPC requests, e.g. for a flight recorder dump, are passed to
+	// rpc_callback().
+	cm_register_function(RPC_JRPC, rpc_callback);
+
+	status = SetupRealtime();
+	if (status != SUCCESS) return status;
 
   return SUCCESS;
 
@@ -401,6 +872,26 @@ INT frontend_init()
 
 INT frontend_exit()
 {
+
+	// The block bus consumer threads are stopped first, and their
+	// statistics printed.
+	BlockBus.Stop();
+
+	for (int i = 0; i < BlockBus.Subscribers(); i++) {
+
+		printf("Block bus consumer %s: %llu blocks processed, %llu dropped\n",
+		       BlockBus.Name(i), 
+		       (unsigned long long)BlockBus.Processed(i),
+		       (unsigned long long)BlockBus.Dropped(i));
+
+	}
+	
+	Tap.Close();
+
+	// The timings of the whole session are printed in a profiling build.
+	if (LJProfiler::Enabled()) LJProfiler::Collect().Print(stdout);
+
+	WriteProfileTrace();
 	
 	// The stream is stopped.
 	printf("Stopping stream...\n");
@@ -417,8 +908,12 @@ INT frontend_exit()
 	printf("finished free\n");
 
 	// Close Labjack
-	CloseOrDie(handle);
-	printf("closed connection to labjack\n");
+	if (!ReplayEnabled && !SimulationEnabled) {
+
+		CloseOrDie(handle);
+		printf("closed connection to labjack\n");
+
+	}
 
 	// (!!!) What's this for?
 	//WaitForUserIfWindows();
@@ -431,6 +926,65 @@ INT frontend_exit()
 INT begin_of_run(INT run_number, char *error)
 {
 
+	// The stream settings may be changed between runs, e.g. to trade noise
+	// for rate with the resolution index. The stream has to be stopped 
+	// for them to be written, so it is restarted here with the new values.
+	INT status = ReadStreamSettings();
+	if (status != SUCCESS) return status;
+
+	// Every run starts at the requested rate.
+	StopStream();
+	ControlledScanRate = 0;
+	RateChangePending = FALSE;
+	ScansPerRead = RequestedScansPerRead;
+	StreamFailed = FALSE;
+	ReplayReported = FALSE;
+	status = StartStream();
+	if (status != SUCCESS) return status;
+
+	status = SetupRateControl();
+	if (status != SUCCESS) return status;
+
+	status = SetupFlightRecorder();
+	if (status != SUCCESS) return status;
+
+	status = SetupTrigger();
+	if (status != SUCCESS) return status;
+
+	// The stream has been restarted, so the filter state is cleared too.
+	status = SetupFilter();
+	if (status != SUCCESS) return status;
+
+	status = SetupCompression();
+	if (status != SUCCESS) return status;
+
+	status = SetupCalibration();
+	if (status != SUCCESS) return status;
+
+	status = SetupDerived();
+	if (status != SUCCESS) return status;
+
+	status = SetupRobust();
+	if (status != SUCCESS) return status;
+
+	status = SetupHistory();
+	if (status != SUCCESS) return status;
+
+	// The stream has been restarted, so the cycles are counted afresh.
+	status = SetupCycle();
+	if (status != SUCCESS) return status;
+
+	// The header is sent again at the start of every run, so that every
+	// run's data can be read on its own.
+	SetupBankLayout();
+	BankHeaderPending = TRUE;
+
+	// The run summary starts from the restarted stream.
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	RunSummary.Start(run_number, NumAddresses, now.tv_sec + 1e-6 * now.tv_usec);
+	RunSummaryPending = FALSE;
+
 	return SUCCESS;
 }
 
@@ -438,6 +992,24 @@ INT begin_of_run(INT run_number, char *error)
 INT end_of_run(INT run_number, char *error)
 {
 
+	// The summary is complete with the last read of the run. It is sent
+	// by read_summary_event(), which MIDAS calls after this.
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	RunSummary.Stop(now.tv_sec + 1e-6 * now.tv_usec);
+	WriteRunSummary();
+	RunSummaryPending = TRUE;
+
+	cm_msg(MINFO, "end_of_run",
+	       "Run %d: %llu scans in %.1f s, %llu skipped, %llu read errors, "
+	       "%llu rate changes", run_number,
+	       (unsigned long long)RunSummary.Scans(), RunSummary.Seconds(),
+	       (unsigned long long)RunSummary.Skipped(),
+	       (unsigned long long)RunSummary.Errors(),
+	       (unsigned long long)RunSummary.RateChanges());
+
+	WriteProfileTrace();
+
 	return SUCCESS;
 }
 
@@ -457,287 +1029,2442 @@ INT resume_run(INT run_number, char *error)
 
 }
 
-/*-- Create Stream Configuration------------------------------------*/
+/*-- Read Stream Settings ------------------------------------------*/
 
-INT HardcodedConfigureStream(INT handle)
+INT ReadStreamSettings()
 {
-	
-	// (!!!) In general, this section of the code is quite poorly
-	// understood (as demonstrated by the sparse commenting). It 
-	// would be good to document it further.
 
-	const int STREAM_TRIGGER_INDEX = 0;
-	const int STREAM_CLOCK_SOURCE = 0;
-	const int STREAM_RESOLUTION_INDEX = 0;
-	const double STREAM_SETTLING_US = 0;
-	const double AIN_ALL_RANGE = 0;
-	const int AIN_ALL_NEGATIVE_CH = LJM_GND;
+	// Each setting is created with the current default if it doesn't yet
+	// exist in the ODB. The Range and NegativeChannel arrays have one 
+	// entry per channel, in the order of CHANNEL_NAMES.
+	int resolutionIndex = 0;
+	double settlingUS = 0;
+	double range[NumAddresses];
+	int negativeChannel[NumAddresses];
+	int size;
 
-	printf("Writing configurations:\n");
+	for (int i = 0; i < NumAddresses; i++) {
 
-	if (STREAM_TRIGGER_INDEX == 0) {
-	printf("    Ensuring triggered stream is disabled:");
-	}
-	printf("    Setting STREAM_TRIGGER_INDEX to %d\n", STREAM_TRIGGER_INDEX);
-	WriteNameOrDie(handle, "STREAM_TRIGGER_INDEX", STREAM_TRIGGER_INDEX);
+		range[i] = 10.0;
+		negativeChannel[i] = LJM_GND;
 
-	if (STREAM_CLOCK_SOURCE == 0) {
-	printf("    Enabling internally-clocked stream:");
 	}
-	printf("    Setting STREAM_CLOCK_SOURCE to %d\n", STREAM_CLOCK_SOURCE);
-	WriteNameOrDie(handle, "STREAM_CLOCK_SOURCE", STREAM_CLOCK_SOURCE);
 
-	// Configure the analog inputs' negative channel, range, settling time and
-	// resolution.
-	// Note: when streaming, negative channels and ranges can be configured 
-	// for individual analog inputs, but the stream has only one settling time
-	// and resolution.
+	size = sizeof(resolutionIndex);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/ResolutionIndex",
+		&resolutionIndex, &size, TID_INT, TRUE);
+
+	size = sizeof(settlingUS);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/SettlingUS",
+		&settlingUS, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(range);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Range",
+		range, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(negativeChannel);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/NegativeChannel",
+		negativeChannel, &size, TID_INT, TRUE);
+
+	size = sizeof(ClampScanRate);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/ClampScanRate",
+		&ClampScanRate, &size, TID_BOOL, TRUE);
+
+	// A TriggerDIO of -1 starts the stream as soon as it is enabled, 
+	// otherwise it starts on TriggerEdge (0 rising, 1 falling, 2 both) of
+	// that DIO. A ClockSource of 2 clocks the scans from CIO3, one scan
+	// every ExternalClockDivisor edges.
+	int triggerDIO = -1;
+	int triggerEdge = LJ_EDGE_RISING;
+	int clockSource = T7_CLOCK_INTERNAL;
+	int clockDivisor = 1;
+
+	size = sizeof(triggerDIO);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/TriggerDIO",
+		&triggerDIO, &size, TID_INT, TRUE);
+
+	size = sizeof(triggerEdge);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/TriggerEdge",
+		&triggerEdge, &size, TID_INT, TRUE);
+
+	size = sizeof(clockSource);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/ClockSource",
+		&clockSource, &size, TID_INT, TRUE);
+
+	size = sizeof(clockDivisor);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/ExternalClockDivisor",
+		&clockDivisor, &size, TID_INT, TRUE);
+
+	// The digital input is only streamed for the cycle events (see 
+	// SetupCycle()), as it takes a sample of every scan.
+	size = sizeof(CycleEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/Enable",
+		&CycleEnabled, &size, TID_BOOL, TRUE);
+
+	if (resolutionIndex < 0 || 
+	    resolutionIndex > T7_MAX_STREAM_RESOLUTION_INDEX) {
+
+		cm_msg(MERROR, "ReadStreamSettings",
+		       "ResolutionIndex %d cannot be used while streaming (0-%d)",
+		       resolutionIndex, T7_MAX_STREAM_RESOLUTION_INDEX);
+		return FE_ERR_ODB;
 
-	printf("    Setting STREAM_RESOLUTION_INDEX to %d\n",\
-	 STREAM_RESOLUTION_INDEX);
-	WriteNameOrDie(handle, "STREAM_RESOLUTION_INDEX", \
-					STREAM_RESOLUTION_INDEX);
+	}
 
-	printf("    Setting STREAM_SETTLING_US to %f\n", STREAM_SETTLING_US);
-	WriteNameOrDie(handle, "STREAM_SETTLING_US", STREAM_SETTLING_US);
+	if (triggerDIO < -1 || triggerDIO > T7_MAX_TRIGGER_DIO ||
+	    triggerEdge < LJ_EDGE_RISING || triggerEdge > LJ_EDGE_BOTH) {
 
-	printf("    Setting AIN_ALL_RANGE to %f\n", AIN_ALL_RANGE);
-	WriteNameOrDie(handle, "AIN_ALL_RANGE", AIN_ALL_RANGE);
+		cm_msg(MERROR, "ReadStreamSettings",
+		       "TriggerDIO %d must be -1 or 0-%d, and TriggerEdge %d 0-2",
+		       triggerDIO, T7_MAX_TRIGGER_DIO, triggerEdge);
+		return FE_ERR_ODB;
 
-	printf("    Setting AIN_ALL_NEGATIVE_CH to ");
+	}
 
-	if (AIN_ALL_NEGATIVE_CH == LJM_GND) {
+	if ((clockSource != T7_CLOCK_INTERNAL && 
+	     clockSource != T7_CLOCK_EXTERNAL) || clockDivisor < 1) {
 
-		printf("LJM_GND");
+		cm_msg(MERROR, "ReadStreamSettings",
+		       "ClockSource %d must be %d (internal) or %d (external), "
+		       "and ExternalClockDivisor %d at least 1", clockSource,
+		       T7_CLOCK_INTERNAL, T7_CLOCK_EXTERNAL, clockDivisor);
+		return FE_ERR_ODB;
 
 	}
 
-	else {
+	// A recording has the analog channels only.
+	if (CycleEnabled && ReplayEnabled) {
 
-		printf("%d", AIN_ALL_NEGATIVE_CH);
+		cm_msg(MINFO, "ReadStreamSettings", 
+		       "A replay has no digital input, so there are no cycle "
+		       "events");
+		CycleEnabled = FALSE;
 
 	}
 
-	printf("\n");
-	WriteNameOrDie(handle, "AIN_ALL_NEGATIVE_CH", AIN_ALL_NEGATIVE_CH);
+	StreamConfig.resolutionIndex = resolutionIndex;
+	StreamConfig.settlingUS = settlingUS;
+	StreamConfig.range.assign(range, range + NumAddresses);
+	StreamConfig.negativeChannel.assign(negativeChannel,
+					    negativeChannel + NumAddresses);
+	StreamConfig.digitalChannels = CycleEnabled ? 1 : 0;
+	StreamConfig.triggerDIO = triggerDIO;
+	StreamConfig.triggerEdge = triggerEdge;
+	StreamConfig.clockSource = clockSource;
+	StreamConfig.clockDivisor = clockDivisor;
 
 	return SUCCESS;
 }
 
+/*-- Create Stream Configuration------------------------------------*/
 
-/*-- Frontend Loop -------------------------------------------------*/
-
-INT frontend_loop()
+INT ConfigureStream(INT handle)
 {
 	
-	// (!!!) What? Where is frontend_call_loop? Is this necessary?
-
-	/* if frontend_call_loop is true, this routine gets called when
-	  the frontend is idle or once between every event */
-	usleep(50);
-	return SUCCESS;
-}
-
-/*------------------------------------------------------------------*/
-
-/********************************************************************\
-
-  Readout routines for different events
+	// The stream either starts as soon as it is enabled or on an edge of
+	// TriggerDIO, and runs on the internal crystal or the clock on CIO3.
+	int channel;
 
-\********************************************************************/
+	printf("Writing configurations:\n");
 
-// (!!!) "Trigger event routines" and "Interrupt configuration" 
-// are of what use? These two pieces of code are not understood.
+	if (StreamConfig.triggerDIO < 0) {
 
-/*-- Trigger event routines ----------------------------------------*/
-// Not currently used for DCRC readout
-extern "C" { INT poll_event(INT source, INT count, BOOL test)
-/* Polling routine for events. Returns TRUE if event
-   is available. If test equals TRUE, don't return. The test
-   flag is used to time the polling */
-{
-	int i;
+		printf("    Ensuring triggered stream is disabled:");
+		printf("    Setting STREAM_TRIGGER_INDEX to 0\n");
 
-	for (i = 0; i < count; i++) {
-		//      cam_lam_read(LAM_SOURCE_CRATE(source), &lam);
+	}
 
-		//      if (lam & LAM_SOURCE_STATION(source))
-		if (!test) {
+	else {
 
-			return 1;
-		}
+		printf("    Triggering the stream on DIO%d (edge %d):",
+		       StreamConfig.triggerDIO, StreamConfig.triggerEdge);
+		printf("    Setting STREAM_TRIGGER_INDEX to %d\n",
+		       2000 + StreamConfig.triggerDIO);
 
 	}
 
-	//usleep(1000);
-	usleep(250);
-	return 0;
-}
-}
+	if (StreamConfig.clockSource == T7_CLOCK_INTERNAL) {
+
+		printf("    Enabling internally-clocked stream:");
+		printf("    Setting STREAM_CLOCK_SOURCE to 0\n");
 
-/*-- Interrupt configuration ---------------------------------------*/
-// This is not currently used by the DCRC readout
-extern "C" { INT interrupt_configure(INT cmd, INT source, POINTER_T adr)
-{
-	switch (cmd) {
-	case CMD_INTERRUPT_ENABLE:
-	  break;
-	case CMD_INTERRUPT_DISABLE:
-	  break;
-	case CMD_INTERRUPT_ATTACH:
-	  break;
-	case CMD_INTERRUPT_DETACH:
-	  break;
 	}
-	return SUCCESS;
-} 
 
-/*-- Event readout -------------------------------------------------*/
-INT read_labjack_event(char *pevent, INT iter)
-{
+	else {
 
-	// ____________________________________________        
-        // ********************************************
-	// VARIABLE INITIALIZATION
+		printf("    Clocking the stream from CIO3, divisor %d:",
+		       StreamConfig.clockDivisor);
+		printf("    Setting STREAM_CLOCK_SOURCE to %d\n",
+		       StreamConfig.clockSource);
 
-	// (!!!) Could this time business be removed?
-	struct timeval te; 
-  	gettimeofday(&te, NULL);
+	}
 
-  	// Printing out the time in milliseconds to confirm time between calls to 
-  	// read_labjack_evennt function - useful to keep around for debugging
-	// calculate milliseconds
-   	// long long milliseconds = te.tv_sec*1000LL + te.tv_usec/1000;
-   	// printf("milliseconds: %lld\n", milliseconds);
+	// Configure the analog inputs' negative channel, range, settling time and
+	// resolution.
+	// Note: when streaming, negative channels and ranges can be configured 
+	// for individual analog inputs, but the stream has only one settling time
+	// and resolution.
 
-	// (!!!) This bank, and pdata piece is unclear, could be better 
-	// explained or documented.
-  	/* init bank structure */
-  	bk_init32(pevent);
-  	double *pdata;
-  	/* create bank of double words */
-  	bk_create(pevent, "LBJK", TID_DOUBLE, (void **)&pdata); 
+	printf("    Setting STREAM_RESOLUTION_INDEX to %d\n",\
+	 StreamConfig.resolutionIndex);
+	printf("    Setting STREAM_SETTLING_US to %f\n", StreamConfig.settlingUS);
 
-	// These backlog variables are for keeping track of how many scans are
-	// left over in each of the deviceBuffer and the LJMBuffer, after each
-	// read.
-  	int deviceScanBacklog = 0;
-  	int LJMScanBacklog = 0;
-  
-  	// Arrays are initialized to hold the calculated values for MIDAS.
-  	double sum[NumAddresses] = {0};
-  	double mean[NumAddresses] = {0};
-  	double std[NumAddresses] = {0};
-  	int i;
+	// The range and negative channel are written channel by channel, e.g.
+	// AIN72_RANGE and AIN72_NEGATIVE_CH.
+	for (channel = 0; channel < NumAddresses; channel++) {
 
-	// Call to eStreamRead should read "ScanRate" many values from each address,
-	err = LJM_eStreamRead(handle, streamData, &deviceScanBacklog, &LJMScanBacklog);
+		printf("    %s: range %.2f V, negative channel ",
+		       CHANNEL_NAMES[channel], StreamConfig.range[channel]);
 
-	// Can be useful for testing:
-	// A loop to check the the individual voltage measurements, 
-	// i.e. the samples from individual channels.
-	//std::cout.precision(15);
-	//for(j = 0; j < ScanRate * NumAddresses; j++) {
-	//	std::cout << std::fixed << streamData[j] << std::endl;	
-	//}
+		if (StreamConfig.negativeChannel[channel] == LJM_GND) {
 
-	// Some error checks are performed
-	if(err == 1221){ // ignore errors of type 1221
+			printf("LJM_GND\n");
 
-		static int error_count = 0;
-		error_count++;
-		cm_msg(MINFO,"read_labjack_event",
-		       "Gotten labjack error with error number = 1221, ",
-		       "Number errors: %i",error_count);
+		}
 
-		if(error_count > 100) {
+		else {
 
-			ErrorCheck(err, "LJM_eStreamRead too many errors");
+			printf("%d\n", StreamConfig.negativeChannel[channel]);
 
 		}
-	  
-	}else{
 
-		ErrorCheck(err, "LJM_eStreamRead Can I add extra info???");
-      	}
-	
+	}
 
-	// The mean and STD of the 10 scans are calculated for each channel.
-	for(channel = 0; channel < NumAddresses; channel++) {
+	// The registers are written by the same code as for the Python 
+	// LabJackT7 class (see ljLabjack.h).
+	std::string failed;
+	err = LJWriteStreamConfig(handle, StreamConfig, CHANNEL_NAMES,
+				  NumAddresses, failed);
+	if (err != LJME_NOERROR) 
+		ErrorCheck(err, "LJM_eWriteName(Handle=%d, Name=%s)", handle, 
+			   failed.c_str());
 
-		// These array values are initialized to 0.
-	      	sum[channel] = 0;
-	      	std[channel] = 0;
+	return SUCCESS;
+}
 
-	      	// The mean is calculated for an individual channel by looping through
-		// the 10 samples read for the channel.
-	      	for(i=0; i<ScansPerRead; i++){
+/*-- Start Stream --------------------------------------------------*/
 
-			sum[channel] += streamData[channel + NumAddresses*i];
-				
-			// a print test useful for debugging
-			//printf("Presently indexing %d from streamData\n", 
-			//		channel + NumAddresses*i);
-			//printf("Channel %d, sample %d value: %f\n", channel, i, 
-			//		streamData[channel + NumAddresses*i]);
+INT StartStream()
+{
 
-      		}
+	// (!!!) This is a major issue that should be resolved. Sometimes, 
+	// depending on how the program exits, the Labjack stream is left 
+	// running in the background. Then if one tries to restart the 
+	// program, it will throw an error. By simply uncommenting the
+	// following line, and thus stopping the stream first, this problem
+	// appears to be mitigated. This is a poor, and temporary solution.
+	err = Source->Stop();
 
-		// (!!!) This could be where the ~-e05 values are coming from
-		// If somehow ScansPerRead is made arbitrarily small, say 0
-		// somehow for one data point, then the mean calculation could
-		// yield the results were seeing. Should be investigated. 
-      		mean[channel] = sum[channel] / ScansPerRead;
+	// Sets the stream configuration, see definition. A replay or the
+	// simulation has no device to configure.
+	printf("Configuring the stream...\n");	
+	if (!ReplayEnabled && !SimulationEnabled) ConfigureStream(handle);
 
-      		// The standard deviation is calculating using a similar iteration.
-		for(i=0; i<ScansPerRead; i++){
+	// A triggered stream has nothing to read until the trigger.
+	LJMSource.SetTriggered(StreamConfig.triggerDIO >= 0);
+	Simulation.SetTrigger(StreamConfig.triggerDIO, StreamConfig.triggerEdge);
 
-        		std[channel] += pow(streamData[channel + NumAddresses*i] \
-						 - mean[channel], 2);
-      	
-		}
-		
-      		std[channel] = sqrt(std[channel] / ScansPerRead);
-    	
-	}
+	// The digital input is streamed after the channels.
+	int nAddresses = NumAddresses + StreamConfig.digitalChannels;
 
-	// (!!!) This is the ideal place for looking for a channel swap. 
-	// The feLabjack02_Jul4_backup.c file contains a rather rushed 
-	// skeleton of what should be implemented for this.
+	// Each channel takes a time to sample that depends on its range, the
+	// resolution index and the settling time. A scan has to fit all of 
+	// them, which limits the ScanRate. Asking for more than this makes the
+	// device buffer overflow, so it is either lowered or refused here.
+	double maxScanRate = T7MaxScanRate(StreamConfig);
+	printf("Maximum scan rate for this configuration: %.2f Hz\n", 
+	       maxScanRate);
 
-      	// deviceScanBackLog is the number of scans left in the device buffer
-      	// whereas LJMScanBackLog is the number of scans left in the LabJack
-      	// buffer. Recall that a single "scan" refers to a single reading from 
-      	// each channel.
-      	printf("iteration: %d - deviceScanBacklog: %d, LJMScanBacklog: %d\n",\
-	     	   iteration, deviceScanBacklog, LJMScanBacklog);
+	ScanRate = ControlledScanRate > 0 ? ControlledScanRate : RequestedScanRate;
+	if (ScanRate > maxScanRate) {
 
-	// (!!!) What does this do?
-      	*pdata++ = (double)time(NULL);
+		if (!ClampScanRate) {
 
+			cm_msg(MERROR, "StartStream",
+			       "ScanRate %.2f Hz exceeds the maximum of %.2f Hz for "
+			       "this range/resolution/settling configuration",
+			       ScanRate, maxScanRate);
+			return FE_ERR_ODB;
 
-	// ASSEMBLE DATA FOR MIDAS
-	// time, sample0, sample1, sample2.... sample99
-	// sample# = ch0_val, ch0_std, ch1_val, ch1_std... etc.
-	for (channel = 0; channel < NumAddresses; channel++) {
+		}
 
+		cm_msg(MINFO, "StartStream",
+		       "ScanRate %.2f Hz exceeds the maximum of %.2f Hz for this "
+		       "configuration, clamping it", ScanRate, maxScanRate);
+		ScanRate = maxScanRate;
 
-		printf(" %s\t Mean: %f \t Std %f \n", \
-			CHANNEL_NAMES[channel], mean[channel], std[channel]);
+	}
 
-		// (!!!) why?
-		*pdata++ = mean[channel];
-		*pdata++ = std[channel];
+	// Initializes a stream object and begins streaming (data from LabJack). 
+	// A Labjack error check is performed.
+	printf("Starting stream...\n");
+	// LJM_eStreamRead returns exactly the scans per read the stream was
+	// started with, and everything after the read (the cycles, the run
+	// totals, the skipped scan count) has to see every one of them. So
+	// the stream is started with ScansPerRead, no more.
+	// The Labjack, a replay and the simulation are all started the same
+	// way, so that a replay or a simulation goes through the same blocks
+	// as production. A replay has no digital input (see 
+	// ReadStreamSettings()), and runs at the rate of the recording.
+	err = Source->Start(ScansPerRead, nAddresses, aScanList, &ScanRate);
+
+	if (ReplayEnabled && err != LJME_NOERROR) {
+
+		cm_msg(MERROR, "StartStream", 
+		       "The replay has %d channels, the frontend %d",
+		       Replay.Channels(), NumAddresses);
+		return FE_ERR_ODB;
+
+	}
+
+	if (!ReplayEnabled && !SimulationEnabled)
+		ErrorCheck(err, "LJM_eStreamStart");
+
+	// Once the stream is started, some infromation on its rates are
+	// printed.
+	printf("Stream started. Actual scan rate: %.02f Hz (%.02f sample rate)\n",
+		 ScanRate, ScanRate * nAddresses);
+
+	if (StreamConfig.triggerDIO >= 0)
+		printf("Waiting for the trigger on DIO%d\n", 
+		       StreamConfig.triggerDIO);
+
+	return SUCCESS;
+}
+
+/*-- Stop Stream ---------------------------------------------------*/
+
+INT StopStream()
+{
+
+	printf("Stopping stream...\n");
+	err = Source->Stop();
+
+	return SUCCESS;
+}
+
+
+/*-- Setup Flight Recorder -----------------------------------------*/
+
+INT SetupFlightRecorder()
+{
+
+	int size;
+	BOOL dump = FALSE;
+
+	// A threshold of 0 disables triggering on that channel.
+	for (int i = 0; i < NumAddresses; i++) FlightRecorderThreshold[i] = 0;
+
+	size = sizeof(FlightRecorderSeconds);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/FlightRecorder/Seconds",
+		&FlightRecorderSeconds, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(FlightRecorderThreshold);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/FlightRecorder/Threshold",
+		FlightRecorderThreshold, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(FlightRecorderPostTrigger);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/FlightRecorder/PostTriggerSeconds",
+		&FlightRecorderPostTrigger, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(FlightRecorderHoldoff);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/FlightRecorder/HoldoffSeconds",
+		&FlightRecorderHoldoff, &size, TID_DOUBLE, TRUE);
+
+	// Setting Dump to y in the ODB requests a dump. It is reset once the
+	// request has been picked up by read_labjack_event().
+	size = sizeof(dump);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/FlightRecorder/Dump",
+		&dump, &size, TID_BOOL, TRUE);
+
+	// The whole window has to fit into one MIDAS event, so the ring can't
+	// be longer than that. The 1024 bytes leave room for the headers and
+	// the LBFI bank.
+	int capacity = (int)(FlightRecorderSeconds * ScanRate);
+	int maxCapacity = (max_event_size - 1024) / (sizeof(float) * NumAddresses);
+
+	if (capacity > maxCapacity) {
+
+		cm_msg(MINFO, "SetupFlightRecorder",
+		       "Flight recorder limited to %.1f s by max_event_size",
+		       maxCapacity / ScanRate);
+		capacity = maxCapacity;
+
+	}
+
+	// Reallocating discards the recorded scans, so it is only done when 
+	// the size actually changes.
+	if (capacity != FlightRecorder.Capacity()) {
+
+		FlightRecorder.Allocate(NumAddresses, capacity);
+		printf("Flight recorder holds %d scans (%.1f s)\n", 
+		       capacity, capacity / ScanRate);
+
+	}
+
+	return SUCCESS;
+}
+
+/*-- Trigger Flight Recorder ---------------------------------------*/
+
+BOOL TriggerFlightRecorder(int triggerChannel)
+{
+
+	// Only one dump can be pending at a time.
+	if (!FlightRecorder.Trigger((int)(FlightRecorderPostTrigger * ScanRate)))
+		return FALSE;
+
+	FlightRecorderTriggerTime = (double)time(NULL);
+	FlightRecorderTriggerChannel = triggerChannel;
+
+	if (triggerChannel < 0) {
+
+		cm_msg(MINFO, "TriggerFlightRecorder", 
+		       "Flight recorder dump requested");
+
+	}
+
+	else {
+
+		cm_msg(MINFO, "TriggerFlightRecorder",
+		       "Flight recorder triggered by %s beyond %f V",
+		       CHANNEL_NAMES[triggerChannel], 
+		       FlightRecorderThreshold[triggerChannel]);
+
+	}
+
+	return TRUE;
+}
+
+/*-- Check Flight Recorder Triggers --------------------------------*/
+
+void CheckFlightRecorderTriggers(const double *data, int nScans)
+{
+
+	int size;
+	BOOL dump = FALSE;
+
+	// A request through the ODB.
+	size = sizeof(dump);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/FlightRecorder/Dump",
+		&dump, &size, TID_BOOL, FALSE);
+
+	if (dump) {
+
+		dump = FALSE;
+		db_set_value(hDB, 0, 
+			"/Equipment/Labjack02/Settings/FlightRecorder/Dump",
+			&dump, sizeof(dump), 1, TID_BOOL);
+		TriggerFlightRecorder(-1);
+		return;
+
+	}
+
+	// After a threshold trigger, further triggers are ignored for the
+	// holdoff time, so a long excursion gives one dump rather than many.
+	if (FlightRecorder.Pending() ||
+	    time(NULL) - FlightRecorderTriggerTime < FlightRecorderHoldoff)
+		return;
+
+	for (int ch = 0; ch < NumAddresses; ch++) {
+
+		double threshold = FlightRecorderThreshold[ch];
+		if (threshold <= 0) continue;
+
+		for (int i = 0; i < nScans; i++) {
+
+			double value = data[ch + NumAddresses*i];
+
+			// Skipped scans are filled with LJM_DUMMY_VALUE (-9999).
+			if (value == LJM_DUMMY_VALUE) continue;
+
+			if (fabs(value) > threshold) {
+
+				TriggerFlightRecorder(ch);
+				return;
+
+			}
+
+		}
+
+	}
+}
+
+/*-- Setup Trigger -------------------------------------------------*/
+
+INT SetupTrigger()
+{
+
+	int size;
+	int window = 10;
+	double threshold[NumAddresses];
+	double slewLimit[NumAddresses];
+	double magnitudeChange[NumSensors];
+
+	// A value of 0 disables the condition for that channel or sensor.
+	for (int i = 0; i < NumAddresses; i++) threshold[i] = slewLimit[i] = 0;
+	for (int i = 0; i < NumSensors; i++) magnitudeChange[i] = 0;
+
+	size = sizeof(TriggerMode);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Trigger/Mode",
+		&TriggerMode, &size, TID_INT, TRUE);
+
+	size = sizeof(TriggerHeartbeat);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Trigger/HeartbeatSeconds",
+		&TriggerHeartbeat, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(window);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Trigger/WindowScans",
+		&window, &size, TID_INT, TRUE);
+
+	size = sizeof(threshold);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Trigger/Threshold",
+		threshold, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(slewLimit);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Trigger/SlewLimit",
+		slewLimit, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(magnitudeChange);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Trigger/MagnitudeChange",
+		magnitudeChange, &size, TID_DOUBLE, TRUE);
+
+	if (TriggerMode != TRIGGER_MODE_PERIODIC && 
+	    TriggerMode != TRIGGER_MODE_TRIGGERED) {
+
+		cm_msg(MERROR, "SetupTrigger", "Unknown trigger mode %d", TriggerMode);
+		return FE_ERR_ODB;
+
+	}
+
+	// A triggered event carries the whole block of raw scans, which has
+	// to fit into one event along with the LBJK bank.
+	if (TriggerMode == TRIGGER_MODE_TRIGGERED &&
+	    sizeof(double) * (NumAddresses * ScansPerRead + 2*NumAddresses + 1)
+	    + 1024 > (size_t)max_event_size) {
+
+		cm_msg(MERROR, "SetupTrigger",
+		       "ScansPerRead %d is too large for triggered events", 
+		       ScansPerRead);
+		return FE_ERR_ODB;
+
+	}
+
+	LJTriggerConfig config;
+	config.window = window;
+	config.threshold.assign(threshold, threshold + NumAddresses);
+	config.slewLimit.assign(slewLimit, slewLimit + NumAddresses);
+	config.magnitudeChange.assign(magnitudeChange, 
+				      magnitudeChange + NumSensors);
+	Trigger.Configure(config, NumAddresses, ScanRate);
+
+	// The first event after a (re)start is always sent.
+	LastEventTime = 0;
+
+	printf("Trigger mode: %s\n", 
+	       TriggerMode == TRIGGER_MODE_TRIGGERED ? "triggered" : "periodic");
+
+	return SUCCESS;
+}
+
+/*-- Setup Filter --------------------------------------------------*/
+
+INT SetupFilter()
+{
+
+	int size;
+	LJFilterConfig config;
+
+	// The defaults notch 60 Hz and its 2nd and 3rd harmonic, and don't
+	// decimate.
+	config.decimation = 1;
+	config.cicOrder = 3;
+	config.notchFrequency = 60;
+	config.notchHarmonics = 3;
+	config.notchQ = 30;
+
+	size = sizeof(FilterEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Filter/Enable",
+		&FilterEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(config.decimation);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Filter/Decimation",
+		&config.decimation, &size, TID_INT, TRUE);
+
+	size = sizeof(config.cicOrder);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Filter/CICOrder",
+		&config.cicOrder, &size, TID_INT, TRUE);
+
+	size = sizeof(config.notchFrequency);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Filter/NotchFrequency",
+		&config.notchFrequency, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.notchHarmonics);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Filter/NotchHarmonics",
+		&config.notchHarmonics, &size, TID_INT, TRUE);
+
+	size = sizeof(config.notchQ);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Filter/NotchQ",
+		&config.notchQ, &size, TID_DOUBLE, TRUE);
+
+	if (!FilterEnabled) return SUCCESS;
+
+	// Every block has to give at least one decimated scan for the mean.
+	if (config.decimation > ScansPerRead) {
+
+		cm_msg(MERROR, "SetupFilter",
+		       "Filter decimation %d is larger than ScansPerRead %d",
+		       config.decimation, ScansPerRead);
+		return FE_ERR_ODB;
+
+	}
+
+	// Beyond that the CIC integrators would no longer be exact.
+	if (LJFilter::GainBits(config.decimation, config.cicOrder) > 
+	    LJ_FILTER_MAX_GAIN_BITS) {
+
+		cm_msg(MERROR, "SetupFilter",
+		       "CICOrder %d times log2(Decimation %d) is more than %d "
+		       "bits", config.cicOrder, config.decimation, 
+		       LJ_FILTER_MAX_GAIN_BITS);
+		return FE_ERR_ODB;
+
+	}
+
+	Filter.Configure(config, NumAddresses, ScanRate);
+	filteredData.resize(NumAddresses * Filter.MaxOutput(ScansPerRead));
+
+	printf("Filter enabled: decimation %d (order %d), %.1f Hz notch with "
+	       "%d harmonics, output rate %.2f Hz\n", config.decimation,
+	       config.cicOrder, config.notchFrequency, config.notchHarmonics,
+	       Filter.OutputRate());
+
+	return SUCCESS;
+}
+
+/*-- Publish Block -------------------------------------------------*/
+
+void PublishBlock(const double *scans, double readTime, int deviceScanBacklog,
+		  int LJMScanBacklog)
+{
+
+	if (!BlockBus.Running()) return;
+
+	// If every pool block is still held by consumers, this block is lost
+	// for them; the bus counts it as dropped.
+	LJBlock *block = BlockBus.Acquire();
+	if (!block) return;
+
+	block->time = readTime;
+	block->scanRate = ScanRate;
+	block->nChannels = NumAddresses;
+	block->nScans = ScansPerRead;
+	block->deviceBacklog = deviceScanBacklog;
+	block->ljmBacklog = LJMScanBacklog;
+	memcpy(&block->data[0], scans, 
+	       sizeof(double) * NumAddresses * ScansPerRead);
+
+	BlockBus.Publish(block);
+}
+
+/*-- Setup Tap -----------------------------------------------------*/
+
+INT SetupTap()
+{
+
+	int size;
+	BOOL enable = FALSE;
+	char shmName[256] = "/labjack02_tap";
+	char socketAddress[256] = "";
+	char archive[256] = "";
+	int sizeMB = 64;
+
+	size = sizeof(enable);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Tap/Enable",
+		&enable, &size, TID_BOOL, TRUE);
+
+	size = sizeof(shmName);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Tap/SharedMemory",
+		shmName, &size, TID_STRING, TRUE);
+
+	size = sizeof(sizeMB);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Tap/SizeMB",
+		&sizeMB, &size, TID_INT, TRUE);
+
+	// Empty for no socket, otherwise "unix:/path" or "tcp:port".
+	size = sizeof(socketAddress);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Tap/Socket",
+		socketAddress, &size, TID_STRING, TRUE);
+
+	// Empty for no archive, otherwise a file the blocks are appended to,
+	// which can be replayed later (see SetupReplay()).
+	size = sizeof(archive);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Tap/Archive",
+		archive, &size, TID_STRING, TRUE);
+
+	if (!enable) return SUCCESS;
+
+	std::vector<std::string> names(CHANNEL_NAMES, CHANNEL_NAMES + NumAddresses);
+	std::string error;
+
+	if (!Tap.OpenSharedMemory(shmName, (size_t)sizeMB * 1024 * 1024, names,
+				  error)) {
+
+		cm_msg(MERROR, "SetupTap", "Cannot open tap shared memory %s: %s",
+		       shmName, error.c_str());
+		return FE_ERR_HW;
+
+	}
+
+	if (socketAddress[0] && !Tap.OpenSocket(socketAddress, error)) {
+
+		cm_msg(MERROR, "SetupTap", "Cannot open tap socket: %s", 
+		       error.c_str());
+		return FE_ERR_HW;
+
+	}
+
+	if (archive[0] && !Tap.OpenArchive(archive, error)) {
+
+		cm_msg(MERROR, "SetupTap", "Cannot open tap archive: %s", 
+		       error.c_str());
+		return FE_ERR_HW;
+
+	}
+
+	BlockBus.Subscribe("tap", &Tap, LJ_DROP_OLDEST, 4);
+
+	printf("Data tap on shared memory %s (%d MB)%s%s\n", shmName, sizeMB,
+	       socketAddress[0] ? " and " : "", socketAddress);
+
+	return SUCCESS;
+}
+
+/*-- Setup Allan ---------------------------------------------------*/
+
+INT SetupAllan()
+{
+
+	int size;
+
+	size = sizeof(AllanEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Allan/Enable",
+		&AllanEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(AllanMaxTau);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Allan/MaxTauSeconds",
+		&AllanMaxTau, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(AllanPeriod);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Allan/PeriodSeconds",
+		&AllanPeriod, &size, TID_DOUBLE, TRUE);
+
+	if (!AllanEnabled) return SUCCESS;
+
+	if (AllanMaxTau <= 0) {
+
+		cm_msg(MERROR, "SetupAllan", "Allan MaxTauSeconds must be positive");
+		return FE_ERR_ODB;
+
+	}
+
+	Allan.Configure(NumAddresses, ScanRate, AllanMaxTau);
+
+	// A dropped block makes the scans either side of it look adjacent,
+	// which hardly matters for the deviation; holding up acquisition 
+	// would.
+	BlockBus.Subscribe("allan", &Allan, LJ_DROP_NEWEST, 16);
+	AllanLastReport = time(NULL);
+
+	printf("Allan deviation for averaging times up to %.0f s, reported "
+	       "every %.0f s\n", AllanMaxTau, AllanPeriod);
+
+	return SUCCESS;
+}
+
+/*-- Setup Realtime ------------------------------------------------*/
+
+INT SetupRealtime()
+{
+
+	int size;
+	BOOL lockMemory = FALSE;
+
+	size = sizeof(Realtime.cpu);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Realtime/CPU",
+		&Realtime.cpu, &size, TID_INT, TRUE);
+
+	size = sizeof(Realtime.priority);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Realtime/Priority",
+		&Realtime.priority, &size, TID_INT, TRUE);
+
+	size = sizeof(lockMemory);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Realtime/LockMemory",
+		&lockMemory, &size, TID_BOOL, TRUE);
+	Realtime.lockMemory = lockMemory;
+
+	size = sizeof(LoopWaitMs);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Realtime/MaxLoopWaitMs",
+		&LoopWaitMs, &size, TID_INT, TRUE);
+
+	std::string error;
+
+	if (LoopWaitMs < 0 || !LJCheckRealtime(Realtime, error)) {
+
+		cm_msg(MERROR, "SetupRealtime", "Bad realtime settings: %s",
+		       error.empty() ? "MaxLoopWaitMs is negative" : error.c_str());
+		return FE_ERR_ODB;
+
+	}
+
+	if (Realtime.cpu < 0 && Realtime.priority == 0 && !Realtime.lockMemory)
+		return SUCCESS;
+
+	// Without the privileges the frontend still runs, as it always did.
+	if (!LJApplyRealtime(Realtime, error))
+		cm_msg(MERROR, "SetupRealtime", "Realtime settings not applied "
+		       "(%s), carrying on without them", error.c_str());
+
+	printf("Frontend thread on CPU %d, SCHED_FIFO priority %d, memory %s\n",
+	       Realtime.cpu, Realtime.priority, 
+	       Realtime.lockMemory ? "locked" : "not locked");
+
+	return SUCCESS;
+}
+
+/*-- Frontend Loop -------------------------------------------------*/
+
+INT LoopWait()
+{
+	DWORD now = ss_millitime();
+	INT wait = LoopWaitMs;
+
+	// Only the equipment which is read periodically counts; the summary is
+	// only read at the end of a run.
+	for (int i = 0; equipment[i].name[0]; i++) {
+
+		EQUIPMENT_INFO *info = &equipment[i].info;
+		if (!info->enabled || !(info->eq_type & EQ_PERIODIC) ||
+		    !(info->read_on & (RO_RUNNING | RO_STOPPED | RO_PAUSED)))
+			continue;
+
+		INT due = (INT)(equipment[i].last_called + info->period - now);
+		if (due < wait) wait = due;
+
+	}
+
+	return wait > 0 ? wait : 0;
+}
+
+INT frontend_loop()
+{
+	
+	/* if frontend_call_loop is true, this routine gets called when
+	  the frontend is idle or once between every event */
+	ReportProfile();
+	ReportAllan();
+
+	// The scheduler comes straight back here, so rather than spinning the
+	// frontend waits in cm_yield() until the next periodic readout is due.
+	// cm_yield() returns as soon as there is an RPC or ODB change to
+	// handle. It returns SS_TIMEOUT when the wait simply runs out, and 
+	// mfe takes anything but SUCCESS from here as a shutdown, so only a
+	// real shutdown is passed on.
+	INT status = cm_yield(LoopWait());
+	if (status == RPC_SHUTDOWN || status == SS_ABORT) return RPC_SHUTDOWN;
+
+	return SUCCESS;
+}
+
+/*------------------------------------------------------------------*/
+
+/********************************************************************\
+
+  Readout routines for different events
+
+\********************************************************************/
+
+// (!!!) "Trigger event routines" and "Interrupt configuration" 
+// are of what use? These two pieces of code are not understood.
+
+/*-- Trigger event routines ----------------------------------------*/
+// Not currently used for DCRC readout
+extern "C" { INT poll_event(INT source, INT count, BOOL test)
+/* Polling routine for events. Returns TRUE if event
+   is available. If test equals TRUE, don't return. The test
+   flag is used to time the polling */
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		//      cam_lam_read(LAM_SOURCE_CRATE(source), &lam);
+
+		//      if (lam & LAM_SOURCE_STATION(source))
+		if (!test) {
+
+			return 1;
+		}
+
+	}
+
+	// There is no polled equipment: the readout of the periodic equipment
+	// blocks in the stream read until a block is there, so there is
+	// nothing to wait for here.
+	return 0;
+}
+}
+
+/*-- Interrupt configuration ---------------------------------------*/
+// This is not currently used by the DCRC readout
+extern "C" { INT interrupt_configure(INT cmd, INT source, POINTER_T adr)
+{
+	switch (cmd) {
+	case CMD_INTERRUPT_ENABLE:
+	  break;
+	case CMD_INTERRUPT_DISABLE:
+	  break;
+	case CMD_INTERRUPT_ATTACH:
+	  break;
+	case CMD_INTERRUPT_DETACH:
+	  break;
+	}
+	return SUCCESS;
+} 
+
+/*-- Event readout -------------------------------------------------*/
+INT read_labjack_event(char *pevent, INT iter)
+{
+
+	// The stages of the event are timed in a build with the per-stage
+	// timers (see ljProfile.h), otherwise these do nothing.
+	LJ_PROFILE_SCOPE("event");
+
+	// ____________________________________________        
+        // ********************************************
+	// VARIABLE INITIALIZATION
+
+	// The time at the start of the read is used to time-stamp the block
+	// handed to the block bus.
+	struct timeval te; 
+  	gettimeofday(&te, NULL);
+
+  	// Printing out the time in milliseconds to confirm time between calls to 
+  	// read_labjack_evennt function - useful to keep around for debugging
+	// calculate milliseconds
+   	// long long milliseconds = te.tv_sec*1000LL + te.tv_usec/1000;
+   	// printf("milliseconds: %lld\n", milliseconds);
+
+	// (!!!) This bank, and pdata piece is unclear, could be better 
+	// explained or documented.
+  	/* init bank structure */
+  	bk_init32(pevent);
+  	double *pdata;
+
+	// The scans are always read into streamData. In the triggered mode,
+	// they are copied into an LBRW bank only once the trigger has fired,
+	// so that a block that doesn't fire leaves nothing behind in the 
+	// event.
+	double *scans = streamData;
+
+	// The LBJK values, the time followed by the mean and STD of every 
+	// channel, are written by the statistics kernel straight into the 
+	// LBJK bank. With compression they are assembled in packed, and 
+	// encoded into an LBJZ bank once they are all there.
+	double packed[1 + 2 * NumAddresses];
+	pdata = packed;
+  	/* create bank of double words */
+	if (!CompressionEnabled)
+	  	bk_create(pevent, "LBJK", TID_DOUBLE, (void **)&pdata); 
+
+	// The mean and STD of channel c are stats[2 * c] and stats[2 * c + 1].
+	double *stats = pdata + 1;
+
+	// A rate change decided after the previous read is applied before
+	// this one.
+	if (RateChangePending) ApplyScanRateChange();
+	if (StreamFailed) return 0;
+
+	// These backlog variables are for keeping track of how many scans are
+	// left over in each of the deviceBuffer and the LJMBuffer, after each
+	// read.
+  	int deviceScanBacklog = 0;
+  	int LJMScanBacklog = 0;
+  	int i;
+
+	// Call to eStreamRead should read "ScanRate" many values from each address,
+	{
+		LJ_PROFILE_SCOPE("read");
+		err = Source->Read(scans, &deviceScanBacklog, &LJMScanBacklog);
+	}
+
+	// At the end of a replay, no more events are sent. The rate at which
+	// the recording went through the frontend is printed once per run.
+	// A block is read once per equipment period at most, so only at a 
+	// replay speed of 0 and a period of 1 ms is this the throughput of the
+	// whole pipeline.
+	if (err == LJ_STREAM_END) {
+
+		if (!ReplayReported) {
+
+			cm_msg(MINFO, "read_labjack_event", 
+			       "Replay finished: %llu scans in %.2f s, %.0f scans/s",
+			       (unsigned long long)Replay.Scans(), Replay.Elapsed(),
+			       Replay.Scans() / Replay.Elapsed());
+			ReplayReported = TRUE;
+
+		}
+
+		return 0;
+
+	}
+
+	// A triggered stream sends no events until it has been triggered.
+	if (err == LJ_STREAM_WAITING) return 0;
+
+	// Can be useful for testing:
+	// A loop to check the the individual voltage measurements, 
+	// i.e. the samples from individual channels.
+	//std::cout.precision(15);
+	//for(j = 0; j < ScanRate * NumAddresses; j++) {
+	//	std::cout << std::fixed << streamData[j] << std::endl;	
+	//}
+
+	// Some error checks are performed
+	if(err == 1221){ // ignore errors of type 1221
+
+		static int error_count = 0;
+		error_count++;
+		RunSummary.CountError();
+		cm_msg(MINFO,"read_labjack_event",
+		       "Gotten labjack error with error number = 1221, ",
+		       "Number errors: %i",error_count);
+
+		if(error_count > 100) {
+
+			ErrorCheck(err, "LJM_eStreamRead too many errors");
+
+		}
+	  
+	}else{
+
+		ErrorCheck(err, "LJM_eStreamRead Can I add extra info???");
+      	}
+
+	// The digital states are split off, and from here on the scans have
+	// the analog channels only.
+	if (StreamConfig.digitalChannels) SplitDigitalStates(scans);
+
+	// Skipped scans are filled with -9999 (LJM_DUMMY_VALUE) by LJM.
+	int skippedScans = 0;
+	for (i = 0; i < ScansPerRead; i++)
+		if (scans[NumAddresses * i] == LJM_DUMMY_VALUE) skippedScans++;
+
+	// The rate controller looks at the backlogs and skipped scans. A 
+	// change is applied at the start of the next read.
+	if (RateControlEnabled) {
+
+		double rate = RateController.Update(te.tv_sec + 1e-6 * te.tv_usec,
+						    deviceScanBacklog, 
+						    LJMScanBacklog, skippedScans);
+
+		if (rate != RateController.Rate()) {
+
+			ControlledScanRate = rate;
+			RateChangePending = TRUE;
+
+		}
+
+	}
+
+	// The block is handed to the block bus consumers, which do their work
+	// on their own threads while this one carries on.
+	{
+		LJ_PROFILE_SCOPE("publish");
+		PublishBlock(scans, te.tv_sec + 1e-6 * te.tv_usec, 
+			     deviceScanBacklog, LJMScanBacklog);
+	}
+	
+
+	// The raw scans are kept in the flight recorder, and the block is
+	// checked for anything that should trigger a dump.
+	{
+		LJ_PROFILE_SCOPE("recorder");
+		FlightRecorder.Record(scans, ScansPerRead);
+		CheckFlightRecorderTriggers(scans, ScansPerRead);
+	}
+
+	// The cycles are built here rather than by a block bus consumer, as
+	// the bus may drop blocks and every scan has to be counted for the
+	// cycles to stay aligned with the edges. The time of the read is that
+	// of the block's first scan, to within the time of a read.
+	if (CycleEnabled) {
+
+		LJ_PROFILE_SCOPE("cycle");
+		Cycles.Add(scans, &DigitalStates[0], ScansPerRead,
+			   te.tv_sec + 1e-6 * te.tv_usec);
+
+	}
+
+	// The run totals are kept here for the same reason: they have to 
+	// count every scan, and every source returns exactly ScansPerRead 
+	// scans per read (see StartStream()). ScansPerRead follows the rate 
+	// under rate control, so it is taken per read.
+	{
+		LJ_PROFILE_SCOPE("summary");
+		RunSummary.Add(scans, ScansPerRead, deviceScanBacklog, 
+			       LJMScanBacklog);
+	}
+
+	// If the filter is enabled, the mean and STD are taken from the 
+	// filtered, decimated scans rather than the raw ones. The filter keeps
+	// its state between reads, so the number of decimated scans can vary
+	// by one from block to block.
+	const double *statsData = scans;
+	int statsScans = ScansPerRead;
+
+	if (FilterEnabled) {
+
+		LJ_PROFILE_SCOPE("filter");
+		statsScans = Filter.Process(scans, ScansPerRead, 
+					    &filteredData[0]);
+		statsData = &filteredData[0];
+
+	}
+
+	// The mean and STD of the scans are calculated for each channel by the
+	// kernel for the channel count (see ljStats.h), which may de-interleave
+	// the scans into StatsChannels first. An empty block, e.g. from a 
+	// filter that hasn't produced a decimated scan yet, gives 0 rather 
+	// than NaN.
+	{
+		LJ_PROFILE_SCOPE("stats");
+		StatsInBlock = StatsKernel->meanStd(statsData, NumAddresses, 
+						    statsScans, StatsChannels, 
+						    stats, stats + 1, 2);
+	}
+
+	// The robust statistics need the scans de-interleaved, which the 
+	// kernel may not have done.
+	if (RobustEnabled) {
+
+		LJ_PROFILE_SCOPE("robust");
+
+		if (!StatsInBlock) {
+
+			StatsChannels.Load(statsData, NumAddresses, statsScans);
+			StatsInBlock = true;
+
+		}
+
+		Robust.Compute(StatsChannels, RobustValues);
+
+		if (RobustReplaceMean) {
+
+			const double *r = RobustValues;
+			for (channel = 0; channel < NumAddresses; channel++) {
+
+				stats[2 * channel] = 
+					r[LJRobustStats::VALUES * channel + 2];
+				stats[2 * channel + 1] = 
+					r[LJRobustStats::VALUES * channel + 3];
+
+			}
+
+		}
+
+	}
+
+	// The derived quantities and the history are taken from the 
+	// calibrated means.
+	double means[NumAddresses];
+	if (DerivedEnabled || HistoryEnabled) CalibrateMeans(stats, means);
+
+	// The means are added to the history average, whatever the mode.
+	if (HistoryEnabled) {
+
+		LJ_PROFILE_SCOPE("history");
+		UpdateHistory(means);
+
+	}
+
+	// (!!!) This is the ideal place for looking for a channel swap. 
+	// The feLabjack02_Jul4_backup.c file contains a rather rushed 
+	// skeleton of what should be implemented for this.
+
+      	// deviceScanBackLog is the number of scans left in the device buffer
+      	// whereas LJMScanBackLog is the number of scans left in the LabJack
+      	// buffer. Recall that a single "scan" refers to a single reading from 
+      	// each channel.
+	{
+		LJ_PROFILE_SCOPE("print");
+
+	      	printf("iteration: %d - deviceScanBacklog: %d, LJMScanBacklog: %d\n",\
+		     	   iteration, deviceScanBacklog, LJMScanBacklog);
+
+		for (channel = 0; channel < NumAddresses; channel++)
+			printf(" %s\t Mean: %f \t Std %f \n", \
+				CHANNEL_NAMES[channel], stats[2 * channel], 
+				stats[2 * channel + 1]);
+	}
+
+	// Everything from here to the end of the event is timed as "bank",
+	// including the trigger evaluation, which has its own stage too.
+	LJ_PROFILE_SCOPE("bank");
+
+	// TRIGGERED MODE
+	// The block is checked for the trigger conditions. If none fired, the
+	// event is dropped unless the heartbeat is due. If one did, the raw 
+	// scans are sent too (see below), so that the transient is seen at 
+	// full rate.
+	int fired = 0;
+
+	if (TriggerMode == TRIGGER_MODE_TRIGGERED) {
+
+		{
+			LJ_PROFILE_SCOPE("trigger");
+			fired = Trigger.Evaluate(scans, ScansPerRead);
+		}
+		time_t now = time(NULL);
+
+		// Returning 0 tells MIDAS that there is no event to send. A
+		// pending layout header is sent straight away, though.
+		if (!fired && !BankHeaderPending &&
+		    now - LastEventTime < TriggerHeartbeat) return 0;
+
+		LastEventTime = now;
+
+	}
+
+	// ASSEMBLE DATA FOR MIDAS
+	// time, sample0, sample1, sample2.... sample99
+	// sample# = ch0_val, ch0_std, ch1_val, ch1_std... etc.
+	pdata[0] = (double)time(NULL);
+
+	// (!!!) What's happening here?
+	//int size = bk_close(pevent, pdata);
+	// LBJZ holds the time as a double, followed by the means and stds as
+	// two compressed series.
+	if (CompressionEnabled)
+		CreateCompressedBank(pevent, "LBJZ", packed, 1, packed + 1, 2, 
+				     NumAddresses);
+
+	else
+		bk_close(pevent, pdata + 1 + 2 * NumAddresses);
+
+	// LBDV holds the magnitude and direction of every sensor, followed by
+	// the gradients of the configured pairs.
+	if (DerivedEnabled) {
+
+		double *pderived;
+		bk_create(pevent, "LBDV", TID_DOUBLE, (void **)&pderived);
+		Derived.Compute(means, 1, pderived);
+		pderived += Derived.Values();
+		bk_close(pevent, pderived);
+
+	}
+
+	// LBRS holds the median, MAD, clipped mean, clipped std and number of
+	// rejected scans of every channel.
+	if (RobustEnabled) {
+
+		double *probust;
+		bk_create(pevent, "LBRS", TID_DOUBLE, (void **)&probust);
+		memcpy(probust, RobustValues, sizeof(RobustValues));
+		probust += LJRobustStats::VALUES * NumAddresses;
+		bk_close(pevent, probust);
+
+	}
+
+	// The trigger that fired, with the raw scans.
+	if (TriggerMode == TRIGGER_MODE_TRIGGERED) {
+
+		// LBTG holds the mask of the conditions that fired (see the
+		// LJ_TRIGGER_* bits in ljTrigger.h, 0 for a heartbeat) and the 
+		// first channel that fired them (-1 for a heartbeat).
+		INT *ptrig;
+		bk_create(pevent, "LBTG", TID_INT, (void **)&ptrig);
+		*ptrig++ = fired;
+		*ptrig++ = Trigger.FiredChannel();
+		bk_close(pevent, ptrig);
+
+		if (fired && CompressionEnabled) {
+
+			// LBRZ holds the raw scans compressed, one series per
+			// channel. Without the filter they are already 
+			// de-interleaved in StatsChannels if the kernel put
+			// them there.
+			bool raw = !FilterEnabled && StatsInBlock;
+			if (!raw)
+				RawChannels.Load(scans, NumAddresses, 
+						 ScansPerRead);
+
+			CreateCompressedChannelBank(pevent, "LBRZ", 
+				raw ? StatsChannels : RawChannels);
+
+		} else if (fired) {
+
+			// LBRW holds the raw scans, interleaved as they were
+			// read, in one copy from streamData.
+			double *praw;
+			bk_create(pevent, "LBRW", TID_DOUBLE, (void **)&praw);
+			memcpy(praw, scans, 
+			       sizeof(double) * NumAddresses * ScansPerRead);
+			praw += NumAddresses * ScansPerRead;
+			bk_close(pevent, praw);
+
+		}
+
+	}
+
+	// LBHD describes the layout of the banks (see ljBankFormat.h).
+	if (BankHeaderPending) {
+
+		uint8_t *pheader;
+		bk_create(pevent, "LBHD", TID_BYTE, (void **)&pheader);
+		pheader += LJBankHeaderEncode(BankLayout, pheader);
+		bk_close(pevent, pheader);
+
+		BankHeaderPending = FALSE;
+
+	}
+
+	// LBRT holds the scan rate the block was read at, the read latency
+	// (see ljRateControl.h), the device and LJM backlogs and the number
+	// of skipped scans.
+	double *prate;
+	bk_create(pevent, "LBRT", TID_DOUBLE, (void **)&prate);
+	*prate++ = ScanRate;
+	*prate++ = (deviceScanBacklog + LJMScanBacklog) / ScanRate;
+	*prate++ = deviceScanBacklog;
+	*prate++ = LJMScanBacklog;
+	*prate++ = skippedScans;
+	bk_close(pevent, prate);
+
+	// LBHR is the id of the layout this event was written with.
+	DWORD *pref;
+	bk_create(pevent, "LBHR", TID_DWORD, (void **)&pref);
+	*pref++ = BankLayout.layoutId;
+	bk_close(pevent, pref);
+
+	return bk_size(pevent);
+
+}
+}
+
+
+
+
+/*-- Flight recorder readout ---------------------------------------*/
+INT read_flight_recorder_event(char *pevent, INT iter)
+{
+
+	// Returning 0 tells MIDAS that there is no event to send.
+	if (!FlightRecorder.Ready()) return 0;
+
+	bk_init32(pevent);
+
+	// LBFR holds the raw scans, oldest first, interleaved in the same way
+	// as the stream data: ch0, ch1, ... chN, ch0, ch1, ...
+	float *pdata;
+	bk_create(pevent, "LBFR", TID_FLOAT, (void **)&pdata);
+	int nScans = FlightRecorder.Snapshot(pdata, FlightRecorder.Capacity());
+	pdata += nScans * NumAddresses;
+	bk_close(pevent, pdata);
+
+	// LBFI describes the dump: trigger time, scan rate, number of channels,
+	// number of scans and the channel that triggered (-1 if requested).
+	double *pinfo;
+	bk_create(pevent, "LBFI", TID_DOUBLE, (void **)&pinfo);
+	*pinfo++ = FlightRecorderTriggerTime;
+	*pinfo++ = ScanRate;
+	*pinfo++ = NumAddresses;
+	*pinfo++ = nScans;
+	*pinfo++ = FlightRecorderTriggerChannel;
+	bk_close(pevent, pinfo);
+
+	printf("Sent flight recorder dump of %d scans\n", nScans);
+
+	return bk_size(pevent);
+}
+
+/*-- Setup Cycle ---------------------------------------------------*/
+
+INT SetupCycle()
+{
+
+	// Cycle/Enable is read with the stream settings, as it decides 
+	// whether the digital input is streamed (see ReadStreamSettings()).
+	int size;
+	LJCycleConfig config;
+	double holdoffSeconds = 0.01;
+	double binSeconds = 0.1;
+	double maxCycleSeconds = 0;
+
+	config.maxBins = 100;
+
+	// The cycles start on Edge (0 rising, 1 falling, 2 both) of DIO, 
+	// which is bit DIO of FIO_EIO_STATE.
+	size = sizeof(config.dio);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/DIO",
+		&config.dio, &size, TID_INT, TRUE);
+
+	size = sizeof(config.edge);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/Edge",
+		&config.edge, &size, TID_INT, TRUE);
+
+	size = sizeof(holdoffSeconds);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/HoldoffSeconds",
+		&holdoffSeconds, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(binSeconds);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/BinSeconds",
+		&binSeconds, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.maxBins);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/MaxBins",
+		&config.maxBins, &size, TID_INT, TRUE);
+
+	// 0 for cycles of any length.
+	size = sizeof(maxCycleSeconds);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Cycle/MaxCycleSeconds",
+		&maxCycleSeconds, &size, TID_DOUBLE, TRUE);
+
+	if (!CycleEnabled) return SUCCESS;
+
+	if (config.dio < 0 || config.dio >= LJ_DIGITAL_LINES ||
+	    config.edge < LJ_EDGE_RISING || config.edge > LJ_EDGE_BOTH) {
+
+		cm_msg(MERROR, "SetupCycle",
+		       "Cycle/DIO %d must be 0-%d, and Cycle/Edge %d 0-2",
+		       config.dio, LJ_DIGITAL_LINES - 1, config.edge);
+		return FE_ERR_ODB;
+
+	}
+
+	if (config.maxBins < 0 || binSeconds <= 0 || holdoffSeconds < 0 ||
+	    maxCycleSeconds < 0) {
+
+		cm_msg(MERROR, "SetupCycle", 
+		       "Cycle/MaxBins, BinSeconds, HoldoffSeconds and "
+		       "MaxCycleSeconds cannot be negative");
+		return FE_ERR_ODB;
+
+	}
+
+	// The cycle event has to fit the description, the statistics and the
+	// profile.
+	int eventSize = sizeof(double) * (12 + 4 * NumAddresses + 
+					  config.maxBins * NumAddresses) + 1024;
+	if (eventSize > max_event_size) {
+
+		cm_msg(MERROR, "SetupCycle",
+		       "Cycle/MaxBins %d makes the cycle event %d bytes, more "
+		       "than the maximum of %d", config.maxBins, eventSize,
+		       max_event_size);
+		return FE_ERR_ODB;
+
+	}
+
+	config.holdoffScans = (int)(holdoffSeconds * ScanRate);
+	config.binScans = (int)(binSeconds * ScanRate + 0.5);
+	config.maxScans = (uint64_t)(maxCycleSeconds * ScanRate);
+
+	// A stream triggered by the cycle edge starts with a cycle, whose own
+	// edge is never seen in the digital states.
+	config.startAtFirstScan = StreamConfig.triggerDIO == config.dio &&
+		StreamConfig.triggerEdge == config.edge;
+
+	Cycles.Configure(config, NumAddresses, ScanRate);
+	DigitalStates.resize(ScansPerRead);
+
+	printf("Cycles on edge %d of DIO%d, profiles of up to %d bins of %d "
+	       "scans\n", config.edge, config.dio, config.maxBins,
+	       Cycles.Config().binScans);
+
+	return SUCCESS;
+}
+
+/*-- Split Digital States ------------------------------------------*/
+
+void SplitDigitalStates(double *scans)
+{
+
+	// Each scan is the channels followed by the digital state. The 
+	// channels are moved down over the states, so that the scans are 
+	// NumAddresses apart as everywhere else.
+	const int stride = NumAddresses + 1;
+
+	for (int i = 0; i < ScansPerRead; i++) {
+
+		DigitalStates[i] = scans[stride * i + NumAddresses];
+		memmove(&scans[NumAddresses * i], &scans[stride * i],
+			sizeof(double) * NumAddresses);
+
+	}
+}
+
+/*-- Cycle readout -------------------------------------------------*/
+INT read_cycle_event(char *pevent, INT iter)
+{
+
+	// Returning 0 tells MIDAS that there is no event to send. One cycle
+	// is sent at a time; any others are sent at the next calls.
+	if (!CycleEnabled || !Cycles.Ready()) return 0;
+
+	const LJCycle &cycle = Cycles.Front();
+	int nChannels = Cycles.Channels();
+
+	bk_init32(pevent);
+
+	// LBCY describes the cycle: cycle number, unix time of the edge, scan
+	// of the edge since the stream started, number of scans, length (s),
+	// skipped scans, flags (LJ_CYCLE_*), scan rate, number of channels, 
+	// scans per profile bin, number of bins and the cycles dropped so far.
+	double *pdata;
+	bk_create(pevent, "LBCY", TID_DOUBLE, (void **)&pdata);
+	*pdata++ = cycle.number;
+	*pdata++ = cycle.time;
+	*pdata++ = cycle.firstScan;
+	*pdata++ = cycle.nScans;
+	*pdata++ = cycle.nScans / Cycles.ScanRate();
+	*pdata++ = cycle.skipped;
+	*pdata++ = cycle.flags;
+	*pdata++ = Cycles.ScanRate();
+	*pdata++ = nChannels;
+	*pdata++ = Cycles.Config().binScans;
+	*pdata++ = cycle.nBins;
+	*pdata++ = Cycles.Dropped();
+	bk_close(pevent, pdata);
+
+	// LBCS has the mean, STD, minimum and maximum over the cycle, channel
+	// by channel.
+	bk_create(pevent, "LBCS", TID_DOUBLE, (void **)&pdata);
+	for (int c = 0; c < nChannels; c++) {
+
+		*pdata++ = cycle.mean[c];
+		*pdata++ = cycle.std[c];
+		*pdata++ = cycle.min[c];
+		*pdata++ = cycle.max[c];
+
+	}
+	bk_close(pevent, pdata);
+
+	// LBCB is the profile, interleaved as the scans are: the means of bin
+	// 0 for ch0, ch1, ... chN, then bin 1, ...
+	if (cycle.nBins > 0) {
+
+		bk_create(pevent, "LBCB", TID_DOUBLE, (void **)&pdata);
+		memcpy(pdata, &cycle.bins[0], 
+		       sizeof(double) * cycle.nBins * nChannels);
+		pdata += cycle.nBins * nChannels;
+		bk_close(pevent, pdata);
+
+	}
+
+	Cycles.Pop();
+
+	return bk_size(pevent);
+}
+
+/*-- Run summary ---------------------------------------------------*/
+
+void WriteRunSummary()
+{
+
+	const LJRunSummary &summary = RunSummary;
+	int n = summary.Channels();
+	if (n == 0) return;
+
+	// The values are those of the LBSM bank. The counts are doubles, as
+	// the scans of a long run can pass 2^32.
+	std::vector<double> values(summary.Values());
+	summary.Write(&values[0]);
+
+	static const char *const RUN_KEYS[LJRunSummary::RUN_VALUES] = {
+		"Run", "Start time", "Seconds", "Scans", "Skipped scans", 
+		"Reads", "Read errors", "Rate changes", "Max device backlog",
+		"Max LJM backlog", "Channels"
+	};
+
+	for (int i = 0; i < LJRunSummary::RUN_VALUES; i++) {
+
+		char path[256];
+		snprintf(path, sizeof(path), "/Equipment/Labjack02/Summary/%s",
+			 RUN_KEYS[i]);
+		db_set_value(hDB, 0, path, &values[i], sizeof(double), 1, 
+			     TID_DOUBLE);
+
+	}
+
+	// Every per-channel value is an array over the channels, in the order
+	// of CHANNEL_NAMES.
+	static const char *const CHANNEL_KEYS[LJRunSummary::CHANNEL_VALUES] = {
+		"Mean (V)", "STD (V)", "Min (V)", "Max (V)", "Samples",
+		"Effective rate (Hz)"
+	};
+
+	std::vector<double> channel(n);
+
+	for (int k = 0; k < LJRunSummary::CHANNEL_VALUES; k++) {
+
+		for (int c = 0; c < n; c++)
+			channel[c] = values[LJRunSummary::RUN_VALUES + 
+					    LJRunSummary::CHANNEL_VALUES * c + k];
+
+		char path[256];
+		snprintf(path, sizeof(path), "/Equipment/Labjack02/Summary/%s",
+			 CHANNEL_KEYS[k]);
+		db_set_value(hDB, 0, path, &channel[0], n * sizeof(double), n,
+			     TID_DOUBLE);
+
+	}
+}
+
+/*-- Summary readout -----------------------------------------------*/
+INT read_summary_event(char *pevent, INT iter)
+{
+
+	// Returning 0 tells MIDAS that there is no event to send.
+	if (!RunSummaryPending) return 0;
+	RunSummaryPending = FALSE;
+
+	bk_init32(pevent);
+
+	// LBSM holds the run totals and the statistics of every channel over
+	// the run (see LJRunSummary::Write()).
+	double *pdata;
+	bk_create(pevent, "LBSM", TID_DOUBLE, (void **)&pdata);
+	RunSummary.Write(pdata);
+	pdata += RunSummary.Values();
+	bk_close(pevent, pdata);
+
+	return bk_size(pevent);
+}
+
+/*-- JSON-RPC ------------------------------------------------------*/
+INT rpc_callback(INT index, void *prpc_param[])
+{
+
+	// The command and its arguments come in as strings, and a reply of at
+	// most return_max_length characters can be written to return_buf.
+	const char *cmd = CSTRING(0);
+	char *return_buf = CSTRING(2);
+	int return_max_length = CINT(3);
+
+	// "flight_recorder_dump" requests a dump of the flight recorder.
+	if (strcmp(cmd, "flight_recorder_dump") == 0) {
+
+		if (TriggerFlightRecorder(-1)) {
+
+			snprintf(return_buf, return_max_length, 
+				 "{\"status\": \"triggered\"}");
+
+		}
+
+		else {
+
+			snprintf(return_buf, return_max_length, 
+				 "{\"status\": \"pending\"}");
+
+		}
+
+		return RPC_SUCCESS;
+
+	}
+
+	snprintf(return_buf, return_max_length, 
+		 "{\"status\": \"unknown command\"}");
+
+	return RPC_SUCCESS;
+}
+
+/*-- Setup Compression ---------------------------------------------*/
+
+INT SetupCompression()
+{
+
+	int size;
+	double lsbMicroVolt = 1;
+
+	size = sizeof(CompressionEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Compression/Enable",
+		&CompressionEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(lsbMicroVolt);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/Compression/LSBMicroVolt",
+		&lsbMicroVolt, &size, TID_DOUBLE, TRUE);
+
+	if (lsbMicroVolt <= 0) {
+
+		cm_msg(MERROR, "SetupCompression", 
+		       "Compression LSB must be positive, not %g uV", 
+		       lsbMicroVolt);
+		return FE_ERR_ODB;
+
+	}
+
+	CompressionLSB = 1e-6 * lsbMicroVolt;
+
+	if (CompressionEnabled)
+		printf("Compressed banks enabled, LSB %g uV\n", lsbMicroVolt);
+
+	return SUCCESS;
+}
+
+/*-- Compressed banks ----------------------------------------------*/
+
+void CreateCompressedBank(char *pevent, const char *name, 
+			  const double *prefix, int nPrefix,
+			  const double *data, int nSeries, int length)
+{
+
+	uint8_t *pdata;
+	bk_create(pevent, name, TID_BYTE, (void **)&pdata);
+
+	if (nPrefix > 0) {
+
+		memcpy(pdata, prefix, sizeof(double) * nPrefix);
+		pdata += sizeof(double) * nPrefix;
+
+	}
+
+	pdata += LJZEncode(data, nSeries, length, CompressionLSB, pdata);
+
+	bk_close(pevent, pdata);
+}
+
+void CreateCompressedChannelBank(char *pevent, const char *name, 
+				 const LJChannelBlock &block)
+{
+
+	std::vector<const double *> series(block.Channels());
+	for (int c = 0; c < block.Channels(); c++) series[c] = block.Channel(c);
+
+	uint8_t *pdata;
+	bk_create(pevent, name, TID_BYTE, (void **)&pdata);
+	pdata += LJZEncodeSeries(&series[0], block.Channels(), block.Scans(),
+				 CompressionLSB, pdata);
+	bk_close(pevent, pdata);
+}
+
+/*-- Setup Bank Layout ---------------------------------------------*/
+
+void SetupBankLayout()
+{
+
+	LJBankLayout layout;
+
+	layout.nChannels = NumAddresses;
+	layout.slicesPerEvent = 1;
+	layout.valuesPerSlice = 2;
+	layout.scansPerRead = ScansPerRead;
+	layout.encoding = CompressionEnabled ? LJ_ENCODING_LJZ 
+					     : LJ_ENCODING_DOUBLE;
+	layout.scanRate = ScanRate;
+	layout.sliceRate = FilterEnabled ? Filter.OutputRate() : ScanRate;
+	layout.lsb = CompressionEnabled ? CompressionLSB : 0;
+	layout.flags = (FilterEnabled ? LJ_BANK_FILTERED : 0) |
+		(TriggerMode == TRIGGER_MODE_TRIGGERED ? LJ_BANK_TRIGGERED : 0) |
+		(RobustEnabled ? LJ_BANK_ROBUST : 0) |
+		(RobustEnabled && RobustReplaceMean ? LJ_BANK_CLIPPED : 0);
+	layout.names.assign(CHANNEL_NAMES, CHANNEL_NAMES + NumAddresses);
+	layout.addresses.assign(aScanList, aScanList + NumAddresses);
+
+	if (DerivedEnabled) {
+
+		layout.derivedSensors = Derived.Sensors();
+
+		for (int i = 0; i < Derived.Pairs(); i++) {
+
+			LJBankPair pair;
+			pair.a = Derived.Pair(i).a;
+			pair.b = Derived.Pair(i).b;
+			pair.distance = Derived.Pair(i).distance;
+			layout.gradientPairs.push_back(pair);
+
+		}
+
+	}
+
+	// The id is computed by encoding the header once.
+	std::vector<uint8_t> header(LJBankHeaderSize(NumAddresses, 
+					layout.gradientPairs.size()));
+	LJBankHeaderEncode(layout, &header[0]);
+
+	if (layout.layoutId != BankLayout.layoutId) BankHeaderPending = TRUE;
+	BankLayout = layout;
+}
+
+/*-- Setup Calibration ---------------------------------------------*/
+
+INT SetupCalibration()
+{
+
+	int size;
+	HNDLE hKey;
+
+	// Uncalibrated by default: everything stays in volts.
+	for (int i = 0; i < NumAddresses; i++) {
+
+		CalibrationGain[i] = 1;
+		CalibrationOffset[i] = 0;
 
 	}
 
-	// (!!!) What's happening here?
-	//int size = bk_close(pevent, pdata);
-	bk_close(pevent, pdata);
-	return bk_size(pevent);
+	size = sizeof(CalibrationGain);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Calibration/Gain",
+		CalibrationGain, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(CalibrationOffset);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Calibration/Offset",
+		CalibrationOffset, &size, TID_DOUBLE, TRUE);
+
+	// The calibration used to apply to the history only.
+	if (db_find_key(hDB, 0, "/Equipment/Labjack02/Settings/History/Gain",
+			&hKey) == DB_SUCCESS)
+		cm_msg(MINFO, "SetupCalibration", "Settings/History/Gain and "
+		       "Offset are no longer used, the calibration is in "
+		       "Settings/Calibration");
+
+	return SUCCESS;
+}
+
+/*-- Calibrate Means -----------------------------------------------*/
+
+void CalibrateMeans(const double *stats, double *means)
+{
+	for (int i = 0; i < NumAddresses; i++)
+		means[i] = CalibrationGain[i] * stats[2 * i] 
+			   + CalibrationOffset[i];
+}
+
+/*-- Setup Derived -------------------------------------------------*/
+
+INT SetupDerived()
+{
+
+	int size;
+	INT pairA[MaxGradientPairs];
+	INT pairB[MaxGradientPairs];
+	double pairDistance[MaxGradientPairs];
+
+	// A pair with a sensor of -1 is unused.
+	for (int i = 0; i < MaxGradientPairs; i++) {
+
+		pairA[i] = pairB[i] = -1;
+		pairDistance[i] = 0;
+
+	}
+
+	size = sizeof(DerivedEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Derived/Enable",
+		&DerivedEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(pairA);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Derived/PairA",
+		pairA, &size, TID_INT, TRUE);
+
+	size = sizeof(pairB);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Derived/PairB",
+		pairB, &size, TID_INT, TRUE);
+
+	size = sizeof(pairDistance);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Derived/PairDistance",
+		pairDistance, &size, TID_DOUBLE, TRUE);
+
+	if (!DerivedEnabled) return SUCCESS;
+
+	std::vector<LJGradientPair> pairs;
+
+	for (int i = 0; i < MaxGradientPairs; i++) {
+
+		if (pairA[i] < 0 || pairB[i] < 0) continue;
+
+		LJGradientPair pair;
+		pair.a = pairA[i];
+		pair.b = pairB[i];
+		pair.distance = pairDistance[i];
+		pairs.push_back(pair);
+
+	}
+
+	if (!Derived.Configure(NumSensors, pairs)) {
+
+		cm_msg(MERROR, "SetupDerived", 
+		       "Gradient pair sensors must be between 0 and %d", 
+		       NumSensors - 1);
+		return FE_ERR_ODB;
+
+	}
+
+	printf("Derived quantities for %d sensors and %d gradient pairs\n",
+	       Derived.Sensors(), Derived.Pairs());
+
+	return SUCCESS;
+}
+
+/*-- Setup Robust --------------------------------------------------*/
+
+INT SetupRobust()
+{
+
+	int size;
+	double clipSigma = 3;
+	INT iterations = 3;
+
+	size = sizeof(RobustEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Robust/Enable",
+		&RobustEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(RobustReplaceMean);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Robust/ReplaceMean",
+		&RobustReplaceMean, &size, TID_BOOL, TRUE);
+
+	size = sizeof(clipSigma);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Robust/ClipSigma",
+		&clipSigma, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(iterations);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Robust/Iterations",
+		&iterations, &size, TID_INT, TRUE);
+
+	if (!RobustEnabled) return SUCCESS;
+
+	if (clipSigma <= 0 || iterations < 1) {
+
+		cm_msg(MERROR, "SetupRobust",
+		       "Robust ClipSigma must be positive and Iterations at least 1");
+		return FE_ERR_ODB;
+
+	}
+
+	Robust.Configure(clipSigma, iterations);
+
+	printf("Robust statistics enabled: clipping at %.1f sigma, %d "
+	       "iterations%s\n", clipSigma, iterations, 
+	       RobustReplaceMean ? ", replacing the mean and std" : "");
+
+	return SUCCESS;
+}
+
+/*-- Setup History -------------------------------------------------*/
+
+INT SetupHistory()
+{
+
+	int size;
+
+	size = sizeof(HistoryEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/History/Enable",
+		&HistoryEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(HistoryPeriod);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/History/PeriodSeconds",
+		&HistoryPeriod, &size, TID_DOUBLE, TRUE);
+
+	// The averages are started over.
+	for (int i = 0; i < NumAddresses; i++) HistorySum[i] = 0;
+	HistoryCount = 0;
+	HistoryLastUpdate = time(NULL);
+
+	if (!HistoryEnabled) return SUCCESS;
+
+	// The history labels the array elements with the "Names Mean" setting.
+	char names[NumAddresses][NAME_LENGTH];
+	memset(names, 0, sizeof(names));
+	for (int i = 0; i < NumAddresses; i++)
+		strncpy(names[i], CHANNEL_NAMES[i], NAME_LENGTH - 1);
+
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Settings/Names Mean",
+		     names, sizeof(names), NumAddresses, TID_STRING);
+
+	// The Variables are created once, and afterwards written through
+	// their key.
+	double zero[NumAddresses] = {0};
+	size = sizeof(zero);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Variables/Mean",
+		zero, &size, TID_DOUBLE, TRUE);
+
+	if (db_find_key(hDB, 0, "/Equipment/Labjack02/Variables/Mean", 
+			&hHistoryKey) != DB_SUCCESS) {
+
+		cm_msg(MERROR, "SetupHistory", 
+		       "Cannot find /Equipment/Labjack02/Variables/Mean");
+		return FE_ERR_ODB;
+
+	}
+
+	printf("History Variables updated every %.1f s\n", HistoryPeriod);
+
+	return SUCCESS;
+}
+
+/*-- Update History ------------------------------------------------*/
+
+void UpdateHistory(const double *means)
+{
+
+	for (int i = 0; i < NumAddresses; i++) HistorySum[i] += means[i];
+	HistoryCount++;
+
+	time_t now = time(NULL);
+	if (now - HistoryLastUpdate < HistoryPeriod) return;
+
+	double values[NumAddresses];
+	for (int i = 0; i < NumAddresses; i++) {
+
+		values[i] = HistorySum[i] / HistoryCount;
+		HistorySum[i] = 0;
+
+	}
+
+	HistoryCount = 0;
+	HistoryLastUpdate = now;
+
+	// All channels go to the ODB in one call.
+	db_set_data(hDB, hHistoryKey, values, sizeof(values), NumAddresses,
+		    TID_DOUBLE);
+}
+
+/*-- Setup Rate Control --------------------------------------------*/
+
+INT SetupRateControl()
+{
+
+	int size;
+	LJRateControlConfig config;
+	int maxDeviceBacklogSamples = 1024;
+
+	// By default the rate can go down to 1/16 of the requested rate. The
+	// device buffer holds 2048 samples by default, so the backlog limit 
+	// is half of it.
+	config.minRate = RequestedScanRate / 16;
+
+	size = sizeof(RateControlEnabled);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/RateControl/Enable",
+		&RateControlEnabled, &size, TID_BOOL, TRUE);
+
+	size = sizeof(config.minRate);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/RateControl/MinScanRate",
+		&config.minRate, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.stepDown);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/RateControl/StepDown",
+		&config.stepDown, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.stepUp);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/RateControl/StepUp",
+		&config.stepUp, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.maxLatency);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/RateControl/MaxLatencySeconds",
+		&config.maxLatency, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(maxDeviceBacklogSamples);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/RateControl/MaxDeviceBacklogSamples",
+		&maxDeviceBacklogSamples, &size, TID_INT, TRUE);
+
+	size = sizeof(config.recoverySeconds);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/RateControl/RecoverySeconds",
+		&config.recoverySeconds, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.settleSeconds);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/RateControl/SettleSeconds",
+		&config.settleSeconds, &size, TID_DOUBLE, TRUE);
+
+	// The backlogs are reported in scans.
+	config.maxDeviceBacklog = maxDeviceBacklogSamples / NumAddresses;
+
+	// The rate is never raised above what the stream was started with,
+	// which is the requested rate unless it had to be clamped.
+	config.maxRate = ScanRate;
+	StartScanRate = ScanRate;
+
+	RateController.Configure(config);
+	RateController.Reset(ScanRate, time(NULL));
+
+	// A replay runs at the rate of the recording, whatever is asked for.
+	if (RateControlEnabled && ReplayEnabled) {
+
+		cm_msg(MINFO, "SetupRateControl", 
+		       "The replay runs at the recorded rate, so there is no rate "
+		       "control");
+		RateControlEnabled = FALSE;
+
+	}
+
+	// The rate of an externally clocked stream is set by the clock.
+	if (RateControlEnabled && StreamConfig.clockSource != T7_CLOCK_INTERNAL) {
+
+		cm_msg(MINFO, "SetupRateControl", 
+		       "The stream is externally clocked, so there is no rate "
+		       "control");
+		RateControlEnabled = FALSE;
+
+	}
 
+	if (RateControlEnabled)
+		printf("Rate control between %.2f and %.2f Hz\n", 
+		       config.minRate, config.maxRate);
+
+	return SUCCESS;
+}
+
+/*-- Apply Scan Rate Change ----------------------------------------*/
+
+INT RestartStream(double rate)
+{
+
+	INT status;
+
+	ControlledScanRate = rate;
+
+	ScansPerRead = (int)(RequestedScansPerRead * rate / StartScanRate + 0.5);
+	if (ScansPerRead < 1) ScansPerRead = 1;
+	if (ScansPerRead > RequestedScansPerRead) 
+		ScansPerRead = RequestedScansPerRead;
+
+	StopStream();
+	status = StartStream();
+	if (status != SUCCESS) return status;
+
+	// The trigger slew limits and the filter coefficients depend on the
+	// rate, and the layout header records it and ScansPerRead. The flight
+	// recorder keeps its scans, which now cover a different time. The 
+	// cycle in progress is lost, as the restarted stream counts its scans
+	// from 0.
+	status = SetupTrigger();
+	if (status != SUCCESS) return status;
+
+	status = SetupFilter();
+	if (status != SUCCESS) return status;
+
+	status = SetupCycle();
+	if (status != SUCCESS) return status;
+
+	SetupBankLayout();
+
+	return SUCCESS;
+}
+
+void ApplyScanRateChange()
+{
+
+	RateChangePending = FALSE;
+
+	double previousRate = ScanRate;
+	double rate = ControlledScanRate;
+
+	cm_msg(MINFO, "ApplyScanRateChange",
+	       "Changing ScanRate from %.2f to %.2f Hz because %s",
+	       previousRate, rate, RateController.Reason());
+
+	if (RestartStream(rate) == SUCCESS) RunSummary.CountRateChange();
+
+	else {
+
+		cm_msg(MERROR, "ApplyScanRateChange", 
+		       "Cannot run at %.2f Hz, going back to %.2f Hz", 
+		       rate, previousRate);
+
+		// The controller is kept from trying that rate again in this run.
+		LJRateControlConfig config = RateController.Config();
+		if (rate < previousRate) config.minRate = previousRate;
+		else config.maxRate = previousRate;
+		RateController.Configure(config);
+
+		if (RestartStream(previousRate) != SUCCESS) {
+
+			cm_msg(MERROR, "ApplyScanRateChange",
+			       "Cannot restart the stream, stopping the run");
+			StreamFailed = TRUE;
+			cm_transition(TR_STOP, 0, NULL, 0, TR_DETACH, FALSE);
+			return;
+
+		}
+
+	}
+
+	// LJM may have adjusted the rate slightly.
+	RateController.Reset(ScanRate, time(NULL));
+}
+
+/*-- Setup Replay --------------------------------------------------*/
+
+INT SetupReplay()
+{
+
+	int size;
+	char file[256] = "";
+	double speed = 1;
+	BOOL loop = FALSE;
+
+	// Empty for reading the Labjack, otherwise a CSV file written by 
+	// LabJackT7.to_csv or a tap archive.
+	size = sizeof(file);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Replay/File",
+		file, &size, TID_STRING, TRUE);
+
+	// A multiple of the recorded rate, 0 for as fast as possible.
+	size = sizeof(speed);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Replay/Speed",
+		&speed, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(loop);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Replay/Loop",
+		&loop, &size, TID_BOOL, TRUE);
+
+	if (!file[0]) return SUCCESS;
+
+	std::string error;
+	if (!Replay.Open(file, error)) {
+
+		cm_msg(MERROR, "SetupReplay", "Cannot replay %s", error.c_str());
+		return FE_ERR_ODB;
+
+	}
+
+	Replay.SetSpeed(speed);
+	Replay.SetLoop(loop);
+
+	ReplayEnabled = TRUE;
+	Source = &Replay;
+
+	cm_msg(MINFO, "SetupReplay", 
+	       "Replaying %s: %d channels at %.2f Hz, speed %g%s", file,
+	       Replay.Channels(), Replay.ScanRate(), speed, 
+	       loop ? ", looping" : "");
+
+	return SUCCESS;
+}
+
+/*-- Setup Simulation ----------------------------------------------*/
+
+INT SetupSimulation()
+{
+
+	int size;
+	BOOL enable = FALSE;
+	LJSimConfig config;
+
+	size = sizeof(enable);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Simulation/Enable",
+		&enable, &size, TID_BOOL, TRUE);
+
+	// The noise and kick are in V, the times in s.
+	size = sizeof(config.noise);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Simulation/Noise",
+		&config.noise, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.cyclePeriod);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/Simulation/CyclePeriod",
+		&config.cyclePeriod, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.pulseWidth);
+	db_get_value(hDB, 0, 
+		"/Equipment/Labjack02/Settings/Simulation/PulseWidth",
+		&config.pulseWidth, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.cycleDIO);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Simulation/CycleDIO",
+		&config.cycleDIO, &size, TID_INT, TRUE);
+
+	size = sizeof(config.kick);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Simulation/Kick",
+		&config.kick, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(config.kickTau);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Simulation/KickTau",
+		&config.kickTau, &size, TID_DOUBLE, TRUE);
+
+	// A multiple of the scan rate, 0 for as fast as possible.
+	size = sizeof(config.speed);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Simulation/Speed",
+		&config.speed, &size, TID_DOUBLE, TRUE);
+
+	if (!enable) return SUCCESS;
+
+	if (ReplayEnabled) {
+
+		cm_msg(MERROR, "SetupSimulation", 
+		       "Replay/File and Simulation/Enable cannot both be set");
+		return FE_ERR_ODB;
+
+	}
+
+	if (config.cycleDIO < 0 || config.cycleDIO >= LJ_DIGITAL_LINES) {
+
+		cm_msg(MERROR, "SetupSimulation", 
+		       "Simulation/CycleDIO %d must be 0-%d", config.cycleDIO,
+		       LJ_DIGITAL_LINES - 1);
+		return FE_ERR_ODB;
+
+	}
+
+	Simulation.Configure(config);
+
+	SimulationEnabled = TRUE;
+	Source = &Simulation;
+
+	cm_msg(MINFO, "SetupSimulation", 
+	       "Simulating the Labjack: cycles of %g s on DIO%d, speed %g",
+	       config.cyclePeriod, config.cycleDIO, config.speed);
+
+	return SUCCESS;
+}
+
+/*-- Profiling -----------------------------------------------------*/
+
+INT SetupProfile()
+{
+
+	int size;
+
+	size = sizeof(ProfilePeriod);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Profile/PeriodSeconds",
+		&ProfilePeriod, &size, TID_DOUBLE, TRUE);
+
+	size = sizeof(ProfileTraceFile);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Profile/Trace File",
+		ProfileTraceFile, &size, TID_STRING, TRUE);
+
+	ProfileTraceEvents = 100000;
+	size = sizeof(ProfileTraceEvents);
+	db_get_value(hDB, 0, "/Equipment/Labjack02/Settings/Profile/Trace Events",
+		&ProfileTraceEvents, &size, TID_INT, TRUE);
+
+	if (!LJProfiler::Enabled()) {
+
+		if (ProfileTraceFile[0])
+			cm_msg(MINFO, "SetupProfile", "Profile/Trace File is set, "
+			       "but the frontend was built without profiling "
+			       "(make PROFILE=1)");
+
+		return SUCCESS;
+
+	}
+
+	// Only threads started from here on are traced, which is all of them.
+	LJProfiler::SetTraceEvents(ProfileTraceFile[0] ? ProfileTraceEvents : 0);
+	LJ_PROFILE_THREAD("frontend");
+
+	ProfileLastReport = time(NULL);
+	ProfileLast = LJProfiler::Collect();
+
+	cm_msg(MINFO, "SetupProfile", "Profiling, reported every %g s%s%s",
+	       ProfilePeriod, ProfileTraceFile[0] ? ", tracing to " : "",
+	       ProfileTraceFile);
+
+	return SUCCESS;
+}
+
+void ReportProfile()
+{
+
+	if (!LJProfiler::Enabled() || ProfilePeriod <= 0) return;
+
+	time_t now = time(NULL);
+	if (now - ProfileLastReport < ProfilePeriod) return;
+	ProfileLastReport = now;
+
+	// The timings since the last report.
+	LJProfileSnapshot snapshot = LJProfiler::Collect();
+	LJProfileSnapshot period = snapshot.Since(ProfileLast);
+	ProfileLast = snapshot;
+
+	int n = period.Stages();
+	if (n == 0) return;
+
+	std::vector<char> names(n * NAME_LENGTH, 0);
+	std::vector<DWORD> count(n);
+	std::vector<double> mean(n), p50(n), p90(n), p99(n), max(n);
+
+	for (int s = 0; s < n; s++) {
+
+		strncpy(&names[s * NAME_LENGTH], period.Name(s), NAME_LENGTH - 1);
+		count[s] = period.Count(s);
+		mean[s] = 1e6 * period.Mean(s);
+		p50[s] = 1e6 * period.Percentile(s, 0.5);
+		p90[s] = 1e6 * period.Percentile(s, 0.9);
+		p99[s] = 1e6 * period.Percentile(s, 0.99);
+		max[s] = 1e6 * period.Percentile(s, 1);
+
+	}
+
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/Stage",
+		     &names[0], names.size(), n, TID_STRING);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/Count",
+		     &count[0], n * sizeof(DWORD), n, TID_DWORD);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/Mean (us)",
+		     &mean[0], n * sizeof(double), n, TID_DOUBLE);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/P50 (us)",
+		     &p50[0], n * sizeof(double), n, TID_DOUBLE);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/P90 (us)",
+		     &p90[0], n * sizeof(double), n, TID_DOUBLE);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/P99 (us)",
+		     &p99[0], n * sizeof(double), n, TID_DOUBLE);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Profile/Max (us)",
+		     &max[0], n * sizeof(double), n, TID_DOUBLE);
 }
+
+/*-- Report Allan --------------------------------------------------*/
+
+void ReportAllan()
+{
+
+	if (!AllanEnabled || AllanPeriod <= 0) return;
+
+	time_t now = time(NULL);
+	if (now - AllanLastReport < AllanPeriod) return;
+	AllanLastReport = now;
+
+	std::vector<double> tau, deviation, drift;
+	uint64_t scans;
+	Allan.Results(tau, deviation, drift, scans);
+
+	int n = tau.size();
+	if (n == 0) return;
+
+	// The deviation of every channel goes into an array named after the
+	// channel, over the averaging times in "Tau (s)".
+	double hours = scans / ScanRate / 3600;
+
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Allan/Tau (s)",
+		     &tau[0], n * sizeof(double), n, TID_DOUBLE);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Allan/Hours",
+		     &hours, sizeof(hours), 1, TID_DOUBLE);
+	db_set_value(hDB, 0, "/Equipment/Labjack02/Allan/Drift (V per s)",
+		     &drift[0], NumAddresses * sizeof(double), NumAddresses,
+		     TID_DOUBLE);
+
+	for (int c = 0; c < NumAddresses; c++) {
+
+		char path[256];
+		snprintf(path, sizeof(path), "/Equipment/Labjack02/Allan/ADEV/%s",
+			 CHANNEL_NAMES[c]);
+		db_set_value(hDB, 0, path, &deviation[c * n], n * sizeof(double),
+			     n, TID_DOUBLE);
+
+	}
 }
 
+void WriteProfileTrace()
+{
 
+	if (!LJProfiler::Enabled() || !ProfileTraceFile[0]) return;
 
+	if (LJProfiler::WriteTrace(ProfileTraceFile))
+		cm_msg(MINFO, "WriteProfileTrace", "Profile trace written to %s",
+		       ProfileTraceFile);
+	else
+		cm_msg(MERROR, "WriteProfileTrace", "Cannot write %s",
+		       ProfileTraceFile);
+}
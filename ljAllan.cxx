@@ -0,0 +1,265 @@
+/********************************************************************\
+ Labjack Allan deviation
+\********************************************************************/
+
+#include <math.h>
+
+#include "ljAllan.h"
+#include "ljStreamSource.h"
+
+// The ring of a level holds the phases 0 to 2 LJ_ALLAN_LAGS back.
+static const int RING = 2 * LJ_ALLAN_LAGS + 1;
+
+// Every this many scans, the phases are moved back towards 0.
+static const uint64_t REBASE_SCANS = 1 << 20;
+
+/*-- Allan ---------------------------------------------------------*/
+
+LJAllan::LJAllan()
+	: fChannels(0), fRate(1), fLevels(0), fScans(0), fSumT(0), fSumT2(0)
+{
+}
+
+void LJAllan::Configure(int nChannels, double rate, double maxTau)
+{
+	fChannels = nChannels;
+	fRate = rate > 0 ? rate : 1;
+
+	// Level 0 has the averaging times up to LJ_ALLAN_LAGS scans, and every
+	// further level the next octave, as long as it's within maxTau.
+	double maxM = maxTau * fRate;
+
+	fM.clear();
+	fLag.clear();
+	fFirst.assign(1, 0);
+
+	for (int lag = 1; lag <= LJ_ALLAN_LAGS; lag *= 2) {
+
+		if (lag > 1 && lag > maxM) break;
+
+		fM.push_back(lag);
+		fLag.push_back(lag);
+
+	}
+
+	fFirst.push_back(fM.size());
+	fLevels = 1;
+
+	if (fM.back() == LJ_ALLAN_LAGS) {
+
+		for (int level = 1; level < 63; level++) {
+
+			uint64_t m = (uint64_t)LJ_ALLAN_LAGS << level;
+			if (m > maxM) break;
+
+			fM.push_back(m);
+			fLag.push_back(LJ_ALLAN_LAGS);
+			fFirst.push_back(fM.size());
+			fLevels = level + 1;
+
+		}
+
+	}
+
+	fRing.assign(fLevels, std::vector<double>(RING * fChannels));
+	fHead.resize(fLevels);
+	fPushed.resize(fLevels);
+
+	Reset();
+}
+
+void LJAllan::Reset()
+{
+	fSum.assign(fM.size() * fChannels, 0);
+	fTerms.assign(fM.size(), 0);
+
+	for (int level = 0; level < fLevels; level++) {
+
+		fHead[level] = RING - 1;
+		fPushed[level] = 0;
+
+	}
+
+	fScans = 0;
+	fReference.assign(fChannels, 0);
+	fLast.assign(fChannels, 0);
+	fPhase.assign(fChannels, 0);
+
+	fSumT = fSumT2 = 0;
+	fSumY.assign(fChannels, 0);
+	fSumTY.assign(fChannels, 0);
+}
+
+void LJAllan::Add(const double *scans, int nScans)
+{
+	for (int i = 0; i < nScans; i++) {
+
+		const double *scan = scans + (size_t)i * fChannels;
+
+		if (fScans == 0) {
+
+			for (int c = 0; c < fChannels; c++)
+				fReference[c] = fLast[c] =
+					scan[c] == LJM_DUMMY_VALUE ? 0 : scan[c];
+
+			// The phase before the first scan is 0, and is the first
+			// value of every level.
+			for (int level = 0; level < fLevels; level++)
+				Push(level, &fPhase[0]);
+
+		}
+
+		double t = (double)fScans;
+		fSumT += t;
+		fSumT2 += t * t;
+
+		for (int c = 0; c < fChannels; c++) {
+
+			if (scan[c] != LJM_DUMMY_VALUE) fLast[c] = scan[c];
+
+			double y = fLast[c] - fReference[c];
+			fPhase[c] += y;
+			fSumY[c] += y;
+			fSumTY[c] += t * y;
+
+		}
+
+		fScans++;
+
+		// Level j takes every 2^j-th phase.
+		for (int level = 0; level < fLevels; level++) {
+
+			if (fScans & ((1ull << level) - 1)) break;
+			Push(level, &fPhase[0]);
+
+		}
+
+		if (fScans % REBASE_SCANS == 0) Rebase();
+
+	}
+}
+
+void LJAllan::Push(int level, const double *x)
+{
+	int head = fHead[level] + 1;
+	if (head == RING) head = 0;
+
+	double *ring = &fRing[level][0];
+	double *newest = ring + head * fChannels;
+	for (int c = 0; c < fChannels; c++) newest[c] = x[c];
+
+	fHead[level] = head;
+	uint64_t pushed = ++fPushed[level];
+
+	// The averaging times taken at this level whose second difference
+	// is complete.
+	for (int k = fFirst[level]; k < fFirst[level + 1]; k++) {
+
+		int lag = fLag[k];
+		if (pushed < (uint64_t)(2 * lag + 1)) continue;
+
+		const double *mid = ring + ((head - lag + RING) % RING) * fChannels;
+		const double *old = ring + ((head - 2 * lag + RING) % RING) * fChannels;
+		double *sum = &fSum[k * fChannels];
+
+		for (int c = 0; c < fChannels; c++) {
+
+			double d = newest[c] - 2 * mid[c] + old[c];
+			sum[c] += d * d;
+
+		}
+
+		fTerms[k]++;
+
+	}
+}
+
+// The phase drifts off with the offset of a channel from its first scan,
+// and with it the precision of the second differences. Only differences
+// of phases are used, so a constant can be taken off all of them.
+void LJAllan::Rebase()
+{
+	for (int c = 0; c < fChannels; c++) {
+
+		double offset = fPhase[c];
+
+		for (int level = 0; level < fLevels; level++)
+			for (int r = 0; r < RING; r++)
+				fRing[level][r * fChannels + c] -= offset;
+
+		fPhase[c] = 0;
+
+	}
+}
+
+double LJAllan::Deviation(int c, int k) const
+{
+	if (fTerms[k] == 0) return 0;
+
+	double m = (double)fM[k];
+	return sqrt(fSum[k * fChannels + c] / (2 * m * m * fTerms[k]));
+}
+
+double LJAllan::Drift(int c) const
+{
+	double n = (double)fScans;
+	double denominator = n * fSumT2 - fSumT * fSumT;
+	if (fScans < 2 || denominator <= 0) return 0;
+
+	double slope = (n * fSumTY[c] - fSumT * fSumY[c]) / denominator;
+	return slope * fRate;
+}
+
+/*-- Monitor -------------------------------------------------------*/
+
+LJAllanMonitor::LJAllanMonitor()
+	: fMaxTau(0)
+{
+}
+
+void LJAllanMonitor::Configure(int nChannels, double rate, double maxTau)
+{
+	std::lock_guard<std::mutex> lock(fMutex);
+
+	fMaxTau = maxTau;
+	fAllan.Configure(nChannels, rate, maxTau);
+}
+
+void LJAllanMonitor::Process(const LJBlock &block)
+{
+	std::lock_guard<std::mutex> lock(fMutex);
+
+	if (block.nChannels != fAllan.Channels()) return;
+
+	if (block.scanRate > 0 && block.scanRate != fAllan.Rate())
+		fAllan.Configure(block.nChannels, block.scanRate, fMaxTau);
+
+	fAllan.Add(&block.data[0], block.nScans);
+}
+
+void LJAllanMonitor::Results(std::vector<double> &tau,
+			     std::vector<double> &deviation,
+			     std::vector<double> &drift, uint64_t &scans)
+{
+	std::lock_guard<std::mutex> lock(fMutex);
+
+	int taus = fAllan.Taus();
+	int channels = fAllan.Channels();
+
+	tau.resize(taus);
+	deviation.resize((size_t)channels * taus);
+	drift.resize(channels);
+
+	for (int k = 0; k < taus; k++) tau[k] = fAllan.Tau(k);
+
+	for (int c = 0; c < channels; c++) {
+
+		for (int k = 0; k < taus; k++)
+			deviation[(size_t)c * taus + k] = fAllan.Deviation(c, k);
+
+		drift[c] = fAllan.Drift(c);
+
+	}
+
+	scans = fAllan.Scans();
+}
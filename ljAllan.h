@@ -0,0 +1,148 @@
+/********************************************************************\
+ Labjack Allan deviation
+
+ Tracks the overlapping Allan deviation of every channel over averaging
+ times from one scan up to days, and the drift of every channel, without
+ keeping the scans. This is what the stability of the fluxgates is judged
+ by, so it can be watched continuously rather than from CSV captures.
+
+ The Allan variance at an averaging time of m scans is taken from the
+ running sum x of the scans (the phase) as
+
+   AVAR(m) = < (x[i + 2m] - 2 x[i + m] + x[i])^2 > / (2 m^2)
+
+ which is half the mean square difference of the averages of two
+ adjacent stretches of m scans. The averaging times are the octaves
+ m = 1, 2, 4, ... Keeping x for the whole of the longest one would take
+ memory in proportion to it, so the phase is kept in a cascade of levels
+ instead: level j holds the last 2R + 1 values of x at every 2^j-th scan
+ (R = LJ_ALLAN_LAGS), which takes
+
+   level 0   m = 1, 2, 4, ..., R, with every start i (fully overlapping)
+   level j   m = R 2^j, with a start every 2^j scans, i.e. R starts per
+	     m, which is all but as good as fully overlapping
+
+ A scan updates level 0, every second scan level 1, and so on, so a scan
+ costs O(log m) in the worst case and a constant amortized, and the
+ memory is O(R log m) per channel.
+
+ Skipped scans (-9999) repeat the last good value. The drift is the least
+ squares slope of every channel over everything added since the reset.
+
+ LJAllan does the work; LJAllanMonitor is the block bus consumer which
+ feeds it, and from which the results are taken on another thread.
+\********************************************************************/
+
+#ifndef LJALLAN_H
+#define LJALLAN_H
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "ljBlockBus.h"
+
+// Averaging times (in units of the top one) per level above level 0. A
+// power of 2.
+#define LJ_ALLAN_LAGS	8
+
+class LJAllan {
+
+public:
+
+	LJAllan();
+
+	// Sets up for nChannels channels scanned at rate Hz, with averaging
+	// times of up to maxTau s, and resets.
+	void Configure(int nChannels, double rate, double maxTau);
+
+	// Forgets everything added.
+	void Reset();
+
+	// Adds nScans interleaved scans.
+	void Add(const double *scans, int nScans);
+
+	int Channels() const { return fChannels; }
+	double Rate() const { return fRate; }
+	uint64_t Scans() const { return fScans; }
+
+	// The averaging times, in s.
+	int Taus() const { return (int)fM.size(); }
+	double Tau(int k) const { return fM[k] / fRate; }
+
+	// Number of differences averaged at Tau(k), 0 until 2 Tau(k) of scans
+	// have been added.
+	uint64_t Terms(int k) const { return fTerms[k]; }
+
+	// The Allan deviation of channel c at Tau(k), 0 without terms yet.
+	double Deviation(int c, int k) const;
+
+	// The drift of channel c, in units per s.
+	double Drift(int c) const;
+
+private:
+
+	void Push(int level, const double *x);
+	void Rebase();
+
+	int fChannels;
+	double fRate;
+	int fLevels;
+
+	// Averaging times in scans, and per averaging time the lag (in level
+	// values) it's taken at, the sum of the squared second differences of
+	// every channel (fSum[k * fChannels + c]) and their number. Level j
+	// has the averaging times from fFirst[j] to fFirst[j + 1].
+	std::vector<uint64_t> fM;
+	std::vector<int> fLag;
+	std::vector<int> fFirst;
+	std::vector<double> fSum;
+	std::vector<uint64_t> fTerms;
+
+	// Per level, a ring of the last 2 LJ_ALLAN_LAGS + 1 phases of all
+	// channels, the position of the newest and the number pushed.
+	std::vector<std::vector<double> > fRing;
+	std::vector<int> fHead;
+	std::vector<uint64_t> fPushed;
+
+	// The phase is taken relative to the first scan, which keeps it small.
+	uint64_t fScans;
+	std::vector<double> fReference;
+	std::vector<double> fLast;
+	std::vector<double> fPhase;
+
+	// For the drift: sums of t, t^2 (t in scans), y and t y.
+	double fSumT;
+	double fSumT2;
+	std::vector<double> fSumY;
+	std::vector<double> fSumTY;
+};
+
+class LJAllanMonitor : public LJConsumer {
+
+public:
+
+	LJAllanMonitor();
+
+	// Sets up the estimator, see LJAllan::Configure().
+	void Configure(int nChannels, double rate, double maxTau);
+
+	// Adds the block. A block at a scan rate other than the configured
+	// one (e.g. after the rate controller changed it) starts afresh at
+	// the new rate, as the results mix badly across rates.
+	virtual void Process(const LJBlock &block);
+
+	// Copies the results under the lock: the averaging times, the
+	// deviations (deviation[c * taus + k]), the drifts and the scans they
+	// are taken over.
+	void Results(std::vector<double> &tau, std::vector<double> &deviation,
+		     std::vector<double> &drift, uint64_t &scans);
+
+private:
+
+	std::mutex fMutex;
+	LJAllan fAllan;
+	double fMaxTau;
+};
+
+#endif
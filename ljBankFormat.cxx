@@ -0,0 +1,182 @@
+/********************************************************************\
+ Labjack bank format
+\********************************************************************/
+
+#include <string.h>
+
+#include "ljBankFormat.h"
+
+static_assert(sizeof(LJBankHeader) == 72, "bank header layout");
+static_assert(sizeof(LJBankChannel) == 24, "bank channel layout");
+static_assert(sizeof(LJBankPair) == 16, "bank pair layout");
+
+// Size of the version 1 header, the smallest there is.
+static const size_t HEADER_SIZE_V1 = 64;
+
+// 32 bit FNV-1a.
+static uint32_t Hash(const uint8_t *p, size_t size)
+{
+	uint32_t h = 2166136261u;
+
+	for (size_t i = 0; i < size; i++) {
+
+		h ^= p[i];
+		h *= 16777619u;
+
+	}
+
+	return h;
+}
+
+LJBankLayout::LJBankLayout()
+	: version(LJ_BANK_HEADER_VERSION), layoutId(0), nChannels(0),
+	  slicesPerEvent(1), valuesPerSlice(2), scansPerRead(0),
+	  encoding(LJ_ENCODING_DOUBLE), scanRate(0), sliceRate(0), lsb(0),
+	  flags(0), derivedSensors(0)
+{
+}
+
+/*-- Encode --------------------------------------------------------*/
+
+size_t LJBankHeaderSize(int nChannels, int nPairs)
+{
+	return sizeof(LJBankHeader) + nChannels * sizeof(LJBankChannel) +
+	       nPairs * sizeof(LJBankPair);
+}
+
+size_t LJBankHeaderEncode(LJBankLayout &layout, uint8_t *out)
+{
+	int nPairs = layout.gradientPairs.size();
+	size_t size = LJBankHeaderSize(layout.nChannels, nPairs);
+	memset(out, 0, size);
+
+	LJBankHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "LJHD", 4);
+	header.version = LJ_BANK_HEADER_VERSION;
+	header.headerSize = sizeof(header);
+	header.nChannels = layout.nChannels;
+	header.slicesPerEvent = layout.slicesPerEvent;
+	header.valuesPerSlice = layout.valuesPerSlice;
+	header.scansPerRead = layout.scansPerRead;
+	header.encoding = layout.encoding;
+	header.scanRate = layout.scanRate;
+	header.sliceRate = layout.sliceRate;
+	header.lsb = layout.lsb;
+	header.flags = layout.flags;
+	header.derivedSensors = layout.derivedSensors;
+	header.gradientPairs = nPairs;
+
+	for (int i = 0; i < layout.nChannels; i++) {
+
+		LJBankChannel channel;
+		memset(&channel, 0, sizeof(channel));
+
+		if (i < (int)layout.names.size())
+			strncpy(channel.name, layout.names[i].c_str(),
+				LJ_BANK_NAME_LENGTH - 1);
+		if (i < (int)layout.addresses.size())
+			channel.address = layout.addresses[i];
+
+		memcpy(out + sizeof(header) + i * sizeof(channel), &channel,
+		       sizeof(channel));
+
+	}
+
+	uint8_t *pairs = out + sizeof(header) + 
+			 layout.nChannels * sizeof(LJBankChannel);
+	for (int i = 0; i < nPairs; i++)
+		memcpy(pairs + i * sizeof(LJBankPair), &layout.gradientPairs[i],
+		       sizeof(LJBankPair));
+
+	// The id is the hash of the whole bank with the id itself zero.
+	memcpy(out, &header, sizeof(header));
+	header.layoutId = Hash(out, size);
+	memcpy(out, &header, sizeof(header));
+
+	layout.version = LJ_BANK_HEADER_VERSION;
+	layout.layoutId = header.layoutId;
+
+	return size;
+}
+
+/*-- Decode --------------------------------------------------------*/
+
+bool LJBankHeaderDecode(const uint8_t *in, size_t size, LJBankLayout &layout)
+{
+	LJBankHeader header;
+
+	// Fields that an older version doesn't have are left 0.
+	if (size < HEADER_SIZE_V1) return false;
+	memset(&header, 0, sizeof(header));
+	memcpy(&header, in, HEADER_SIZE_V1);
+
+	if (memcmp(header.magic, "LJHD", 4) != 0) return false;
+	if (header.headerSize < HEADER_SIZE_V1 || size < header.headerSize)
+		return false;
+
+	memcpy(&header, in, header.headerSize < sizeof(header) ? 
+	       header.headerSize : sizeof(header));
+
+	size_t pairsOffset = header.headerSize + 
+			     (size_t)header.nChannels * sizeof(LJBankChannel);
+	if (size < pairsOffset + 
+		   (size_t)header.gradientPairs * sizeof(LJBankPair)) return false;
+
+	// The id is checked over the bank as it was written, with the id
+	// zeroed, so that it also covers fields added by later versions.
+	std::vector<uint8_t> copy(in, in + size);
+	memset(&copy[offsetof(LJBankHeader, layoutId)], 0, sizeof(uint32_t));
+	if (Hash(&copy[0], size) != header.layoutId) return false;
+
+	layout.version = header.version;
+	layout.layoutId = header.layoutId;
+	layout.nChannels = header.nChannels;
+	layout.slicesPerEvent = header.slicesPerEvent;
+	layout.valuesPerSlice = header.valuesPerSlice;
+	layout.scansPerRead = header.scansPerRead;
+	layout.encoding = header.encoding;
+	layout.scanRate = header.scanRate;
+	layout.sliceRate = header.sliceRate;
+	layout.lsb = header.lsb;
+	layout.flags = header.flags;
+
+	layout.names.resize(header.nChannels);
+	layout.addresses.resize(header.nChannels);
+
+	for (uint32_t i = 0; i < header.nChannels; i++) {
+
+		LJBankChannel channel;
+		memcpy(&channel, in + header.headerSize + i * sizeof(channel),
+		       sizeof(channel));
+
+		layout.names[i] = std::string(channel.name,
+			strnlen(channel.name, LJ_BANK_NAME_LENGTH));
+		layout.addresses[i] = channel.address;
+
+	}
+
+	layout.derivedSensors = header.derivedSensors;
+	layout.gradientPairs.resize(header.gradientPairs);
+
+	for (uint32_t i = 0; i < header.gradientPairs; i++)
+		memcpy(&layout.gradientPairs[i], 
+		       in + pairsOffset + i * sizeof(LJBankPair),
+		       sizeof(LJBankPair));
+
+	return true;
+}
+
+/*-- Stats view ----------------------------------------------------*/
+
+LJStatsView::LJStatsView()
+	: fData(NULL), fChannels(0), fSlices(0), fValues(0)
+{
+}
+
+LJStatsView::LJStatsView(const LJBankLayout &layout, const double *data, int n)
+	: fData(NULL), fChannels(layout.nChannels),
+	  fSlices(layout.slicesPerEvent), fValues(layout.valuesPerSlice)
+{
+	if (n == layout.EventValues() && fValues >= 2) fData = data;
+}
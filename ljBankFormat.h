@@ -0,0 +1,208 @@
+/********************************************************************\
+ Labjack bank format
+
+ Describes the layout of the data banks, so that consumers don't have to
+ hard-code the number of channels or the order of the values. At the
+ start of every run (and whenever the layout changes) the frontend sends
+ an LBHD header bank with the first event. Every data event carries an
+ LBHR bank holding the id of the layout it was written with.
+
+ An LBJK bank (or a decoded LBJZ bank, see ljCompress.h) then holds
+
+   time, then for each slice and channel the valuesPerSlice values
+   (mean, std), i.e. 1 + slicesPerEvent * nChannels * valuesPerSlice
+   doubles.
+
+ If derived quantities are enabled, an LBDV bank (TID_DOUBLE) holds for
+ each slice the output of LJDerived::Compute() (see ljDerived.h) for
+ derivedSensors sensors and the listed gradient pairs.
+
+ If robust statistics are enabled (LJ_BANK_ROBUST), an LBRS bank
+ (TID_DOUBLE) holds for each slice and channel the LJRobustStats values
+ (see ljStats.h): median, MAD, clipped mean, clipped std and the number
+ of scans rejected. With LJ_BANK_CLIPPED, the mean and std in LBJK are
+ the clipped ones rather than those of all scans.
+
+ LBHD layout (TID_BYTE, little-endian):
+
+   offset  type       field
+   0       char[4]    magic, "LJHD"
+   4       uint16     version, LJ_BANK_HEADER_VERSION
+   6       uint16     size of this fixed part, where the channels start
+   8       uint32     layout id, FNV-1a hash of the header with this
+                      field set to 0
+   12      uint32     number of channels
+   16      uint32     slices per event
+   20      uint32     values per channel and slice
+   24      uint32     scans per read
+   28      uint32     encoding: LJ_ENCODING_DOUBLE (LBJK) or
+                      LJ_ENCODING_LJZ (LBJZ)
+   32      double     scan rate in Hz
+   40      double     rate of the scans the statistics are taken over,
+                      lower than the scan rate if the filter decimates
+   48      double     quantization LSB in volts, 0 if not compressed
+   56      uint32     flags, LJ_BANK_FILTERED | LJ_BANK_TRIGGERED |
+                      LJ_BANK_ROBUST | LJ_BANK_CLIPPED
+   60      uint32     reserved
+   64      uint32     sensors in the LBDV bank, 0 if there is none   (v2)
+   68      uint32     gradient pairs in the LBDV bank                (v2)
+   72      channels:  for each channel a LJ_BANK_NAME_LENGTH byte null
+                      padded name, int32 LJM address and 4 reserved bytes
+   ...     pairs:     for each gradient pair the int32 sensors a and b,
+                      and the double distance in m                   (v2)
+
+ Readers must use the size field rather than assume 72 bytes, so that
+ later versions can add fields at the end. Version 1 headers are 64
+ bytes, without the fields marked v2.
+\********************************************************************/
+
+#ifndef LJBANKFORMAT_H
+#define LJBANKFORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define LJ_BANK_HEADER_VERSION	2
+#define LJ_BANK_NAME_LENGTH	16
+
+enum { LJ_ENCODING_DOUBLE = 0, LJ_ENCODING_LJZ = 1 };
+
+enum { LJ_BANK_FILTERED = 1, LJ_BANK_TRIGGERED = 2, LJ_BANK_ROBUST = 4,
+       LJ_BANK_CLIPPED = 8 };
+
+// Values per channel and slice in an LBRS bank.
+#define LJ_BANK_ROBUST_VALUES	5
+
+struct LJBankHeader {
+	char magic[4];
+	uint16_t version;
+	uint16_t headerSize;
+	uint32_t layoutId;
+	uint32_t nChannels;
+	uint32_t slicesPerEvent;
+	uint32_t valuesPerSlice;
+	uint32_t scansPerRead;
+	uint32_t encoding;
+	double scanRate;
+	double sliceRate;
+	double lsb;
+	uint32_t flags;
+	uint32_t reserved;
+	uint32_t derivedSensors;
+	uint32_t gradientPairs;
+};
+
+struct LJBankChannel {
+	char name[LJ_BANK_NAME_LENGTH];
+	int32_t address;
+	uint32_t reserved;
+};
+
+struct LJBankPair {
+	int32_t a;
+	int32_t b;
+	double distance;
+};
+
+// The layout in a form convenient to use, on both sides.
+struct LJBankLayout {
+
+	LJBankLayout();
+
+	int version;
+	uint32_t layoutId;
+	int nChannels;
+	int slicesPerEvent;
+	int valuesPerSlice;
+	int scansPerRead;
+	int encoding;
+	double scanRate;
+	double sliceRate;
+	double lsb;
+	uint32_t flags;
+
+	std::vector<std::string> names;
+	std::vector<int> addresses;
+
+	int derivedSensors;
+	std::vector<LJBankPair> gradientPairs;
+
+	// Number of doubles in an LBJK bank (or decoded LBJZ bank).
+	int EventValues() const
+	{
+		return 1 + slicesPerEvent * nChannels * valuesPerSlice;
+	}
+
+	// Number of doubles in an LBDV bank, 0 if there is none.
+	int DerivedValues() const
+	{
+		if (derivedSensors == 0) return 0;
+		return slicesPerEvent * (4 * derivedSensors + 
+					 4 * (int)gradientPairs.size());
+	}
+
+	// Number of doubles in an LBRS bank, 0 if there is none.
+	int RobustValues() const
+	{
+		if (!(flags & LJ_BANK_ROBUST)) return 0;
+		return slicesPerEvent * nChannels * LJ_BANK_ROBUST_VALUES;
+	}
+};
+
+// Size of the LBHD bank for nChannels channels and nPairs gradient pairs.
+size_t LJBankHeaderSize(int nChannels, int nPairs = 0);
+
+// Writes the LBHD bank for the layout into out, which must have room for
+// LJBankHeaderSize() bytes, and sets layout.layoutId. Returns the size.
+size_t LJBankHeaderEncode(LJBankLayout &layout, uint8_t *out);
+
+// Reads an LBHD bank. Returns false if it isn't one, is truncated, or
+// its layout id doesn't match its contents.
+bool LJBankHeaderDecode(const uint8_t *in, size_t size, LJBankLayout &layout);
+
+// A typed view into the values of an LBJK bank (or a decoded LBJZ bank),
+// without copying them. It is only valid while the bank is.
+class LJStatsView {
+
+public:
+
+	LJStatsView();
+
+	// Views the n doubles at data with the given layout. Valid() is false
+	// if n doesn't match the layout.
+	LJStatsView(const LJBankLayout &layout, const double *data, int n);
+
+	bool Valid() const { return fData != NULL; }
+
+	int Channels() const { return fChannels; }
+	int Slices() const { return fSlices; }
+
+	double Time() const { return fData[0]; }
+
+	double Mean(int channel, int slice = 0) const
+	{
+		return fData[1 + (slice * fChannels + channel) * fValues];
+	}
+
+	double Std(int channel, int slice = 0) const
+	{
+		return fData[2 + (slice * fChannels + channel) * fValues];
+	}
+
+	// The valuesPerSlice values of every channel of a slice, interleaved.
+	const double *Slice(int slice) const
+	{
+		return fData + 1 + slice * fChannels * fValues;
+	}
+
+private:
+
+	const double *fData;
+	int fChannels;
+	int fSlices;
+	int fValues;
+};
+
+#endif
@@ -0,0 +1,250 @@
+/********************************************************************\
+ Labjack block bus
+\********************************************************************/
+
+#include <chrono>
+
+#include "ljBlockBus.h"
+#include "ljProfile.h"
+
+LJBlockBus::LJBlockBus()
+	: fRunning(false), fSequence(0)
+{
+}
+
+LJBlockBus::~LJBlockBus()
+{
+	Stop();
+
+	for (size_t i = 0; i < fQueues.size(); i++) delete fQueues[i];
+	for (size_t i = 0; i < fPool.size(); i++) delete fPool[i];
+}
+
+/*-- Subscribe -----------------------------------------------------*/
+
+int LJBlockBus::Subscribe(const char *name, LJConsumer *consumer,
+			  LJBackPressure policy, int depth)
+{
+	if (depth < 1) depth = 1;
+
+	Queue *queue = new Queue;
+	queue->name = name;
+	queue->consumer = consumer;
+	queue->policy = policy;
+	queue->slots = std::vector<std::atomic<LJBlock *> >(depth);
+	for (int i = 0; i < depth; i++) queue->slots[i].store(NULL);
+	queue->read.store(0);
+	queue->write.store(0);
+	queue->processed.store(0);
+	queue->dropped.store(0);
+	queue->sleeping.store(false);
+
+	fQueues.push_back(queue);
+
+	return (int)fQueues.size() - 1;
+}
+
+/*-- Start ---------------------------------------------------------*/
+
+void LJBlockBus::Start(int nChannels, int maxScans)
+{
+	if (fRunning) return;
+
+	// Enough blocks for every queue to be full, plus the one being filled
+	// and the one each consumer is working on.
+	size_t poolSize = 1;
+	for (size_t i = 0; i < fQueues.size(); i++)
+		poolSize += fQueues[i]->slots.size() + 1;
+
+	for (size_t i = 0; i < fPool.size(); i++) delete fPool[i];
+	fPool.resize(poolSize);
+
+	for (size_t i = 0; i < poolSize; i++) {
+
+		fPool[i] = new LJBlock;
+		fPool[i]->data.resize((size_t)nChannels * maxScans);
+
+	}
+
+	fSequence = 0;
+	fRunning = true;
+
+	for (size_t i = 0; i < fQueues.size(); i++)
+		fQueues[i]->thread = std::thread(&LJBlockBus::Run, this, fQueues[i]);
+}
+
+/*-- Stop ----------------------------------------------------------*/
+
+void LJBlockBus::Stop()
+{
+	if (!fRunning) return;
+
+	fRunning = false;
+
+	for (size_t i = 0; i < fQueues.size(); i++) {
+
+		Wake(fQueues[i]);
+		if (fQueues[i]->thread.joinable()) fQueues[i]->thread.join();
+
+		// Whatever the consumer didn't get to is released unprocessed.
+		LJBlock *block;
+		while ((block = fQueues[i]->Pop()) != NULL) block->Release();
+
+	}
+}
+
+/*-- Acquire -------------------------------------------------------*/
+
+LJBlock *LJBlockBus::Acquire()
+{
+	for (size_t i = 0; i < fPool.size(); i++) {
+
+		int expected = 0;
+		if (fPool[i]->fRefs.compare_exchange_strong(expected, 1))
+			return fPool[i];
+
+	}
+
+	// Every block is still held by a consumer.
+	for (size_t i = 0; i < fQueues.size(); i++) fQueues[i]->dropped++;
+
+	return NULL;
+}
+
+/*-- Publish -------------------------------------------------------*/
+
+void LJBlockBus::Publish(LJBlock *block)
+{
+	block->sequence = fSequence++;
+
+	for (size_t i = 0; i < fQueues.size(); i++) {
+
+		Queue *queue = fQueues[i];
+
+		// The queue's reference.
+		block->Retain();
+
+		if (!queue->Push(block)) {
+
+			if (queue->policy == LJ_DROP_OLDEST) {
+
+				LJBlock *oldest = queue->Pop();
+				if (oldest) oldest->Release();
+				queue->dropped++;
+
+				// Only the publisher pushes, so there is room now.
+				queue->Push(block);
+
+			}
+
+			else if (queue->policy == LJ_BLOCK) {
+
+				while (!queue->Push(block)) {
+
+					if (!fRunning) {
+
+						block->Release();
+						queue->dropped++;
+						break;
+
+					}
+
+					Wake(queue);
+					std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+				}
+
+			}
+
+			else {
+
+				block->Release();
+				queue->dropped++;
+				continue;
+
+			}
+
+		}
+
+		Wake(queue);
+
+	}
+
+	// The publisher's reference.
+	block->Release();
+}
+
+/*-- Consumer thread -----------------------------------------------*/
+
+void LJBlockBus::Run(Queue *queue)
+{
+	LJ_PROFILE_THREAD(queue->name.c_str());
+
+	while (true) {
+
+		LJBlock *block = queue->Pop();
+
+		if (block) {
+
+			LJ_PROFILE_SCOPE("consumer");
+			queue->consumer->Process(*block);
+			block->Release();
+			queue->processed++;
+			continue;
+
+		}
+
+		if (!fRunning) break;
+
+		// Nothing to do: sleep until the publisher wakes us up. The queue
+		// is checked again after announcing that we are asleep, so a block
+		// pushed in between is not missed. The timeout is only a backstop.
+		std::unique_lock<std::mutex> lock(queue->mutex);
+		queue->sleeping = true;
+
+		if (queue->read.load() == queue->write.load() && fRunning)
+			queue->wakeup.wait_for(lock, std::chrono::milliseconds(100));
+
+		queue->sleeping = false;
+
+	}
+}
+
+void LJBlockBus::Wake(Queue *queue)
+{
+	if (!queue->sleeping) return;
+
+	std::lock_guard<std::mutex> lock(queue->mutex);
+	queue->wakeup.notify_one();
+}
+
+/*-- Queue ---------------------------------------------------------*/
+
+bool LJBlockBus::Queue::Push(LJBlock *block)
+{
+	uint64_t w = write.load(std::memory_order_relaxed);
+	uint64_t r = read.load(std::memory_order_acquire);
+
+	if (w - r >= slots.size()) return false;
+
+	slots[w % slots.size()].store(block, std::memory_order_release);
+	write.store(w + 1);
+
+	return true;
+}
+
+LJBlock *LJBlockBus::Queue::Pop()
+{
+	uint64_t r = read.load(std::memory_order_acquire);
+
+	while (r != write.load(std::memory_order_acquire)) {
+
+		// If the publisher dropped this block in the meantime, the slot
+		// may already hold a newer one; the CAS fails and we try again.
+		LJBlock *block = slots[r % slots.size()].load(std::memory_order_acquire);
+		if (read.compare_exchange_weak(r, r + 1)) return block;
+
+	}
+
+	return NULL;
+}
@@ -0,0 +1,165 @@
+/********************************************************************\
+ Labjack block bus
+
+ Fans the blocks read from the Labjack out to any number of consumers,
+ each of which runs on its own thread. This keeps slow processing (spectra,
+ archive writing, network taps, ...) out of read_labjack_event, so that it
+ can't hold up the MIDAS thread or the stream.
+
+ The acquisition thread takes a free block from a preallocated pool with
+ Acquire(), fills it, and hands it to Publish(). The block is reference
+ counted: every consumer queue which accepts it holds one reference, and
+ it goes back to the pool once the last consumer is done with it. Nothing
+ is copied per consumer.
+
+ Each consumer has a bounded queue, with a policy for when it is full:
+
+   LJ_DROP_NEWEST  the new block is not queued for this consumer,
+   LJ_DROP_OLDEST  the oldest queued block is dropped to make room,
+   LJ_BLOCK        Publish() waits until the consumer has made room.
+
+ Only LJ_BLOCK can ever hold up acquisition. The queues are lock-free;
+ a mutex is only taken to wake up a consumer which has gone to sleep on
+ an empty queue.
+
+ Consumers should be subscribed before Start(), and the bus stopped with
+ Stop() before they are destroyed.
+\********************************************************************/
+
+#ifndef LJBLOCKBUS_H
+#define LJBLOCKBUS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LJBlockBus;
+
+// One block of interleaved scans, with what is known about how it was
+// read. Consumers must treat it as read-only.
+class LJBlock {
+
+public:
+
+	LJBlock() : sequence(0), time(0), scanRate(0), nChannels(0), nScans(0),
+		    deviceBacklog(0), ljmBacklog(0), fRefs(0) {}
+
+	// Block number since the bus was started, and the unix time at which
+	// the block was read.
+	uint64_t sequence;
+	double time;
+
+	double scanRate;
+	int nChannels;
+	int nScans;
+
+	int deviceBacklog;
+	int ljmBacklog;
+
+	// nScans * nChannels samples: ch0, ch1, ... chN, ch0, ...
+	std::vector<double> data;
+
+	// Reference counting. A block returns to the pool when the last
+	// reference is released.
+	void Retain() { fRefs.fetch_add(1, std::memory_order_relaxed); }
+	void Release() { fRefs.fetch_sub(1, std::memory_order_acq_rel); }
+
+private:
+
+	friend class LJBlockBus;
+	std::atomic<int> fRefs;
+};
+
+// Back-pressure policies for a consumer queue which is full.
+enum LJBackPressure { LJ_DROP_NEWEST = 0, LJ_DROP_OLDEST = 1, LJ_BLOCK = 2 };
+
+// Base class of everything that wants to see the blocks.
+class LJConsumer {
+
+public:
+
+	virtual ~LJConsumer() {}
+
+	// Called on the consumer's own thread for every block it receives.
+	virtual void Process(const LJBlock &block) = 0;
+};
+
+class LJBlockBus {
+
+public:
+
+	LJBlockBus();
+	~LJBlockBus();
+
+	// Adds a consumer with a queue of depth blocks. Returns its index.
+	int Subscribe(const char *name, LJConsumer *consumer,
+		      LJBackPressure policy, int depth);
+
+	// Allocates the block pool for blocks of up to maxScans scans of
+	// nChannels channels, and starts the consumer threads.
+	void Start(int nChannels, int maxScans);
+
+	// Stops and joins the consumer threads. Blocks still queued are
+	// released without being processed.
+	void Stop();
+
+	bool Running() const { return fRunning; }
+	int Subscribers() const { return (int)fQueues.size(); }
+
+	// A free block with one reference held by the caller, or NULL if the
+	// pool is exhausted (which is counted as a drop for every consumer).
+	LJBlock *Acquire();
+
+	// Queues the block for every consumer and gives up the caller's
+	// reference.
+	void Publish(LJBlock *block);
+
+	// Per consumer: name, blocks processed and blocks dropped.
+	const char *Name(int i) const { return fQueues[i]->name.c_str(); }
+	uint64_t Processed(int i) const { return fQueues[i]->processed; }
+	uint64_t Dropped(int i) const { return fQueues[i]->dropped; }
+
+private:
+
+	// Queue of a single consumer. Only the publisher pushes. Both the
+	// consumer and, for LJ_DROP_OLDEST, the publisher pop, so a pop claims
+	// its slot by advancing fRead with a compare-and-swap.
+	struct Queue {
+
+		std::string name;
+		LJConsumer *consumer;
+		LJBackPressure policy;
+
+		std::vector<std::atomic<LJBlock *> > slots;
+		std::atomic<uint64_t> read;
+		std::atomic<uint64_t> write;
+
+		std::atomic<uint64_t> processed;
+		std::atomic<uint64_t> dropped;
+
+		// Wake-up of a consumer waiting for blocks.
+		std::mutex mutex;
+		std::condition_variable wakeup;
+		std::atomic<bool> sleeping;
+
+		std::thread thread;
+
+		bool Push(LJBlock *block);
+		LJBlock *Pop();
+	};
+
+	void Run(Queue *queue);
+	void Wake(Queue *queue);
+
+	std::vector<Queue *> fQueues;
+	std::vector<LJBlock *> fPool;
+
+	std::atomic<bool> fRunning;
+	uint64_t fSequence;
+};
+
+#endif
@@ -0,0 +1,118 @@
+/********************************************************************\
+ Labjack channel blocks
+\********************************************************************/
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <string.h>
+
+#include "ljChannels.h"
+
+// Scans per tile of the transpose: with up to 32 channels, the tile of
+// every channel array fits into a 32 kB L1 cache alongside the scans.
+static const int TILE_SCANS = 64;
+
+LJChannelBlock::LJChannelBlock()
+	: fChannels(0), fScans(0), fStride(0)
+{
+}
+
+LJChannelBlock::LJChannelBlock(const LJChannelBlock &other)
+	: fChannels(0), fScans(0), fStride(0)
+{
+	*this = other;
+}
+
+LJChannelBlock &LJChannelBlock::operator=(const LJChannelBlock &other)
+{
+	if (this == &other) return *this;
+
+	Reserve(other.fChannels, other.fStride);
+
+	for (int c = 0; c < fChannels; c++)
+		memcpy(Channel(c), other.Channel(c), sizeof(double) * other.fScans);
+
+	fScans = other.fScans;
+
+	return *this;
+}
+
+/*-- Reserve -------------------------------------------------------*/
+
+void LJChannelBlock::Reserve(int nChannels, int nScans)
+{
+	if (nChannels < 0) nChannels = 0;
+	if (nScans < 0) nScans = 0;
+
+	// The stride never shrinks, so that alternating block sizes don't
+	// cause reallocations. The extra 8 doubles leave room for aligning
+	// the start.
+	size_t stride = ((size_t)nScans + 7) / 8 * 8;
+	if (stride < fStride) stride = fStride;
+
+	size_t size = nChannels * stride + 8;
+	if (fStorage.size() < size) fStorage.resize(size);
+
+	fChannels = nChannels;
+	fScans = 0;
+	fStride = stride;
+}
+
+/*-- Load ----------------------------------------------------------*/
+
+void LJChannelBlock::Load(const double *scans, int nChannels, int nScans)
+{
+	if (nChannels != fChannels || (size_t)nScans > fStride)
+		Reserve(nChannels, nScans);
+
+	fScans = nScans;
+
+	double *base = Base();
+	const size_t n = nChannels;
+
+	for (int tile = 0; tile < nScans; tile += TILE_SCANS) {
+
+		int end = tile + TILE_SCANS < nScans ? tile + TILE_SCANS : nScans;
+		int c = 0;
+
+#ifdef __SSE2__
+		// Two channels of two scans at a time: (a0 a1) and (b0 b1) of 
+		// scans i and i+1 become (a0 b0) of channel c and (a1 b1) of 
+		// channel c+1. The channel arrays are aligned and i is even, so
+		// the stores are aligned.
+		for (; c + 1 < nChannels; c += 2) {
+
+			double *x0 = base + c * fStride;
+			double *x1 = x0 + fStride;
+			int i = tile;
+
+			for (; i + 1 < end; i += 2) {
+
+				__m128d a = _mm_loadu_pd(scans + i * n + c);
+				__m128d b = _mm_loadu_pd(scans + (i + 1) * n + c);
+				_mm_store_pd(x0 + i, _mm_unpacklo_pd(a, b));
+				_mm_store_pd(x1 + i, _mm_unpackhi_pd(a, b));
+
+			}
+
+			for (; i < end; i++) {
+
+				x0[i] = scans[i * n + c];
+				x1[i] = scans[i * n + c + 1];
+
+			}
+
+		}
+#endif
+
+		for (; c < nChannels; c++) {
+
+			double *x = base + c * fStride;
+			for (int i = tile; i < end; i++) x[i] = scans[i * n + c];
+
+		}
+
+	}
+}
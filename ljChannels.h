@@ -0,0 +1,76 @@
+/********************************************************************\
+ Labjack channel blocks
+
+ The stream delivers blocks of interleaved scans (scan i, channel c at
+ data[c + nChannels * i]), so every per-channel loop over a block strides
+ through memory and can't be vectorized. LJChannelBlock holds a block
+ de-interleaved into one contiguous array per channel instead, which is
+ what the statistics (ljStats.h) and the raw bank compression
+ (ljCompress.h) work on.
+
+ Every channel array starts on a 64 byte (cache line) boundary, and the
+ arrays are Stride() doubles apart. The transpose is done in tiles of
+ TILE_SCANS scans, so that the channel arrays being written stay in the
+ L1 cache while the scans are read through once, and within a tile two
+ channels of two scans are transposed at a time with SSE2 where it's
+ available.
+
+ The storage grows as needed, so a block can be loaded with any number
+ of scans; it is only reallocated when a block is larger than any before.
+\********************************************************************/
+
+#ifndef LJCHANNELS_H
+#define LJCHANNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class LJChannelBlock {
+
+public:
+
+	LJChannelBlock();
+	LJChannelBlock(const LJChannelBlock &other);
+	LJChannelBlock &operator=(const LJChannelBlock &other);
+
+	// Makes room for nScans scans of nChannels channels. The contents are
+	// lost.
+	void Reserve(int nChannels, int nScans);
+
+	// De-interleaves nScans scans of nChannels channels.
+	void Load(const double *scans, int nChannels, int nScans);
+
+	int Channels() const { return fChannels; }
+	int Scans() const { return fScans; }
+
+	// Doubles from the start of one channel to the next, a multiple of 8.
+	size_t Stride() const { return fStride; }
+
+	const double *Channel(int c) const { return Base() + c * fStride; }
+	double *Channel(int c) { return Base() + c * fStride; }
+
+private:
+
+	// The channel arrays start at the first 64 byte boundary in fStorage.
+	// A copy's storage can be aligned differently, so it's copied channel
+	// by channel.
+	const double *Base() const
+	{
+		uintptr_t p = (uintptr_t)fStorage.data();
+		return fStorage.data() + ((64 - p % 64) % 64) / sizeof(double);
+	}
+
+	double *Base()
+	{
+		return const_cast<double *>(((const LJChannelBlock *)this)->Base());
+	}
+
+	int fChannels;
+	int fScans;
+	size_t fStride;
+
+	std::vector<double> fStorage;
+};
+
+#endif
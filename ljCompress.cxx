@@ -0,0 +1,349 @@
+/********************************************************************\
+ Labjack bank compression
+\********************************************************************/
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "ljCompress.h"
+#include "ljStreamSource.h"
+
+// Unary quotients longer than this are replaced by an escape: this many
+// one bits, a zero, and the value in 64 bits.
+static const int ESCAPE = 32;
+
+static const size_t HEADER_SIZE = 24;
+
+/*-- Bit writer ----------------------------------------------------*/
+
+namespace {
+
+class BitWriter {
+
+public:
+
+	BitWriter(uint8_t *out) : fOut(out), fBytes(0), fAcc(0), fBits(0) {}
+
+	// Appends the n (at most 32) low bits of value.
+	void Put(uint64_t value, int n)
+	{
+		if (n == 0) return;
+
+		fAcc |= (value & ((1ULL << n) - 1)) << fBits;
+		fBits += n;
+
+		while (fBits >= 8) {
+
+			fOut[fBytes++] = (uint8_t)fAcc;
+			fAcc >>= 8;
+			fBits -= 8;
+
+		}
+	}
+
+	void Put64(uint64_t value)
+	{
+		Put(value & 0xFFFFFFFF, 32);
+		Put(value >> 32, 32);
+	}
+
+	// Pads to a whole byte and returns the number of bytes written.
+	size_t Finish()
+	{
+		if (fBits > 0) fOut[fBytes++] = (uint8_t)fAcc;
+		fAcc = 0;
+		fBits = 0;
+		return fBytes;
+	}
+
+private:
+
+	uint8_t *fOut;
+	size_t fBytes;
+	uint64_t fAcc;
+	int fBits;
+};
+
+class BitReader {
+
+public:
+
+	BitReader(const uint8_t *in, size_t size)
+		: fIn(in), fSize(size), fPos(0), fAcc(0), fBits(0) {}
+
+	// Returns the next n (at most 32) bits. Past the end, zeros are read
+	// and Overrun() turns true.
+	uint64_t Get(int n)
+	{
+		if (n == 0) return 0;
+
+		while (fBits < n) {
+
+			uint64_t byte = fPos < fSize ? fIn[fPos] : 0;
+			fPos++;
+			fAcc |= byte << fBits;
+			fBits += 8;
+
+		}
+
+		uint64_t value = fAcc & ((1ULL << n) - 1);
+		fAcc >>= n;
+		fBits -= n;
+
+		return value;
+	}
+
+	uint64_t Get64()
+	{
+		uint64_t low = Get(32);
+		return low | (Get(32) << 32);
+	}
+
+	bool Overrun() const { return fPos > fSize; }
+
+private:
+
+	const uint8_t *fIn;
+	size_t fSize;
+	size_t fPos;
+	uint64_t fAcc;
+	int fBits;
+};
+
+}
+
+/*-- Helpers -------------------------------------------------------*/
+
+static inline uint64_t ZigZag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t UnZigZag(uint64_t u)
+{
+	return (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+}
+
+static inline void PutU32(uint8_t *p, uint32_t v) { memcpy(p, &v, 4); }
+static inline uint32_t GetU32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+// The Rice parameter which makes the code of values around the mean of
+// the chunk shortest: about log2 of the mean.
+static int RiceParameter(const uint64_t *values, int n)
+{
+	uint64_t sum = 0;
+	for (int i = 0; i < n; i++) sum += values[i] > (1ULL << 56) ? (1ULL << 56) : values[i];
+
+	uint64_t mean = sum / n;
+	int k = 0;
+	while (k < 62 && (2ULL << k) <= mean) k++;
+
+	return k;
+}
+
+/*-- Size ----------------------------------------------------------*/
+
+size_t LJZMaxSize(int nSeries, int length)
+{
+	// Per value at worst an escape: ESCAPE + 1 + 64 bits. Per chunk the
+	// parameter, and per series the first value and the padding.
+	size_t chunks = (length + LJZ_CHUNK - 1) / LJZ_CHUNK;
+	size_t bits = (size_t)length * (ESCAPE + 1 + 64) + chunks * 6;
+
+	return HEADER_SIZE + 4 * (size_t)nSeries +
+	       (size_t)nSeries * (8 + bits / 8 + 1);
+}
+
+/*-- Encode --------------------------------------------------------*/
+
+// Encodes length values, step doubles apart, from x into p. Returns the
+// encoded size in bytes.
+static size_t EncodeSeries(const double *x, size_t step, int length,
+			   double scale, uint8_t *p)
+{
+	BitWriter bits(p);
+	uint64_t chunk[LJZ_CHUNK];
+
+	int64_t prev = length > 0 ? llrint(x[0] * scale) : 0;
+	bits.Put64((uint64_t)prev);
+
+	for (int start = 1; start < length; start += LJZ_CHUNK) {
+
+		int n = length - start;
+		if (n > LJZ_CHUNK) n = LJZ_CHUNK;
+
+		for (int i = 0; i < n; i++) {
+
+			int64_t q = llrint(x[(size_t)(start + i) * step] * scale);
+			chunk[i] = ZigZag(q - prev);
+			prev = q;
+
+		}
+
+		int k = RiceParameter(chunk, n);
+		bits.Put(k, 6);
+
+		for (int i = 0; i < n; i++) {
+
+			uint64_t quotient = chunk[i] >> k;
+
+			if (quotient < (uint64_t)ESCAPE) {
+
+				// quotient ones, a zero, and the k low bits.
+				bits.Put((1ULL << quotient) - 1, quotient + 1);
+				bits.Put(chunk[i], k > 32 ? 32 : k);
+				if (k > 32) bits.Put(chunk[i] >> 32, k - 32);
+
+			}
+
+			else {
+
+				bits.Put((1ULL << ESCAPE) - 1, ESCAPE);
+				bits.Put(0, 1);
+				bits.Put64(chunk[i]);
+
+			}
+
+		}
+
+	}
+
+	return bits.Finish();
+}
+
+static void PutHeader(uint8_t *out, int nSeries, int length, double lsb)
+{
+	memcpy(out, "LJZ1", 4);
+	PutU32(out + 4, nSeries);
+	PutU32(out + 8, length);
+	PutU32(out + 12, 0);
+	memcpy(out + 16, &lsb, 8);
+}
+
+size_t LJZEncode(const double *data, int nSeries, int length, double lsb,
+		 uint8_t *out)
+{
+	PutHeader(out, nSeries, length, lsb);
+
+	uint8_t *sizes = out + HEADER_SIZE;
+	uint8_t *p = sizes + 4 * (size_t)nSeries;
+
+	for (int s = 0; s < nSeries; s++) {
+
+		size_t n = EncodeSeries(data + s, nSeries, length, 1.0 / lsb, p);
+		PutU32(sizes + 4 * (size_t)s, n);
+		p += n;
+
+	}
+
+	return p - out;
+}
+
+size_t LJZEncodeSeries(const double *const *series, int nSeries, int length,
+		       double lsb, uint8_t *out)
+{
+	PutHeader(out, nSeries, length, lsb);
+
+	uint8_t *sizes = out + HEADER_SIZE;
+	uint8_t *p = sizes + 4 * (size_t)nSeries;
+
+	for (int s = 0; s < nSeries; s++) {
+
+		size_t n = EncodeSeries(series[s], 1, length, 1.0 / lsb, p);
+		PutU32(sizes + 4 * (size_t)s, n);
+		p += n;
+
+	}
+
+	return p - out;
+}
+
+/*-- Decode --------------------------------------------------------*/
+
+bool LJZDecode(const uint8_t *in, size_t size, std::vector<double> &out,
+	       int &nSeries, int &length)
+{
+	if (size < HEADER_SIZE || memcmp(in, "LJZ1", 4) != 0) return false;
+
+	uint32_t series = GetU32(in + 4);
+	uint32_t values = GetU32(in + 8);
+	if (series > INT_MAX || values > INT_MAX) return false;
+
+	nSeries = series;
+	length = values;
+
+	double lsb;
+	memcpy(&lsb, in + 16, 8);
+
+	if (size < HEADER_SIZE + 4 * (size_t)nSeries) return false;
+
+	// Every series takes at least 64 bits for its first value and a bit
+	// for each further one, so a corrupt or truncated bank is caught here
+	// rather than by allocating far more than it can hold.
+	uint64_t payloadBits = 
+		8 * (uint64_t)(size - HEADER_SIZE - 4 * (size_t)nSeries);
+	uint64_t minBits = (uint64_t)nSeries * (64 + (length > 0 ? length - 1 : 0));
+	if (minBits > payloadBits) return false;
+
+	out.resize((size_t)nSeries * length);
+
+	const uint8_t *sizes = in + HEADER_SIZE;
+	const uint8_t *p = sizes + 4 * (size_t)nSeries;
+	const uint8_t *end = in + size;
+
+	for (int s = 0; s < nSeries; s++) {
+
+		size_t n = GetU32(sizes + 4 * (size_t)s);
+		if (n > (size_t)(end - p)) return false;
+
+		BitReader bits(p, n);
+
+		int64_t q = (int64_t)bits.Get64();
+		int k = 0;
+
+		for (int i = 0; i < length; i++) {
+
+			if (i > 0) {
+
+				if ((i - 1) % LJZ_CHUNK == 0) k = (int)bits.Get(6);
+
+				uint64_t quotient = 0;
+				while (quotient < (uint64_t)ESCAPE && bits.Get(1)) quotient++;
+
+				uint64_t u;
+				if (quotient < (uint64_t)ESCAPE) {
+
+					u = quotient << k;
+					u |= bits.Get(k > 32 ? 32 : k);
+					if (k > 32) u |= bits.Get(k - 32) << 32;
+
+				}
+
+				else {
+
+					bits.Get(1);
+					u = bits.Get64();
+
+				}
+
+				q += UnZigZag(u);
+
+			}
+
+			double value = q * lsb;
+
+			// Skipped scans come back exactly as they went in.
+			if (fabs(value - LJM_DUMMY_VALUE) <= lsb) value = LJM_DUMMY_VALUE;
+
+			out[(size_t)i * nSeries + s] = value;
+
+		}
+
+		if (bits.Overrun()) return false;
+		p += n;
+
+	}
+
+	return true;
+}
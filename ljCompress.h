@@ -0,0 +1,66 @@
+/********************************************************************\
+ Labjack bank compression
+
+ A compact encoding of fluxgate data for MIDAS banks. The voltages carry
+ only 16-18 bits of real information, so rather than 8 byte doubles they
+ are stored as
+
+   1) fixed point integers, counts of a configurable LSB (e.g. 1 uV),
+   2) differences from the previous value of the same series, which are
+      small for slowly varying fields,
+   3) Rice codes of those differences, with the Rice parameter chosen
+      for every chunk of LJZ_CHUNK values.
+
+ The quantization is the only lossy step: decoded values are within
+ LSB/2 of the originals. Skipped scans (-9999 V) decode exactly.
+
+ The data is a set of series of equal length, interleaved in the same
+ way as the stream data: value i of series s is data[i*nSeries + s]. For
+ raw scans the series are the channels; for the mean/std pairs of an
+ LBJK bank there are two series, the means and the stds.
+
+ Encoded layout (little-endian):
+
+   offset  type       field
+   0       char[4]    magic, "LJZ1"
+   4       uint32     number of series
+   8       uint32     length of each series
+   12      uint32     flags, 0
+   16      double     LSB in volts
+   24      uint32[]   encoded size in bytes of each series
+   ...     series:    int64 first value in counts, then the Rice coded
+                      differences (zigzag mapped to unsigned), each chunk
+                      starting with its 6 bit Rice parameter. Bits are
+                      filled from the least significant end of each byte.
+                      Each series is padded to a whole byte.
+\********************************************************************/
+
+#ifndef LJCOMPRESS_H
+#define LJCOMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define LJZ_CHUNK 32
+
+// An upper limit on the encoded size of nSeries series of length values,
+// for sizing the output buffer.
+size_t LJZMaxSize(int nSeries, int length);
+
+// Encodes the interleaved data into out, which must have room for
+// LJZMaxSize(nSeries, length) bytes. Returns the encoded size in bytes.
+size_t LJZEncode(const double *data, int nSeries, int length, double lsb,
+		 uint8_t *out);
+
+// The same, for series which are each contiguous, e.g. the channels of a
+// de-interleaved block (see ljChannels.h). The output is identical.
+size_t LJZEncodeSeries(const double *const *series, int nSeries, int length,
+		       double lsb, uint8_t *out);
+
+// Decodes size bytes of encoded data into out, interleaved as they were
+// encoded. Returns false if the data is not a valid LJZ stream.
+bool LJZDecode(const uint8_t *in, size_t size, std::vector<double> &out,
+	       int &nSeries, int &length);
+
+#endif
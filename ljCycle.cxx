@@ -0,0 +1,207 @@
+/********************************************************************\
+ Labjack cycle events
+\********************************************************************/
+
+#include <math.h>
+
+#include "ljCycle.h"
+#include "ljStreamSource.h"
+
+LJCycleBuilder::LJCycleBuilder()
+	: fChannels(0), fScanRate(1), fScan(0), fLevel(-1), fLastEdge(0),
+	  fHaveEdge(false), fCycles(0), fOpen(false), fGood(0), fDropped(0)
+{
+}
+
+void LJCycleBuilder::Configure(const LJCycleConfig &config, int nChannels,
+			       double scanRate)
+{
+	fConfig = config;
+	if (fConfig.binScans < 1) fConfig.binScans = 1;
+	if (fConfig.maxBins < 0) fConfig.maxBins = 0;
+
+	fChannels = nChannels;
+	fScanRate = scanRate > 0 ? scanRate : 1;
+
+	fShift.resize(fChannels);
+	fSum.resize(fChannels);
+	fSum2.resize(fChannels);
+	fBinSum.resize((size_t)fConfig.maxBins * fChannels);
+	fBinCount.resize(fConfig.maxBins);
+
+	Reset();
+}
+
+void LJCycleBuilder::Reset()
+{
+	fScan = 0;
+	fLevel = -1;
+	fHaveEdge = false;
+	fOpen = false;
+	fCycles = 0;
+	fDone.clear();
+}
+
+/*-- Scans ---------------------------------------------------------*/
+
+void LJCycleBuilder::Add(const double *scans, const double *digital,
+			 int nScans, double time)
+{
+	const int mask = 1 << fConfig.dio;
+
+	for (int i = 0; i < nScans; i++, fScan++) {
+
+		const double *scan = scans + (size_t)i * fChannels;
+		bool skipped = scan[0] == LJM_DUMMY_VALUE;
+
+		// The triggered stream starts on the edge itself.
+		if (fScan == 0 && fConfig.startAtFirstScan) {
+
+			Open(time + i / fScanRate);
+			fCycle.flags |= LJ_CYCLE_FIRST;
+			fLastEdge = 0;
+			fHaveEdge = true;
+
+		}
+
+		// A skipped scan holds the line where it was.
+		if (digital[i] != LJM_DUMMY_VALUE) {
+
+			int level = ((int)digital[i] & mask) ? 1 : 0;
+
+			bool edge = fLevel >= 0 && level != fLevel &&
+				(fConfig.edge == LJ_EDGE_BOTH ||
+				 (fConfig.edge == LJ_EDGE_RISING) == (level == 1));
+
+			if (edge && (!fHaveEdge ||
+				     fScan - fLastEdge >= (uint64_t)fConfig.holdoffScans)) {
+
+				if (fOpen) Close(0);
+				Open(time + i / fScanRate);
+				fLastEdge = fScan;
+				fHaveEdge = true;
+
+			}
+
+			fLevel = level;
+
+		}
+
+		if (!fOpen) continue;
+
+		uint64_t offset = fScan - fCycle.firstScan;
+
+		if (fConfig.maxScans && offset >= fConfig.maxScans) {
+
+			Close(LJ_CYCLE_TIMEOUT);
+			continue;
+
+		}
+
+		fCycle.nScans++;
+
+		if (skipped) {
+
+			fCycle.skipped++;
+			continue;
+
+		}
+
+		if (fGood == 0)
+			for (int c = 0; c < fChannels; c++) fShift[c] = scan[c];
+
+		fGood++;
+
+		for (int c = 0; c < fChannels; c++) {
+
+			double v = scan[c];
+			double d = v - fShift[c];
+			fSum[c] += d;
+			fSum2[c] += d * d;
+			if (v < fCycle.min[c]) fCycle.min[c] = v;
+			if (v > fCycle.max[c]) fCycle.max[c] = v;
+
+		}
+
+		uint64_t bin = offset / fConfig.binScans;
+		if (bin < (uint64_t)fConfig.maxBins) {
+
+			double *sum = &fBinSum[bin * fChannels];
+			for (int c = 0; c < fChannels; c++) sum[c] += scan[c];
+			fBinCount[bin]++;
+
+			if ((int)bin >= fCycle.nBins) fCycle.nBins = bin + 1;
+
+		}
+
+	}
+}
+
+/*-- Cycles --------------------------------------------------------*/
+
+void LJCycleBuilder::Open(double time)
+{
+	fOpen = true;
+
+	fCycle.number = fCycles++;
+	fCycle.firstScan = fScan;
+	fCycle.time = time;
+	fCycle.nScans = 0;
+	fCycle.skipped = 0;
+	fCycle.flags = 0;
+	fCycle.nBins = 0;
+
+	fCycle.min.assign(fChannels, HUGE_VAL);
+	fCycle.max.assign(fChannels, -HUGE_VAL);
+
+	fGood = 0;
+	fSum.assign(fChannels, 0);
+	fSum2.assign(fChannels, 0);
+	fBinSum.assign(fBinSum.size(), 0);
+	fBinCount.assign(fBinCount.size(), 0);
+}
+
+void LJCycleBuilder::Close(int flags)
+{
+	fOpen = false;
+
+	LJCycle &cycle = fCycle;
+	cycle.flags |= flags;
+	if (cycle.skipped) cycle.flags |= LJ_CYCLE_SKIPPED;
+
+	cycle.mean.resize(fChannels);
+	cycle.std.resize(fChannels);
+
+	for (int c = 0; c < fChannels; c++) {
+
+		if (fGood == 0) {
+
+			cycle.mean[c] = cycle.std[c] = 0;
+			cycle.min[c] = cycle.max[c] = 0;
+			continue;
+
+		}
+
+		double m = fSum[c] / fGood;
+		double var = fSum2[c] / fGood - m * m;
+		cycle.mean[c] = fShift[c] + m;
+		cycle.std[c] = var > 0 ? sqrt(var) : 0;
+
+	}
+
+	cycle.bins.resize((size_t)cycle.nBins * fChannels);
+
+	for (int b = 0; b < cycle.nBins; b++)
+		for (int c = 0; c < fChannels; c++)
+			cycle.bins[(size_t)b * fChannels + c] = fBinCount[b] ?
+				fBinSum[(size_t)b * fChannels + c] / fBinCount[b] : 0;
+
+	if (fDone.size() >= LJ_CYCLE_QUEUE) {
+
+		fDone.pop_front();
+		fDropped++;
+
+	}
+
+	fDone.push_back(cycle);
+}
@@ -0,0 +1,162 @@
+/********************************************************************\
+ Labjack cycle events
+
+ Cuts the stream into the cycles of an external machine (e.g. the UCN
+ beam and kicker cycles), marked by edges on a digital line that is
+ streamed along with the analog channels. The edges are found in the
+ streamed digital states scan by scan, so a cycle is aligned with the
+ hardware to within a scan, without correlating anything in software
+ afterwards.
+
+ A cycle runs from one edge to the next (the scan with the edge is the
+ first of the new cycle), or until it has run for the maximum length,
+ after which the next edge is waited for. Edges closer than the holdoff
+ to the previous one are ignored, to ride out ringing on the line. For
+ every completed cycle, LJCycle holds
+
+   * when it started (scan number since the stream started, and unix
+     time), its length and the skipped scans in it;
+   * the mean, STD, minimum and maximum of every channel over it;
+   * the profile: the mean of every channel over consecutive bins of a
+     fixed number of scans from the edge, so cycles can be overlaid and
+     averaged as they are.
+
+ Skipped scans (-9999) count towards the length but not the statistics,
+ and hold the digital line at its last state. Completed cycles are kept
+ in a short queue until they are taken, the oldest being dropped if it
+ is full.
+\********************************************************************/
+
+#ifndef LJCYCLE_H
+#define LJCYCLE_H
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+#include "ljStreamConfig.h"
+
+// Bits of LJCycle::flags.
+#define LJ_CYCLE_TIMEOUT	0x1	// ended at the maximum length
+#define LJ_CYCLE_SKIPPED	0x2	// had skipped scans
+#define LJ_CYCLE_FIRST		0x4	// started with the triggered stream
+
+// Completed cycles kept until taken.
+#define LJ_CYCLE_QUEUE		16
+
+struct LJCycleConfig {
+
+	LJCycleConfig()
+		: dio(0), edge(LJ_EDGE_RISING), holdoffScans(0), binScans(1),
+		  maxBins(0), maxScans(0), startAtFirstScan(false) {}
+
+	// The bit of the digital state with the cycle line, and the edge
+	// (LJ_EDGE_*) which starts a cycle.
+	int dio;
+	int edge;
+
+	// Edges fewer than this many scans after the last one are ignored.
+	int holdoffScans;
+
+	// The profile has up to maxBins bins of binScans scans each.
+	int binScans;
+	int maxBins;
+
+	// A cycle is ended after this many scans without an edge, 0 for no
+	// limit.
+	uint64_t maxScans;
+
+	// The stream is triggered by the cycle edge, so its first scan starts
+	// a cycle.
+	bool startAtFirstScan;
+};
+
+struct LJCycle {
+
+	// Cycle number since the reset, and the scan of its edge since the
+	// stream started.
+	uint64_t number;
+	uint64_t firstScan;
+
+	// Unix time of the edge.
+	double time;
+
+	uint64_t nScans;
+	uint64_t skipped;
+	int flags;
+
+	// Per channel.
+	std::vector<double> mean;
+	std::vector<double> std;
+	std::vector<double> min;
+	std::vector<double> max;
+
+	// The profile, bins[b * nChannels + c]. Bins without a good scan are 0.
+	int nBins;
+	std::vector<double> bins;
+};
+
+class LJCycleBuilder {
+
+public:
+
+	LJCycleBuilder();
+
+	// Sets up for nChannels channels scanned at scanRate Hz, and resets.
+	void Configure(const LJCycleConfig &config, int nChannels,
+		       double scanRate);
+
+	// Forgets the cycle in progress and counts scans from 0 again, for a
+	// restarted stream.
+	void Reset();
+
+	// Adds nScans interleaved scans of the analog channels, with the
+	// digital state of each scan. time is the unix time of the first scan.
+	void Add(const double *scans, const double *digital, int nScans,
+		 double time);
+
+	// Completed cycles, oldest first.
+	bool Ready() const { return !fDone.empty(); }
+	const LJCycle &Front() const { return fDone.front(); }
+	void Pop() { fDone.pop_front(); }
+
+	// Completed cycles dropped because the queue was full.
+	uint64_t Dropped() const { return fDropped; }
+
+	const LJCycleConfig &Config() const { return fConfig; }
+	int Channels() const { return fChannels; }
+	double ScanRate() const { return fScanRate; }
+
+private:
+
+	void Open(double time);
+	void Close(int flags);
+
+	LJCycleConfig fConfig;
+	int fChannels;
+	double fScanRate;
+
+	// Scans since the reset, the level of the line (-1 before the first
+	// good state) and the scan of the last edge taken.
+	uint64_t fScan;
+	int fLevel;
+	uint64_t fLastEdge;
+	bool fHaveEdge;
+	uint64_t fCycles;
+
+	// The cycle in progress. The sums are taken relative to the first
+	// good value of each channel, which keeps them precise.
+	bool fOpen;
+	LJCycle fCycle;
+	std::vector<double> fShift;
+	std::vector<double> fSum;
+	std::vector<double> fSum2;
+	uint64_t fGood;
+	std::vector<double> fBinSum;
+	std::vector<int> fBinCount;
+
+	std::deque<LJCycle> fDone;
+	uint64_t fDropped;
+};
+
+#endif
@@ -0,0 +1,80 @@
+/********************************************************************\
+ Labjack derived quantities
+\********************************************************************/
+
+#include <math.h>
+
+#include "ljDerived.h"
+
+LJDerived::LJDerived()
+	: fSensors(0)
+{
+}
+
+/*-- Configure -----------------------------------------------------*/
+
+bool LJDerived::Configure(int nSensors, const std::vector<LJGradientPair> &pairs)
+{
+	fSensors = nSensors;
+	fPairs.clear();
+
+	for (size_t i = 0; i < pairs.size(); i++) {
+
+		if (pairs[i].a < 0 || pairs[i].a >= nSensors ||
+		    pairs[i].b < 0 || pairs[i].b >= nSensors) return false;
+
+		fPairs.push_back(pairs[i]);
+
+	}
+
+	fX.assign(fSensors, 0);
+	fY.assign(fSensors, 0);
+	fZ.assign(fSensors, 0);
+	fMagnitude.assign(fSensors, 0);
+
+	return true;
+}
+
+/*-- Compute -------------------------------------------------------*/
+
+void LJDerived::Compute(const double *means, int stride, double *out)
+{
+	const int n = fSensors;
+	double *x = &fX[0], *y = &fY[0], *z = &fZ[0], *mag = &fMagnitude[0];
+
+	for (int s = 0; s < n; s++) {
+
+		x[s] = means[stride * (3 * s)];
+		y[s] = means[stride * (3 * s + 1)];
+		z[s] = means[stride * (3 * s + 2)];
+
+	}
+
+	for (int s = 0; s < n; s++)
+		mag[s] = sqrt(x[s] * x[s] + y[s] * y[s] + z[s] * z[s]);
+
+	for (int s = 0; s < n; s++) {
+
+		double inverse = mag[s] > 0 ? 1.0 / mag[s] : 0;
+
+		out[LJ_DERIVED_SENSOR_VALUES * s] = mag[s];
+		out[LJ_DERIVED_SENSOR_VALUES * s + 1] = x[s] * inverse;
+		out[LJ_DERIVED_SENSOR_VALUES * s + 2] = y[s] * inverse;
+		out[LJ_DERIVED_SENSOR_VALUES * s + 3] = z[s] * inverse;
+
+	}
+
+	out += LJ_DERIVED_SENSOR_VALUES * n;
+
+	for (size_t p = 0; p < fPairs.size(); p++) {
+
+		int a = fPairs[p].a, b = fPairs[p].b;
+		double scale = fPairs[p].distance > 0 ? 1.0 / fPairs[p].distance : 1;
+
+		out[LJ_DERIVED_PAIR_VALUES * p] = (x[b] - x[a]) * scale;
+		out[LJ_DERIVED_PAIR_VALUES * p + 1] = (y[b] - y[a]) * scale;
+		out[LJ_DERIVED_PAIR_VALUES * p + 2] = (z[b] - z[a]) * scale;
+		out[LJ_DERIVED_PAIR_VALUES * p + 3] = (mag[b] - mag[a]) * scale;
+
+	}
+}
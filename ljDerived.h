@@ -0,0 +1,72 @@
+/********************************************************************\
+ Labjack derived quantities
+
+ Combines the channel means of the x/y/z sensors (three consecutive
+ channels each) into the field magnitude and direction of every sensor,
+ and the gradients between configured pairs of sensors. The values are
+ in the units of the means, so sensors with different scales have to be
+ calibrated before they are passed in, as the frontend does.
+
+ The output of Compute() is, for every sensor,
+
+   |B|, then the direction as a unit vector (x, y, z), 0 if |B| is 0
+
+ followed, for every pair (a, b), by
+
+   (B_b - B_a) / distance for x, y, z and |B|
+
+ with a distance of 0 giving the plain differences. The sensors are
+ worked on as separate x, y and z arrays, so that the loops vectorize.
+\********************************************************************/
+
+#ifndef LJDERIVED_H
+#define LJDERIVED_H
+
+#include <vector>
+
+// Values per sensor and per pair in the output.
+#define LJ_DERIVED_SENSOR_VALUES	4
+#define LJ_DERIVED_PAIR_VALUES		4
+
+struct LJGradientPair {
+	int a;
+	int b;
+	double distance;
+};
+
+class LJDerived {
+
+public:
+
+	LJDerived();
+
+	// Sets up for nSensors sensors and the given pairs. Returns false if a
+	// pair refers to a sensor that doesn't exist.
+	bool Configure(int nSensors, const std::vector<LJGradientPair> &pairs);
+
+	int Sensors() const { return fSensors; }
+	int Pairs() const { return (int)fPairs.size(); }
+	const LJGradientPair &Pair(int i) const { return fPairs[i]; }
+
+	// Number of values written by Compute().
+	int Values() const
+	{
+		return fSensors * LJ_DERIVED_SENSOR_VALUES +
+		       Pairs() * LJ_DERIVED_PAIR_VALUES;
+	}
+
+	// Computes the derived values from the means of the 3 * Sensors()
+	// channels, that of channel c at means[stride * c], into out, which
+	// must have room for Values() doubles.
+	void Compute(const double *means, int stride, double *out);
+
+private:
+
+	int fSensors;
+	std::vector<LJGradientPair> fPairs;
+
+	// Components and magnitude of each sensor.
+	std::vector<double> fX, fY, fZ, fMagnitude;
+};
+
+#endif
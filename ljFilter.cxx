@@ -0,0 +1,213 @@
+/********************************************************************\
+ Labjack digital filter and decimation
+\********************************************************************/
+
+#include <math.h>
+
+#include "ljFilter.h"
+#include "ljStreamSource.h"
+
+LJFilter::LJFilter()
+	: fChannels(0), fScanRate(1), fDecimation(1), fOrder(0), fPhase(0),
+	  fFixed(1), fScale(1), fPrimed(false)
+{
+}
+
+/*-- Configure -----------------------------------------------------*/
+
+void LJFilter::Configure(const LJFilterConfig &config, int nChannels,
+			 double scanRate)
+{
+	fChannels = nChannels;
+	fScanRate = scanRate;
+
+	fDecimation = config.decimation > 1 ? config.decimation : 1;
+	fOrder = fDecimation > 1 ? config.cicOrder : 0;
+	if (fOrder < 0) fOrder = 0;
+
+	// One notch section per harmonic, up to the Nyquist frequency.
+	fNotch.clear();
+	if (config.notchFrequency > 0 && config.notchQ > 0) {
+
+		for (int h = 1; h <= config.notchHarmonics; h++) {
+
+			double f = h * config.notchFrequency;
+			if (f >= 0.5 * scanRate) break;
+
+			double w0 = 2 * M_PI * f / scanRate;
+			double alpha = sin(w0) / (2 * config.notchQ);
+			double a0 = 1 + alpha;
+
+			Biquad q;
+			q.b0 = 1 / a0;
+			q.b1 = -2 * cos(w0) / a0;
+			q.b2 = 1 / a0;
+			q.a1 = -2 * cos(w0) / a0;
+			q.a2 = (1 - alpha) / a0;
+			fNotch.push_back(q);
+
+		}
+
+	}
+
+	// The inputs are converted to fixed point with as many fractional bits
+	// as fit into 63 bits after the gain, leaving 5 bits for inputs up to
+	// +/-16 V. With the gain at most LJ_FILTER_MAX_GAIN_BITS, that is at
+	// least 8.
+	double gainBits = GainBits(fDecimation, fOrder);
+	int fractionBits = (int)(58 - ceil(gainBits));
+	if (fractionBits > 40) fractionBits = 40;
+
+	fFixed = ldexp(1.0, fractionBits);
+	fScale = 1.0 / (fFixed * pow((double)fDecimation, fOrder));
+
+	Reset();
+}
+
+/*-- Reset ---------------------------------------------------------*/
+
+void LJFilter::Reset()
+{
+	fZ1.assign(fNotch.size() * fChannels, 0);
+	fZ2.assign(fNotch.size() * fChannels, 0);
+	fIntegrator.assign((size_t)fOrder * fChannels, 0);
+	fComb.assign((size_t)fOrder * fChannels, 0);
+	fLast.assign(fChannels, 0);
+	fWork.assign(fChannels, 0);
+
+	fPhase = 0;
+	fPrimed = false;
+}
+
+/*-- Output size ---------------------------------------------------*/
+
+int LJFilter::MaxOutput(int nScans) const
+{
+	return nScans / fDecimation + 1;
+}
+
+/*-- Prime ---------------------------------------------------------*/
+
+// Starting from zero state, both the notches and the CIC would ring for a
+// while on the DC level of the fluxgates. Instead the state is set as if
+// the first scan had been the input forever: the notches have unity gain
+// at DC, so their steady state follows directly, and the CIC is run over
+// one full response length of the first scan.
+void LJFilter::Prime(const double *scan)
+{
+	for (int ch = 0; ch < fChannels; ch++) {
+
+		double x = scan[ch] == LJM_DUMMY_VALUE ? 0 : scan[ch];
+		fLast[ch] = x;
+
+		for (size_t k = 0; k < fNotch.size(); k++) {
+
+			const Biquad &q = fNotch[k];
+			fZ2[k*fChannels + ch] = (q.b2 - q.a2) * x;
+			fZ1[k*fChannels + ch] = (q.b1 - q.a1) * x + fZ2[k*fChannels + ch];
+
+		}
+
+	}
+
+	fPrimed = true;
+
+	if (fOrder == 0) return;
+
+	std::vector<double> discard(fChannels);
+	for (int i = 0; i < fOrder * fDecimation; i++) Step(scan, &discard[0]);
+	fPhase = 0;
+}
+
+/*-- Single scan ---------------------------------------------------*/
+
+bool LJFilter::Step(const double *scan, double *out)
+{
+	double *w = &fWork[0];
+
+	// Skipped scans repeat the last good value, which keeps the filters
+	// from ringing on the -9999 placeholders.
+	for (int ch = 0; ch < fChannels; ch++) {
+
+		if (scan[ch] == LJM_DUMMY_VALUE) w[ch] = fLast[ch];
+		else w[ch] = fLast[ch] = scan[ch];
+
+	}
+
+	// Notches, in transposed direct form II.
+	for (size_t k = 0; k < fNotch.size(); k++) {
+
+		const Biquad q = fNotch[k];
+		double *z1 = &fZ1[k*fChannels];
+		double *z2 = &fZ2[k*fChannels];
+
+		for (int ch = 0; ch < fChannels; ch++) {
+
+			double x = w[ch];
+			double y = q.b0 * x + z1[ch];
+			z1[ch] = q.b1 * x - q.a1 * y + z2[ch];
+			z2[ch] = q.b2 * x - q.a2 * y;
+			w[ch] = y;
+
+		}
+
+	}
+
+	if (fOrder == 0) {
+
+		for (int ch = 0; ch < fChannels; ch++) out[ch] = w[ch];
+		return true;
+
+	}
+
+	// CIC integrators run at the input rate...
+	uint64_t *integrator = &fIntegrator[0];
+	for (int ch = 0; ch < fChannels; ch++)
+		integrator[ch] += (uint64_t)llrint(w[ch] * fFixed);
+
+	for (int s = 1; s < fOrder; s++) {
+
+		uint64_t *cur = &fIntegrator[(size_t)s*fChannels];
+		const uint64_t *prev = &fIntegrator[(size_t)(s-1)*fChannels];
+		for (int ch = 0; ch < fChannels; ch++) cur[ch] += prev[ch];
+
+	}
+
+	if (++fPhase < fDecimation) return false;
+	fPhase = 0;
+
+	// ...and the combs at the output rate.
+	const uint64_t *last = &fIntegrator[(size_t)(fOrder-1)*fChannels];
+	for (int ch = 0; ch < fChannels; ch++) {
+
+		uint64_t c = last[ch];
+		for (int s = 0; s < fOrder; s++) {
+
+			uint64_t y = c - fComb[(size_t)s*fChannels + ch];
+			fComb[(size_t)s*fChannels + ch] = c;
+			c = y;
+
+		}
+
+		out[ch] = (double)(int64_t)c * fScale;
+
+	}
+
+	return true;
+}
+
+/*-- Process -------------------------------------------------------*/
+
+int LJFilter::Process(const double *scans, int nScans, double *out)
+{
+	if (nScans <= 0 || fChannels == 0) return 0;
+
+	if (!fPrimed) Prime(scans);
+
+	int nOut = 0;
+	for (int i = 0; i < nScans; i++)
+		if (Step(scans + (size_t)i*fChannels, out + (size_t)nOut*fChannels))
+			nOut++;
+
+	return nOut;
+}
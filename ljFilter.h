@@ -0,0 +1,119 @@
+/********************************************************************\
+ Labjack digital filter and decimation
+
+ An optional filter chain which is applied to every channel before the
+ mean and standard deviation are taken:
+
+   1) notch filters at a mains frequency and its harmonics (second order
+      IIR sections, from the RBJ audio EQ cookbook),
+   2) a cascaded integrator-comb (CIC) decimator of order N and rate
+      change R, which is an N-fold boxcar average over R scans without a
+      single multiplication.
+
+ The filter state is kept between calls, so blocks of any length can be
+ passed in one after another and the output is the same as if the whole
+ stream had been filtered at once. The number of output scans of a block
+ therefore depends on where the decimation phase was left off.
+
+ The CIC integrators run on 64 bit integers, where overflow wraps around
+ and cancels out in the combs, rather than on doubles, where the growing
+ integrator values would slowly eat up the precision.
+\********************************************************************/
+
+#ifndef LJFILTER_H
+#define LJFILTER_H
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+// The CIC has a gain of R^N, i.e. N log2(R) bits. Its integrators are only
+// exact while the inputs (5 integer bits for +/-16 V, and at least 8
+// fractional bits) and the gain fit into 63 bits, so at most this many.
+#define LJ_FILTER_MAX_GAIN_BITS	50
+
+struct LJFilterConfig {
+
+	// CIC rate change R (1 for no decimation) and number of stages N.
+	int decimation;
+	int cicOrder;
+
+	// Notch frequency in Hz (0 for none), how many harmonics of it to
+	// notch (1 is the fundamental only), and the quality factor.
+	double notchFrequency;
+	int notchHarmonics;
+	double notchQ;
+};
+
+class LJFilter {
+
+public:
+
+	LJFilter();
+
+	// Sets up the chain for nChannels interleaved channels streamed at
+	// scanRate, and clears the filter state. The CIC gain must be at most
+	// LJ_FILTER_MAX_GAIN_BITS (see GainBits()).
+	void Configure(const LJFilterConfig &config, int nChannels,
+		       double scanRate);
+
+	// Clears the filter state, e.g. after the stream has been restarted.
+	void Reset();
+
+	// Filters nScans interleaved scans. The decimated scans are written,
+	// interleaved, to out, which must have room for MaxOutput(nScans)
+	// scans. Returns the number of output scans.
+	int Process(const double *scans, int nScans, double *out);
+
+	// The most scans Process() can return for a block of nScans scans.
+	int MaxOutput(int nScans) const;
+
+	// Scan rate of the output.
+	double OutputRate() const { return fScanRate / fDecimation; }
+
+	int Decimation() const { return fDecimation; }
+
+	// Gain of a CIC of order cicOrder decimating by decimation, in bits.
+	static double GainBits(int decimation, int cicOrder)
+		{ return decimation > 1 ? cicOrder * log2((double)decimation) : 0; }
+
+private:
+
+	// Sets the state as if the first scan had always been the input.
+	void Prime(const double *scan);
+
+	// Filters a single scan. Returns true if an output scan was written.
+	bool Step(const double *scan, double *out);
+
+	int fChannels;
+	double fScanRate;
+
+	// Notch sections: coefficients are shared by all channels, the state
+	// is stored section by section, channel by channel, so that the inner
+	// loops run over contiguous channels.
+	struct Biquad { double b0, b1, b2, a1, a2; };
+	std::vector<Biquad> fNotch;
+	std::vector<double> fZ1;
+	std::vector<double> fZ2;
+
+	// CIC state, stage by stage, channel by channel.
+	int fDecimation;
+	int fOrder;
+	int fPhase;
+
+	// Fixed point scale of the CIC inputs, and the factor which converts
+	// the CIC output back to volts and removes its gain.
+	double fFixed;
+	double fScale;
+	std::vector<uint64_t> fIntegrator;
+	std::vector<uint64_t> fComb;
+
+	// The last good input of each channel, used in place of skipped scans,
+	// and the current scan after the notches.
+	std::vector<double> fLast;
+	std::vector<double> fWork;
+
+	bool fPrimed;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/********************************************************************\
+ Labjack flight recorder
+\********************************************************************/
+
+#include <string.h>
+
+#include "ljFlightRecorder.h"
+
+LJFlightRecorder::LJFlightRecorder()
+	: fChannels(0), fCapacity(0), fHead(0), fSize(0),
+	  fPending(false), fPostTrigger(0)
+{
+}
+
+/*-- Allocate ------------------------------------------------------*/
+
+void LJFlightRecorder::Allocate(int nChannels, int capacity)
+{
+	fChannels = nChannels > 0 ? nChannels : 0;
+	fCapacity = capacity > 0 ? capacity : 0;
+
+	fRing.assign((size_t)fChannels * fCapacity, 0.0f);
+
+	fHead = 0;
+	fSize = 0;
+	fPending = false;
+	fPostTrigger = 0;
+}
+
+/*-- Record --------------------------------------------------------*/
+
+void LJFlightRecorder::Record(const double *scans, int nScans)
+{
+	if (fCapacity == 0) return;
+
+	// Only the last fCapacity scans of a very long block can survive.
+	if (nScans > fCapacity) {
+
+		scans += (size_t)(nScans - fCapacity) * fChannels;
+		if (fPending) fPostTrigger -= nScans - fCapacity;
+		nScans = fCapacity;
+
+	}
+
+	// The block is copied in at most two pieces: up to the end of the
+	// ring, and the remainder from the start.
+	int done = 0;
+	while (done < nScans) {
+
+		int n = nScans - done;
+		if (n > fCapacity - fHead) n = fCapacity - fHead;
+
+		const double *src = scans + (size_t)done * fChannels;
+		float *dst = &fRing[(size_t)fHead * fChannels];
+		for (int i = 0; i < n * fChannels; i++) dst[i] = (float)src[i];
+
+		fHead = (fHead + n) % fCapacity;
+		done += n;
+
+	}
+
+	fSize += nScans;
+	if (fSize > fCapacity) fSize = fCapacity;
+
+	if (fPending) fPostTrigger -= nScans;
+}
+
+/*-- Trigger -------------------------------------------------------*/
+
+bool LJFlightRecorder::Trigger(int postTriggerScans)
+{
+	if (fPending || fCapacity == 0) return false;
+
+	// Waiting longer than the ring is long would lose the trigger itself.
+	if (postTriggerScans > fCapacity) postTriggerScans = fCapacity;
+	if (postTriggerScans < 0) postTriggerScans = 0;
+
+	fPending = true;
+	fPostTrigger = postTriggerScans;
+
+	return true;
+}
+
+/*-- Snapshot ------------------------------------------------------*/
+
+int LJFlightRecorder::Snapshot(float *out, int maxScans)
+{
+	int n = fSize < maxScans ? fSize : maxScans;
+
+	fPending = false;
+	fPostTrigger = 0;
+
+	if (n <= 0) return 0;
+
+	// The oldest of the n most recent scans.
+	int start = (fHead - n + fCapacity) % fCapacity;
+
+	int first = fCapacity - start;
+	if (first > n) first = n;
+
+	memcpy(out, &fRing[(size_t)start * fChannels],
+	       sizeof(float) * first * fChannels);
+	if (n > first)
+		memcpy(out + (size_t)first * fChannels, &fRing[0],
+		       sizeof(float) * (n - first) * fChannels);
+
+	return n;
+}
@@ -0,0 +1,68 @@
+/********************************************************************\
+ Labjack flight recorder
+
+ Keeps the last few seconds of raw scans in a ring buffer which is
+ allocated once, so that the raw waveform around a field excursion or a
+ quench can be looked at afterwards. Recording is a copy of each block
+ into the ring; nothing else happens until a dump is triggered.
+
+ A dump is triggered with Trigger(). The ring then keeps recording for
+ the requested number of post-trigger scans, after which Ready() turns
+ true and Snapshot() copies the window out, oldest scan first. Scans are
+ stored interleaved, in the same order as the stream data.
+\********************************************************************/
+
+#ifndef LJFLIGHTRECORDER_H
+#define LJFLIGHTRECORDER_H
+
+#include <vector>
+
+class LJFlightRecorder {
+
+public:
+
+	LJFlightRecorder();
+
+	// Sets up the ring for nChannels channels and capacity scans. Any
+	// recorded data and pending trigger are discarded.
+	void Allocate(int nChannels, int capacity);
+
+	// Copies nScans interleaved scans into the ring, overwriting the
+	// oldest ones once it is full.
+	void Record(const double *scans, int nScans);
+
+	// Arms a dump which becomes ready after postTriggerScans more scans.
+	// Returns false if a dump is already pending.
+	bool Trigger(int postTriggerScans);
+
+	// True from Trigger() until the dump has been taken by Snapshot().
+	bool Pending() const { return fPending; }
+
+	// True once the post-trigger scans have been recorded.
+	bool Ready() const { return fPending && fPostTrigger <= 0; }
+
+	// Copies up to maxScans of the most recent scans into out, oldest
+	// first, and clears the pending dump. Returns the number of scans.
+	int Snapshot(float *out, int maxScans);
+
+	int Channels() const { return fChannels; }
+	int Capacity() const { return fCapacity; }
+	int Size() const { return fSize; }
+
+private:
+
+	std::vector<float> fRing;
+
+	int fChannels;
+	int fCapacity;
+
+	// Index of the scan which will be written next, and the number of
+	// valid scans in the ring.
+	int fHead;
+	int fSize;
+
+	bool fPending;
+	int fPostTrigger;
+};
+
+#endif
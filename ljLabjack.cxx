@@ -0,0 +1,144 @@
+/********************************************************************\
+ Labjack device access
+\********************************************************************/
+
+#include <stdio.h>
+
+#include "LabJackM.h"
+#include "ljLabjack.h"
+
+/*-- Channels ------------------------------------------------------*/
+
+// Without the _ljcore extension, LabJackCore.py reads the names from here,
+// so keep them quoted between the braces.
+//                                         x        y        z
+const char *const LJ_FLUXGATE_CHANNELS[] = {"AIN73", "AIN75", "AIN77",	// 1
+					   "AIN72", "AIN74", "AIN76",	// 2
+					   "AIN79", "AIN81", "AIN83",	// 3
+					   "AIN78", "AIN80", "AIN82",	// 4
+					   "AIN99", "AIN101", "AIN103",	// 5
+					   "AIN96", "AIN98", "AIN100",	// 6
+					   "AIN107", "AIN109", "AIN110",	// 7
+					   "AIN102", "AIN104", "AIN106",	// 8
+					   "AIN115", "AIN117", "AIN119",	// 9
+					   "AIN108", "AIN111", "AIN113"};	// 10
+
+/*-- Stream configuration ------------------------------------------*/
+
+static int Write(int handle, const char *name, double value,
+		 std::string &failed)
+{
+	int err = LJM_eWriteName(handle, name, value);
+	if (err != LJME_NOERROR) failed = name;
+
+	return err;
+}
+
+int LJWriteStreamConfig(int handle, const LJStreamConfig &config,
+			const char *const *channelNames, int nChannels,
+			std::string &failed)
+{
+	int err;
+	char name[LJM_MAX_NAME_SIZE];
+
+	// A triggered stream is started by an edge-detecting extended feature
+	// of the DIO, STREAM_TRIGGER_INDEX 2000 + n for DIOn_EF. The feature
+	// is disabled while it is changed.
+	int trigger = config.triggerDIO >= 0 ? 2000 + config.triggerDIO : 0;
+	if ((err = Write(handle, "STREAM_TRIGGER_INDEX", trigger, failed)))
+		return err;
+
+	if (trigger) {
+
+		// DIO_EF 3 and 4 are frequency in on rising and falling edges,
+		// 5 is pulse width in, which fires on either. All three exist on
+		// DIO0 and DIO1 only (T7_MAX_TRIGGER_DIO).
+		static const int EF_INDEX[] = {3, 4, 5};
+
+		snprintf(name, sizeof(name), "DIO%d_EF_ENABLE", config.triggerDIO);
+		if ((err = Write(handle, name, 0, failed))) return err;
+
+		snprintf(name, sizeof(name), "DIO%d_EF_INDEX", config.triggerDIO);
+		if ((err = Write(handle, name, EF_INDEX[config.triggerEdge], 
+				 failed))) return err;
+
+		snprintf(name, sizeof(name), "DIO%d_EF_ENABLE", config.triggerDIO);
+		if ((err = Write(handle, name, 1, failed))) return err;
+
+	}
+
+	// The internal crystal, or a scan every clockDivisor edges on CIO3.
+	if ((err = Write(handle, "STREAM_CLOCK_SOURCE", config.clockSource,
+			 failed))) return err;
+
+	if (config.clockSource == T7_CLOCK_EXTERNAL &&
+	    (err = Write(handle, "STREAM_EXTERNAL_CLOCK_DIVISOR", 
+			 config.clockDivisor, failed))) return err;
+
+	// The stream has one resolution and settling time; the range and
+	// negative channel are per channel, e.g. AIN72_RANGE.
+	if ((err = Write(handle, "STREAM_RESOLUTION_INDEX",
+			 config.resolutionIndex, failed))) return err;
+	if ((err = Write(handle, "STREAM_SETTLING_US", config.settlingUS,
+			 failed))) return err;
+
+	for (int channel = 0; channel < nChannels; channel++) {
+
+		double range = channel < (int)config.range.size() ?
+			config.range[channel] : 0;
+		int negative = channel < (int)config.negativeChannel.size() ?
+			config.negativeChannel[channel] : LJM_GND;
+
+		snprintf(name, sizeof(name), "%s_RANGE", channelNames[channel]);
+		if ((err = Write(handle, name, range, failed))) return err;
+
+		snprintf(name, sizeof(name), "%s_NEGATIVE_CH",
+			 channelNames[channel]);
+		if ((err = Write(handle, name, negative, failed))) return err;
+
+	}
+
+	return LJME_NOERROR;
+}
+
+/*-- Stream source -------------------------------------------------*/
+
+int LJMStreamSource::Start(int scansPerRead, int nAddresses,
+			   const int *addresses, double *scanRate)
+{
+	fWaiting = fTriggered;
+	LJM_WriteLibraryConfigS(LJM_STREAM_SCANS_RETURN, fWaiting ?
+				LJM_STREAM_SCANS_RETURN_ALL_OR_NONE :
+				LJM_STREAM_SCANS_RETURN_ALL);
+
+	return LJM_eStreamStart(fHandle, scansPerRead, nAddresses, addresses,
+				scanRate);
+}
+
+int LJMStreamSource::Read(double *data, int *deviceScanBacklog,
+			  int *LJMScanBacklog)
+{
+	int err = LJM_eStreamRead(fHandle, data, deviceScanBacklog, 
+				  LJMScanBacklog);
+
+	if (!fWaiting) return err;
+	if (err == LJME_NO_SCANS_RETURNED) return LJ_STREAM_WAITING;
+
+	// Once the stream has been triggered, reads wait for the next block
+	// again, so that a block isn't left in LJM every time a read comes
+	// a little early.
+	if (err == LJME_NOERROR) {
+
+		fWaiting = false;
+		LJM_WriteLibraryConfigS(LJM_STREAM_SCANS_RETURN, 
+					LJM_STREAM_SCANS_RETURN_ALL);
+
+	}
+
+	return err;
+}
+
+int LJMStreamSource::Stop()
+{
+	return LJM_eStreamStop(fHandle);
+}
@@ -0,0 +1,82 @@
+/********************************************************************\
+ Labjack device access
+
+ The parts of the readout that talk to the T7 through LJM, shared by the
+ feLabjack02 frontend and the Python LabJackT7 class (through the
+ _ljcore extension, see src/ljCore.cxx), so that an interactive read is
+ configured and streamed exactly as production is:
+
+   * the wiring of the fluxgate inputs to the MUX80 AIN channels;
+   * writing the stream configuration (ljStreamConfig.h) to the device,
+     including the stream trigger and the external clock;
+   * LJMStreamSource, the stream source for a device handle.
+
+ A triggered stream only starts at the trigger edge, which may be long
+ after it is enabled. Until then its reads don't wait for scans (LJM's
+ LJM_STREAM_SCANS_RETURN_ALL_OR_NONE) but return LJ_STREAM_WAITING, so
+ the frontend isn't held up; from the first block on they wait as usual.
+
+ The handle comes from LJM_Open (or ljm.openS in Python, which uses the
+ same library, so the handles are the same).
+\********************************************************************/
+
+#ifndef LJLABJACK_H
+#define LJLABJACK_H
+
+#include <string>
+
+#include "ljStreamConfig.h"
+#include "ljStreamSource.h"
+
+// Number of fluxgate inputs on the DAQ box, each with an x, y and z
+// channel.
+#define LJ_FLUXGATE_INPUTS	10
+
+// The AIN channels of the inputs, x, y, z of input 1, then of input 2,
+// ... (LJ_FLUXGATE_INPUTS * 3 names).
+extern const char *const LJ_FLUXGATE_CHANNELS[];
+
+// The digital input streamed with the analog channels: the states of
+// FIO0-7 (bits 0-7) and EIO0-7 (bits 8-15), so bit n is DIOn.
+#define LJ_DIGITAL_STATE	"FIO_EIO_STATE"
+#define LJ_DIGITAL_LINES	16
+
+// Writes the trigger, clock, resolution and settling time of the stream,
+// and the range and negative channel of each of the nChannels analog
+// channels. Returns the first LJM error, with the register it was written
+// to in failed, or 0.
+int LJWriteStreamConfig(int handle, const LJStreamConfig &config,
+			const char *const *channelNames, int nChannels,
+			std::string &failed);
+
+// The stream of the Labjack with the given handle.
+class LJMStreamSource : public LJStreamSource {
+
+public:
+
+	LJMStreamSource() : fHandle(0), fTriggered(false), fWaiting(false) {}
+	explicit LJMStreamSource(int handle)
+		: fHandle(handle), fTriggered(false), fWaiting(false) {}
+
+	void SetHandle(int handle) { fHandle = handle; }
+	int Handle() const { return fHandle; }
+
+	// Whether the stream is triggered (LJStreamConfig::triggerDIO), and
+	// so returns LJ_STREAM_WAITING until the trigger. Takes effect at the
+	// next Start().
+	void SetTriggered(bool triggered) { fTriggered = triggered; }
+
+	virtual int Start(int scansPerRead, int nAddresses, const int *addresses,
+			  double *scanRate);
+	virtual int Read(double *data, int *deviceScanBacklog,
+			 int *LJMScanBacklog);
+	virtual int Stop();
+
+private:
+
+	int fHandle;
+	bool fTriggered;
+	bool fWaiting;
+};
+
+#endif
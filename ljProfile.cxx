@@ -0,0 +1,401 @@
+/********************************************************************\
+ Labjack profiling
+\********************************************************************/
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "ljProfile.h"
+
+struct LJProfileEvent {
+	int stage;
+	uint64_t start;
+	uint64_t end;
+};
+
+// The buffers of one thread. Only the thread itself writes them, so the
+// counters are plain loads and stores; they are atomic only so that
+// Collect() can read them meanwhile.
+struct LJProfileBuffer {
+
+	LJProfileBuffer(int id, int traceEvents)
+		: id(id), trace(traceEvents), traceWrite(0)
+	{
+		snprintf(name, sizeof(name), "thread %d", id);
+
+		for (int s = 0; s < LJ_PROFILE_MAX_STAGES; s++) {
+
+			count[s] = 0;
+			sum[s] = 0;
+			for (int b = 0; b < LJ_PROFILE_BUCKETS; b++)
+				histogram[s][b] = 0;
+
+		}
+	}
+
+	int id;
+	char name[64];
+
+	std::atomic<uint64_t> count[LJ_PROFILE_MAX_STAGES];
+	std::atomic<uint64_t> sum[LJ_PROFILE_MAX_STAGES];
+	std::atomic<uint64_t> histogram[LJ_PROFILE_MAX_STAGES][LJ_PROFILE_BUCKETS];
+
+	std::vector<LJProfileEvent> trace;
+	std::atomic<uint64_t> traceWrite;
+};
+
+// Buffers are never freed, so that the events of threads which have
+// finished are still collected.
+static std::mutex gMutex;
+static std::vector<LJProfileBuffer *> gThreads;
+static const char *gStages[LJ_PROFILE_MAX_STAGES];
+static std::atomic<int> gNumStages(0);
+static int gTraceEvents = 0;
+
+// The ticks and monotonic time when the profiler was first used, for
+// converting ticks to seconds.
+static uint64_t gStartTicks = 0;
+static double gStartTime = 0;
+
+static thread_local LJProfileBuffer *tThread = NULL;
+
+static double Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Called with gMutex held.
+static void Start()
+{
+	if (gStartTime > 0) return;
+
+	gStartTicks = LJProfileTicks();
+	gStartTime = Now();
+}
+
+static double TicksPerSecond()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	{
+		std::lock_guard<std::mutex> lock(gMutex);
+		Start();
+	}
+
+	// The TSC is measured against the monotonic clock since the start,
+	// which is needed to be long enough for a precise rate.
+	double elapsed;
+	while ((elapsed = Now() - gStartTime) < 0.05) usleep(10000);
+
+	return (LJProfileTicks() - gStartTicks) / elapsed;
+#else
+	return 1e9;
+#endif
+}
+
+static LJProfileBuffer *Thread()
+{
+	if (tThread) return tThread;
+
+	std::lock_guard<std::mutex> lock(gMutex);
+	Start();
+
+	tThread = new LJProfileBuffer(gThreads.size(), gTraceEvents);
+	gThreads.push_back(tThread);
+
+	return tThread;
+}
+
+static int Bucket(uint64_t ticks)
+{
+	if (ticks < 8) return ticks;
+
+	int e = 63 - __builtin_clzll(ticks);
+	return 8 + (e - 3) * 8 + ((ticks >> (e - 3)) & 7);
+}
+
+static void BucketRange(int bucket, double &low, double &width)
+{
+	if (bucket < 8) {
+
+		low = bucket;
+		width = 1;
+		return;
+
+	}
+
+	int e = (bucket - 8) / 8 + 3;
+	int sub = (bucket - 8) % 8;
+
+	low = (double)((uint64_t)(8 + sub) << (e - 3));
+	width = (double)(1ull << (e - 3));
+}
+
+// Writes s as a JSON string.
+static void WriteString(FILE *f, const char *s)
+{
+	fputc('"', f);
+
+	for (; *s; s++) {
+
+		if (*s == '"' || *s == '\\') fputc('\\', f);
+		if ((unsigned char)*s >= 0x20) fputc(*s, f);
+
+	}
+
+	fputc('"', f);
+}
+
+/*-- Snapshot ------------------------------------------------------*/
+
+LJProfileSnapshot::LJProfileSnapshot()
+	: fTicksPerSecond(1)
+{
+}
+
+double LJProfileSnapshot::Mean(int stage) const
+{
+	if (fCount[stage] == 0) return 0;
+
+	return fSum[stage] / (double)fCount[stage] / fTicksPerSecond;
+}
+
+double LJProfileSnapshot::Percentile(int stage, double q) const
+{
+	const std::vector<uint64_t> &h = fHistogram[stage];
+
+	// The count is taken from the histogram itself: a snapshot taken while
+	// threads record can have fCount a little out of step with it.
+	uint64_t count = 0;
+	for (int b = 0; b < LJ_PROFILE_BUCKETS; b++) count += h[b];
+	if (count == 0) return 0;
+
+	if (q < 0) q = 0;
+	if (q > 1) q = 1;
+
+	// The rank is interpolated within the bucket it falls into.
+	double rank = q * count;
+	uint64_t below = 0;
+
+	for (int b = 0; b < LJ_PROFILE_BUCKETS; b++) {
+
+		if (h[b] == 0) continue;
+
+		if (below + h[b] >= rank) {
+
+			double low, width;
+			BucketRange(b, low, width);
+
+			double fraction = (rank - below) / h[b];
+			return (low + fraction * width) / fTicksPerSecond;
+
+		}
+
+		below += h[b];
+
+	}
+
+	return 0;
+}
+
+LJProfileSnapshot LJProfileSnapshot::Since(const LJProfileSnapshot &prev) const
+{
+	LJProfileSnapshot since = *this;
+
+	// Stages are only ever added, so prev has a prefix of ours.
+	for (int s = 0; s < prev.Stages() && s < Stages(); s++) {
+
+		since.fCount[s] -= prev.fCount[s];
+		since.fSum[s] -= prev.fSum[s];
+		for (int b = 0; b < LJ_PROFILE_BUCKETS; b++)
+			since.fHistogram[s][b] -= prev.fHistogram[s][b];
+
+	}
+
+	return since;
+}
+
+void LJProfileSnapshot::Print(FILE *f) const
+{
+	fprintf(f, "%-20s %10s %10s %10s %10s %10s %10s\n", "Stage", "Count",
+		"Mean (us)", "P50 (us)", "P90 (us)", "P99 (us)", "Max (us)");
+
+	for (int s = 0; s < Stages(); s++) {
+
+		if (fCount[s] == 0) continue;
+
+		fprintf(f, "%-20s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+			Name(s), (unsigned long long)fCount[s], 1e6 * Mean(s),
+			1e6 * Percentile(s, 0.5), 1e6 * Percentile(s, 0.9),
+			1e6 * Percentile(s, 0.99), 1e6 * Percentile(s, 1));
+
+	}
+}
+
+/*-- Profiler ------------------------------------------------------*/
+
+bool LJProfiler::Enabled()
+{
+#ifdef LJ_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+int LJProfiler::Stage(const char *name)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+
+	int n = gNumStages.load();
+	for (int s = 0; s < n; s++)
+		if (strcmp(gStages[s], name) == 0) return s;
+
+	if (n == LJ_PROFILE_MAX_STAGES) return -1;
+
+	gStages[n] = name;
+	gNumStages.store(n + 1);
+
+	return n;
+}
+
+void LJProfiler::NameThread(const char *name)
+{
+	LJProfileBuffer *thread = Thread();
+
+	std::lock_guard<std::mutex> lock(gMutex);
+	snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+void LJProfiler::SetTraceEvents(int eventsPerThread)
+{
+	std::lock_guard<std::mutex> lock(gMutex);
+	gTraceEvents = eventsPerThread > 0 ? eventsPerThread : 0;
+}
+
+void LJProfiler::Record(int stage, uint64_t start, uint64_t end)
+{
+	if (stage < 0) return;
+
+	LJProfileBuffer *thread = Thread();
+	uint64_t ticks = end > start ? end - start : 0;
+
+	std::atomic<uint64_t> &count = thread->count[stage];
+	std::atomic<uint64_t> &sum = thread->sum[stage];
+	std::atomic<uint64_t> &bucket = thread->histogram[stage][Bucket(ticks)];
+
+	count.store(count.load(std::memory_order_relaxed) + 1,
+		    std::memory_order_relaxed);
+	sum.store(sum.load(std::memory_order_relaxed) + ticks,
+		  std::memory_order_relaxed);
+	bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+		     std::memory_order_relaxed);
+
+	if (thread->trace.empty()) return;
+
+	uint64_t w = thread->traceWrite.load(std::memory_order_relaxed);
+	LJProfileEvent &event = thread->trace[w % thread->trace.size()];
+	event.stage = stage;
+	event.start = start;
+	event.end = end;
+	thread->traceWrite.store(w + 1, std::memory_order_release);
+}
+
+LJProfileSnapshot LJProfiler::Collect()
+{
+	LJProfileSnapshot snapshot;
+	snapshot.fTicksPerSecond = TicksPerSecond();
+
+	std::lock_guard<std::mutex> lock(gMutex);
+
+	int n = gNumStages.load();
+	for (int s = 0; s < n; s++) snapshot.fNames.push_back(gStages[s]);
+
+	snapshot.fCount.assign(n, 0);
+	snapshot.fSum.assign(n, 0);
+	snapshot.fHistogram.assign(n, std::vector<uint64_t>(LJ_PROFILE_BUCKETS));
+
+	for (size_t t = 0; t < gThreads.size(); t++) {
+
+		LJProfileBuffer *thread = gThreads[t];
+
+		for (int s = 0; s < n; s++) {
+
+			snapshot.fCount[s] += thread->count[s].load(std::memory_order_relaxed);
+			snapshot.fSum[s] += thread->sum[s].load(std::memory_order_relaxed);
+
+			for (int b = 0; b < LJ_PROFILE_BUCKETS; b++)
+				snapshot.fHistogram[s][b] +=
+					thread->histogram[s][b].load(std::memory_order_relaxed);
+
+		}
+
+	}
+
+	return snapshot;
+}
+
+/*-- Trace ---------------------------------------------------------*/
+
+bool LJProfiler::WriteTrace(const char *path)
+{
+	double ticksPerSecond = TicksPerSecond();
+
+	FILE *f = fopen(path, "w");
+	if (!f) return false;
+
+	std::lock_guard<std::mutex> lock(gMutex);
+
+	int pid = getpid();
+	bool first = true;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	for (size_t t = 0; t < gThreads.size(); t++) {
+
+		LJProfileBuffer *thread = gThreads[t];
+
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+			"\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", pid,
+			thread->id);
+		WriteString(f, thread->name);
+		fprintf(f, "}}");
+		first = false;
+
+		if (thread->trace.empty()) continue;
+
+		uint64_t size = thread->trace.size();
+		uint64_t w = thread->traceWrite.load(std::memory_order_acquire);
+		uint64_t begin = w > size ? w - size : 0;
+
+		for (uint64_t i = begin; i < w; i++) {
+
+			const LJProfileEvent &event = thread->trace[i % size];
+			if (event.stage < 0 || event.stage >= gNumStages.load()) continue;
+
+			// In us since the profiler started.
+			double ts = ((double)event.start - (double)gStartTicks) *
+				    1e6 / ticksPerSecond;
+			double dur = ((double)event.end - (double)event.start) *
+				     1e6 / ticksPerSecond;
+
+			fprintf(f, ",\n{\"name\":");
+			WriteString(f, gStages[event.stage]);
+			fprintf(f, ",\"cat\":\"labjack\",\"ph\":\"X\",\"pid\":%d,"
+				"\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", pid, thread->id,
+				ts, dur);
+
+		}
+
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	return true;
+}
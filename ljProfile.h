@@ -0,0 +1,163 @@
+/********************************************************************\
+ Labjack profiling
+
+ Per-stage timers for the hot paths of the frontend and the analyzer, to
+ see where the time of an event goes (waiting for the stream, the
+ statistics, printing, banking, ...). A stage is timed by putting
+
+   LJ_PROFILE_SCOPE("stats");
+
+ at the start of a block: the time from there to the end of the block is
+ recorded under that name. Scopes can be nested, and the same name can
+ be used in more than one place.
+
+ The timers are only compiled in if LJ_PROFILE is defined ("make
+ PROFILE=1"). Otherwise LJ_PROFILE_SCOPE and LJ_PROFILE_THREAD expand to
+ nothing, and the rest of the interface is there but never has anything
+ to report, so the hot paths cost exactly what they did before.
+
+ The time is read from the TSC on x86 and from the monotonic clock
+ elsewhere. Every thread records into buffers of its own, without locks:
+
+   * a histogram per stage with 8 buckets per factor of 2, from which the
+     percentiles are taken (to within 1/8 of their value);
+   * optionally, a ring of the latest trace events (stage, start and
+     duration), which WriteTrace() writes in the Chrome trace format, to
+     be opened in chrome://tracing or https://ui.perfetto.dev.
+
+ Collect() adds up the histograms of all threads into a snapshot, and
+ Since() gives the timings between two snapshots. Collect() and
+ WriteTrace() can be called from any thread while the others record;
+ a trace event being overwritten while it's written out can come out
+ garbled, which only happens if the ring wraps around during the dump.
+\********************************************************************/
+
+#ifndef LJPROFILE_H
+#define LJPROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// The most stages there can be; further names are not recorded.
+#define LJ_PROFILE_MAX_STAGES	32
+
+// Histogram buckets: 8 for 0-7 ticks, then 8 per factor of 2.
+#define LJ_PROFILE_BUCKETS	496
+
+#ifdef LJ_PROFILE
+
+#define LJ_PROFILE_CAT2(a, b)	a##b
+#define LJ_PROFILE_CAT(a, b)	LJ_PROFILE_CAT2(a, b)
+
+#define LJ_PROFILE_SCOPE(name) \
+	static const int LJ_PROFILE_CAT(ljProfileStage, __LINE__) = \
+		LJProfiler::Stage(name); \
+	LJProfileScope LJ_PROFILE_CAT(ljProfileScope, __LINE__)( \
+		LJ_PROFILE_CAT(ljProfileStage, __LINE__))
+
+#define LJ_PROFILE_THREAD(name)	LJProfiler::NameThread(name)
+
+#else
+
+#define LJ_PROFILE_SCOPE(name)	do { } while (0)
+#define LJ_PROFILE_THREAD(name)	do { } while (0)
+
+#endif
+
+inline uint64_t LJProfileTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+class LJProfileSnapshot {
+
+public:
+
+	LJProfileSnapshot();
+
+	int Stages() const { return fNames.size(); }
+	const char *Name(int stage) const { return fNames[stage].c_str(); }
+
+	// The number of times the stage was timed, and its mean time and
+	// percentile q (0 to 1) in s. The maximum is percentile 1.
+	uint64_t Count(int stage) const { return fCount[stage]; }
+	double Mean(int stage) const;
+	double Percentile(int stage, double q) const;
+
+	// The timings recorded after prev was collected.
+	LJProfileSnapshot Since(const LJProfileSnapshot &prev) const;
+
+	// Prints a table of the stages timed at least once.
+	void Print(FILE *f) const;
+
+private:
+
+	friend class LJProfiler;
+
+	double fTicksPerSecond;
+
+	std::vector<std::string> fNames;
+	std::vector<uint64_t> fCount;
+	std::vector<uint64_t> fSum;
+	std::vector<std::vector<uint64_t> > fHistogram;
+};
+
+class LJProfiler {
+
+public:
+
+	// Whether the timers are compiled in.
+	static bool Enabled();
+
+	// Returns the id of the stage called name, adding it if it's new, or
+	// -1 if there are too many stages already. name must stay valid.
+	static int Stage(const char *name);
+
+	// Names the calling thread in the trace.
+	static void NameThread(const char *name);
+
+	// Keeps the latest events of every thread for WriteTrace(), or none
+	// for 0. Only threads which start recording afterwards are traced, so
+	// this should be set before any timing is done.
+	static void SetTraceEvents(int eventsPerThread);
+
+	static void Record(int stage, uint64_t start, uint64_t end);
+
+	static LJProfileSnapshot Collect();
+
+	// Writes the kept events to path as Chrome trace JSON. Returns false
+	// if the file can't be written.
+	static bool WriteTrace(const char *path);
+};
+
+// Records the time from its construction to its destruction.
+class LJProfileScope {
+
+public:
+
+	explicit LJProfileScope(int stage)
+		: fStage(stage), fStart(LJProfileTicks()) {}
+
+	~LJProfileScope() { LJProfiler::Record(fStage, fStart, LJProfileTicks()); }
+
+private:
+
+	int fStage;
+	uint64_t fStart;
+};
+
+#endif
@@ -0,0 +1,87 @@
+/********************************************************************\
+ Labjack scan rate control
+\********************************************************************/
+
+#include <stddef.h>
+
+#include "ljRateControl.h"
+
+LJRateControlConfig::LJRateControlConfig()
+	: minRate(1), maxRate(1), stepDown(0.5), stepUp(1.25), maxLatency(2),
+	  maxDeviceBacklog(0), recoverySeconds(60), settleSeconds(5)
+{
+}
+
+LJRateController::LJRateController()
+	: fRate(0), fLatency(0), fLastChange(0), fLastOverload(0), fReason("")
+{
+}
+
+/*-- Configure -----------------------------------------------------*/
+
+void LJRateController::Configure(const LJRateControlConfig &config)
+{
+	fConfig = config;
+
+	if (fConfig.minRate > fConfig.maxRate) fConfig.minRate = fConfig.maxRate;
+	if (fConfig.stepDown <= 0 || fConfig.stepDown >= 1) fConfig.stepDown = 0.5;
+	if (fConfig.stepUp <= 1) fConfig.stepUp = 1.25;
+}
+
+void LJRateController::Reset(double rate, double now)
+{
+	fRate = rate;
+	fLatency = 0;
+	fLastChange = now;
+	fLastOverload = now;
+	fReason = "";
+}
+
+/*-- Update --------------------------------------------------------*/
+
+double LJRateController::Update(double now, int deviceBacklog, int LJMBacklog,
+				int skippedScans)
+{
+	if (fRate <= 0) return fRate;
+
+	fLatency = (deviceBacklog + LJMBacklog) / fRate;
+
+	const char *overload = NULL;
+	if (skippedScans > 0)
+		overload = "scans were skipped";
+	else if (fConfig.maxDeviceBacklog > 0 &&
+		 deviceBacklog > fConfig.maxDeviceBacklog)
+		overload = "the device backlog is too high";
+	else if (fConfig.maxLatency > 0 && fLatency > fConfig.maxLatency)
+		overload = "the read latency is too high";
+
+	if (overload) fLastOverload = now;
+
+	// The backlogs are still settling after the last change.
+	if (now - fLastChange < fConfig.settleSeconds) return fRate;
+
+	if (overload) {
+
+		double rate = fRate * fConfig.stepDown;
+		if (rate < fConfig.minRate) rate = fConfig.minRate;
+		if (rate >= fRate) return fRate;
+
+		fReason = overload;
+		return rate;
+
+	}
+
+	if (fRate < fConfig.maxRate &&
+	    now - fLastOverload >= fConfig.recoverySeconds &&
+	    (fConfig.maxLatency <= 0 || fLatency < fConfig.maxLatency / 4)) {
+
+		double rate = fRate * fConfig.stepUp;
+		if (rate > fConfig.maxRate) rate = fConfig.maxRate;
+
+		fReason = "there is headroom again";
+		return rate;
+
+	}
+
+	return fRate;
+}
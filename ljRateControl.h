@@ -0,0 +1,72 @@
+/********************************************************************\
+ Labjack scan rate control
+
+ Adapts the scan rate to what the host and the network can take. After
+ every read the controller is given the device and LJM backlogs and the
+ number of skipped scans, and decides whether the stream should run at
+ a different rate:
+
+   * it is overloaded if scans were skipped, if the device backlog is
+     above maxDeviceBacklog (the device buffer is about to overflow), or
+     if the latency, the time the newest scan waits before it is read
+     ((device + LJM backlog) / rate), is above maxLatency. The rate is
+     then stepped down by stepDown, to no lower than minRate.
+   * once it has not been overloaded for recoverySeconds and the latency
+     is below a quarter of maxLatency, the rate is stepped up by stepUp,
+     to no higher than maxRate.
+
+ After a change nothing is decided for settleSeconds, while the stream
+ restarts and the backlogs settle.
+\********************************************************************/
+
+#ifndef LJRATECONTROL_H
+#define LJRATECONTROL_H
+
+struct LJRateControlConfig {
+
+	LJRateControlConfig();
+
+	double minRate;
+	double maxRate;
+	double stepDown;
+	double stepUp;
+	double maxLatency;
+	int maxDeviceBacklog;
+	double recoverySeconds;
+	double settleSeconds;
+};
+
+class LJRateController {
+
+public:
+
+	LJRateController();
+
+	void Configure(const LJRateControlConfig &config);
+	const LJRateControlConfig &Config() const { return fConfig; }
+
+	// Starts over at rate, e.g. after the stream has been (re)started. now
+	// is the unix time.
+	void Reset(double rate, double now);
+
+	// Takes the result of a read, and returns the rate the stream should
+	// run at. If it differs from Rate(), Reason() says why.
+	double Update(double now, int deviceBacklog, int LJMBacklog,
+		      int skippedScans);
+
+	double Rate() const { return fRate; }
+	double Latency() const { return fLatency; }
+	const char *Reason() const { return fReason; }
+
+private:
+
+	LJRateControlConfig fConfig;
+
+	double fRate;
+	double fLatency;
+	double fLastChange;
+	double fLastOverload;
+	const char *fReason;
+};
+
+#endif
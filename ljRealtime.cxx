@@ -0,0 +1,84 @@
+/********************************************************************\
+ Labjack realtime settings
+\********************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ljRealtime.h"
+
+static void AddError(std::string &error, const char *what, int err)
+{
+	char line[256];
+	snprintf(line, sizeof(line), "%s: %s", what, strerror(err));
+
+	if (!error.empty()) error += "; ";
+	error += line;
+}
+
+bool LJCheckRealtime(const LJRealtimeConfig &config, std::string &error)
+{
+	char line[256];
+	long nCPUs = sysconf(_SC_NPROCESSORS_CONF);
+
+	if (config.cpu >= CPU_SETSIZE || (nCPUs > 0 && config.cpu >= nCPUs)) {
+
+		snprintf(line, sizeof(line), "CPU %d doesn't exist, this host has "
+			 "%ld", config.cpu, nCPUs);
+		error = line;
+		return false;
+
+	}
+
+	int maxPriority = sched_get_priority_max(SCHED_FIFO);
+
+	if (config.priority < 0 || config.priority > maxPriority) {
+
+		snprintf(line, sizeof(line), "Priority %d is outside 0 to %d",
+			 config.priority, maxPriority);
+		error = line;
+		return false;
+
+	}
+
+	return true;
+}
+
+bool LJApplyRealtime(const LJRealtimeConfig &config, std::string &error)
+{
+	error.clear();
+
+	if (config.cpu >= 0) {
+
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(config.cpu, &cpus);
+
+		int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		if (err) AddError(error, "pinning to a CPU", err);
+
+	}
+
+	if (config.priority > 0) {
+
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = config.priority;
+
+		int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (err) AddError(error, "setting SCHED_FIFO", err);
+
+	}
+
+	// MCL_FUTURE also covers the buffers that are only allocated later,
+	// e.g. at the start of a run.
+	if (config.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+		AddError(error, "locking memory", errno);
+
+	return error.empty();
+}
@@ -0,0 +1,46 @@
+/********************************************************************\
+ Labjack realtime settings
+
+ On a busy DAQ host the frontend competes with everything else for the
+ CPU, and a read that is scheduled late shows up as a spike in the
+ backlog. To keep the reads on time, the acquisition thread (the MIDAS
+ frontend thread, which calls the readout routines) can be
+
+   * pinned to one CPU, so that it isn't migrated and keeps its caches;
+   * run under SCHED_FIFO, so that ordinary processes can't preempt it;
+   * kept in RAM with mlockall(), so that a page fault never stalls it.
+
+ All of them need privileges: CAP_SYS_NICE (or an RLIMIT_RTPRIO) for the
+ priority and CAP_IPC_LOCK (or a large enough RLIMIT_MEMLOCK, e.g.
+ "ulimit -l unlimited") for the locking. What can't be done is reported,
+ and the rest is still applied.
+
+ Threads inherit the CPU and priority of the thread creating them, so
+ the settings should be applied after the helper threads have been
+ started, or they end up sharing the CPU at the same priority.
+\********************************************************************/
+
+#ifndef LJREALTIME_H
+#define LJREALTIME_H
+
+#include <string>
+
+struct LJRealtimeConfig {
+
+	int cpu;           // CPU to pin the calling thread to, -1 for any
+	int priority;      // SCHED_FIFO priority (1-99), 0 to leave it alone
+	bool lockMemory;   // lock current and future pages into RAM
+
+	LJRealtimeConfig() : cpu(-1), priority(0), lockMemory(false) {}
+};
+
+// Checks the config against this host. Returns false, with the reason in
+// error, if the CPU or priority is out of range.
+bool LJCheckRealtime(const LJRealtimeConfig &config, std::string &error);
+
+// Applies the config to the calling thread, and the memory locking to the
+// whole process. Returns false, with what failed in error, if any of it
+// couldn't be applied.
+bool LJApplyRealtime(const LJRealtimeConfig &config, std::string &error);
+
+#endif
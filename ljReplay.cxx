@@ -0,0 +1,326 @@
+/********************************************************************\
+ Labjack replay
+\********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ljReplay.h"
+#include "ljTap.h"
+
+static double Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+LJReplay::LJReplay()
+	: fFile(NULL), fFormat(FORMAT_CSV), fDataStart(0), fChannels(0),
+	  fScanRate(0), fSpeed(1), fLoop(false), fScansPerRead(0), fScans(0),
+	  fStartTime(0), fFrameScans(0), fFrameScan(0), fLine(NULL),
+	  fLineSize(0)
+{
+}
+
+LJReplay::~LJReplay()
+{
+	Close();
+	free(fLine);
+}
+
+/*-- Open ----------------------------------------------------------*/
+
+bool LJReplay::Open(const char *path, std::string &error)
+{
+	Close();
+
+	fFile = fopen(path, "rb");
+	if (!fFile) {
+
+		error = std::string("cannot open ") + path;
+		return false;
+
+	}
+
+	// Archives start with a tap frame, CSV files with text.
+	uint32_t magic = 0;
+	if (fread(&magic, sizeof(magic), 1, fFile) != 1) magic = 0;
+	fseek(fFile, 0, SEEK_SET);
+
+	fChannels = 0;
+	fScanRate = 0;
+
+	bool ok;
+	if (magic == LJ_TAP_FRAME_MAGIC) {
+
+		fFormat = FORMAT_ARCHIVE;
+		ok = OpenArchive(error);
+
+	}
+
+	else {
+
+		fFormat = FORMAT_CSV;
+		ok = OpenCSV(error);
+
+	}
+
+	if (ok && (fChannels <= 0 || fScanRate <= 0)) {
+
+		error = "no channels or scan rate found";
+		ok = false;
+
+	}
+
+	if (!ok) {
+
+		error = std::string(path) + ": " + error;
+		Close();
+		return false;
+
+	}
+
+	Rewind();
+	return true;
+}
+
+bool LJReplay::OpenCSV(std::string &error)
+{
+	// The header comments are read for the scan rate, up to the column
+	// names, which give the number of channels.
+	while (getline(&fLine, &fLineSize, fFile) > 0) {
+
+		const char *rate = strstr(fLine, "Scan rate of last read:");
+
+		if (fLine[0] == '#' && rate) {
+
+			fScanRate = atof(rate + strlen("Scan rate of last read:"));
+
+		}
+
+		else if (strncmp(fLine, "dt (s)", 6) == 0) {
+
+			for (const char *p = fLine; *p; p++)
+				if (*p == ',') fChannels++;
+
+			fDataStart = ftell(fFile);
+			break;
+
+		}
+
+	}
+
+	if (fChannels == 0) {
+
+		error = "no \"dt (s)\" column header found";
+		return false;
+
+	}
+
+	if (fScanRate > 0) return true;
+
+	// Otherwise the rate is worked out from the first two time offsets.
+	double dt[2];
+	int n = 0;
+
+	while (n < 2 && getline(&fLine, &fLineSize, fFile) > 0) {
+
+		char *end;
+		double value = strtod(fLine, &end);
+		if (end != fLine) dt[n++] = value;
+
+	}
+
+	if (n == 2 && dt[1] > dt[0]) fScanRate = 1 / (dt[1] - dt[0]);
+
+	return true;
+}
+
+bool LJReplay::OpenArchive(std::string &error)
+{
+	// Frames are read up to the first data frame.
+	LJTapFrameHeader header;
+
+	while (fread(&header, sizeof(header), 1, fFile) == 1) {
+
+		if (header.magic != LJ_TAP_FRAME_MAGIC || 
+		    header.size < sizeof(header)) {
+
+			error = "corrupt tap frame";
+			return false;
+
+		}
+
+		if (header.type == LJ_TAP_DATA) {
+
+			fChannels = header.nChannels;
+			fScanRate = header.scanRate;
+			fDataStart = 0;
+			return true;
+
+		}
+
+		fseek(fFile, header.size - sizeof(header), SEEK_CUR);
+
+	}
+
+	error = "no data frames found";
+	return false;
+}
+
+void LJReplay::Close()
+{
+	if (fFile) fclose(fFile);
+	fFile = NULL;
+}
+
+void LJReplay::Rewind()
+{
+	fseek(fFile, fDataStart, SEEK_SET);
+	fFrameScans = 0;
+	fFrameScan = 0;
+}
+
+/*-- Scans ---------------------------------------------------------*/
+
+bool LJReplay::NextScan(double *scan)
+{
+	if (fFormat == FORMAT_ARCHIVE) return NextArchiveScan(scan);
+	return NextCSVScan(scan);
+}
+
+bool LJReplay::NextCSVScan(double *scan)
+{
+	while (getline(&fLine, &fLineSize, fFile) > 0) {
+
+		// Files with several streams repeat the "START stream" line and
+		// the column names before each.
+		char *p = fLine;
+		char *end;
+		strtod(p, &end);
+		if (end == p) continue;
+
+		p = end;
+
+		for (int i = 0; i < fChannels; i++) {
+
+			if (*p == ',') p++;
+			scan[i] = strtod(p, &end);
+			// A missing value is filled in like a skipped scan.
+			if (end == p) scan[i] = LJM_DUMMY_VALUE;
+			p = end;
+
+		}
+
+		return true;
+
+	}
+
+	return false;
+}
+
+bool LJReplay::NextArchiveScan(double *scan)
+{
+	while (fFrameScan >= fFrameScans) {
+
+		LJTapFrameHeader header;
+		if (fread(&header, sizeof(header), 1, fFile) != 1) return false;
+		if (header.magic != LJ_TAP_FRAME_MAGIC ||
+		    header.size < sizeof(header)) return false;
+
+		size_t payload = header.size - sizeof(header);
+
+		if (header.type != LJ_TAP_DATA) {
+
+			fseek(fFile, payload, SEEK_CUR);
+			continue;
+
+		}
+
+		// The channels can't change in the middle of a replay.
+		if ((int)header.nChannels != fChannels) return false;
+
+		size_t n = (size_t)header.nScans * header.nChannels;
+		if (n * sizeof(double) > payload) return false;
+
+		fFrame.resize(n);
+		if (n > 0 && fread(&fFrame[0], sizeof(double), n, fFile) != n)
+			return false;
+		fseek(fFile, payload - n * sizeof(double), SEEK_CUR);
+
+		fFrameScans = header.nScans;
+		fFrameScan = 0;
+
+	}
+
+	memcpy(scan, &fFrame[(size_t)fFrameScan * fChannels], 
+	       sizeof(double) * fChannels);
+	fFrameScan++;
+
+	return true;
+}
+
+/*-- Stream --------------------------------------------------------*/
+
+int LJReplay::Start(int scansPerRead, int nAddresses, const int *,
+		    double *scanRate)
+{
+	// A recording with other channels can't be played back at all.
+	if (!fFile || nAddresses != fChannels) return LJ_STREAM_END;
+
+	fScansPerRead = scansPerRead;
+	*scanRate = fScanRate;
+
+	// Every start, e.g. of every run, plays the recording from the top.
+	Rewind();
+	fScans = 0;
+	fStartTime = Now();
+
+	return 0;
+}
+
+int LJReplay::Read(double *data, int *deviceScanBacklog, int *LJMScanBacklog)
+{
+	*deviceScanBacklog = 0;
+	*LJMScanBacklog = 0;
+
+	for (int i = 0; i < fScansPerRead; i++) {
+
+		double *scan = data + (size_t)i * fChannels;
+		if (NextScan(scan)) continue;
+
+		if (!fLoop) return LJ_STREAM_END;
+
+		Rewind();
+		if (!NextScan(scan)) return LJ_STREAM_END;
+
+	}
+
+	fScans += fScansPerRead;
+
+	if (fSpeed <= 0) return 0;
+
+	// The block is delivered when it would have been complete at the 
+	// playback speed. If that has already passed, the frontend is behind.
+	double rate = fScanRate * fSpeed;
+	double due = fStartTime + fScans / rate;
+	double now = Now();
+
+	if (due > now) usleep((useconds_t)((due - now) * 1e6));
+	else *LJMScanBacklog = (int)((now - due) * rate);
+
+	return 0;
+}
+
+int LJReplay::Stop()
+{
+	return 0;
+}
+
+double LJReplay::Elapsed() const
+{
+	return Now() - fStartTime;
+}
@@ -0,0 +1,108 @@
+/********************************************************************\
+ Labjack replay
+
+ A stream source which plays back recorded raw scans instead of reading
+ the Labjack, so that a bad run can be put through the frontend again.
+ Two kinds of recording are read:
+
+   * CSV files written by LabJackT7.to_csv (src/LabJackT7.py), with a
+     "dt (s)" column followed by one column per channel. The scan rate is
+     taken from the "Scan rate of last read" header line, or otherwise
+     from the first two dt values.
+   * archives of data tap frames (see ljTap.h), as written by the tap's
+     archive file or recorded from its socket. The scan rate is that of
+     the first data frame.
+
+ The file is read as it is played back, so it can be larger than the
+ memory. The scans are delivered at speed times the recorded rate, or as
+ fast as the frontend reads them for a speed of 0. The backlog reported
+ as the LJM backlog is the number of scans which would have been
+ available but haven't been read yet, i.e. how far the frontend has
+ fallen behind.
+\********************************************************************/
+
+#ifndef LJREPLAY_H
+#define LJREPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "ljStreamSource.h"
+
+class LJReplay : public LJStreamSource {
+
+public:
+
+	LJReplay();
+	virtual ~LJReplay();
+
+	// Opens the recording and reads its channel count and scan rate.
+	// Returns false and fills error if it can't be read.
+	bool Open(const char *path, std::string &error);
+
+	void Close();
+
+	// Playback speed as a multiple of the recorded rate, 0 for as fast as
+	// possible. If loop is set, playback starts over at the end.
+	void SetSpeed(double speed) { fSpeed = speed; }
+	void SetLoop(bool loop) { fLoop = loop; }
+
+	int Channels() const { return fChannels; }
+	double ScanRate() const { return fScanRate; }
+
+	// Scans delivered since Start(), and the time that took in s.
+	uint64_t Scans() const { return fScans; }
+	double Elapsed() const;
+
+	// Starts playing back from the beginning of the recording. The number
+	// of addresses must match the number of channels in the recording,
+	// which are played back in their recorded order whatever the
+	// addresses. *scanRate is set to the recorded rate.
+	virtual int Start(int scansPerRead, int nAddresses, const int *addresses,
+			  double *scanRate);
+
+	// Returns LJ_STREAM_END at the end of the recording, unless looping.
+	virtual int Read(double *data, int *deviceScanBacklog,
+			 int *LJMScanBacklog);
+
+	virtual int Stop();
+
+private:
+
+	enum { FORMAT_CSV, FORMAT_ARCHIVE };
+
+	bool OpenCSV(std::string &error);
+	bool OpenArchive(std::string &error);
+	void Rewind();
+
+	// Reads the next scan into scan. Returns false at the end of the file.
+	bool NextScan(double *scan);
+	bool NextCSVScan(double *scan);
+	bool NextArchiveScan(double *scan);
+
+	FILE *fFile;
+	int fFormat;
+	long fDataStart;
+
+	int fChannels;
+	double fScanRate;
+
+	double fSpeed;
+	bool fLoop;
+
+	int fScansPerRead;
+	uint64_t fScans;
+	double fStartTime;
+
+	// The archive frame being played back, and the next scan in it.
+	std::vector<double> fFrame;
+	int fFrameScans;
+	int fFrameScan;
+
+	char *fLine;
+	size_t fLineSize;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/********************************************************************\
+ Labjack run summary
+\********************************************************************/
+
+#include <math.h>
+
+#include "ljRunSummary.h"
+#include "ljStreamSource.h"
+
+LJRunSummary::LJRunSummary()
+	: fRunning(false), fRun(0), fChannels(0), fStart(0), fStop(0),
+	  fScans(0), fSkipped(0), fReads(0), fErrors(0), fRateChanges(0),
+	  fMaxDeviceBacklog(0), fMaxLJMBacklog(0)
+{
+}
+
+void LJRunSummary::Start(int run, int nChannels, double time)
+{
+	fRunning = true;
+	fRun = run;
+	fChannels = nChannels;
+	fStart = fStop = time;
+
+	fScans = fSkipped = fReads = fErrors = fRateChanges = 0;
+	fMaxDeviceBacklog = fMaxLJMBacklog = 0;
+
+	fSamples.assign(nChannels, 0);
+	fShift.assign(nChannels, 0);
+	fSum.assign(nChannels, 0);
+	fSum2.assign(nChannels, 0);
+	fMin.assign(nChannels, HUGE_VAL);
+	fMax.assign(nChannels, -HUGE_VAL);
+}
+
+void LJRunSummary::Stop(double time)
+{
+	if (!fRunning) return;
+
+	fRunning = false;
+	fStop = time;
+}
+
+/*-- Reads ---------------------------------------------------------*/
+
+void LJRunSummary::Add(const double *scans, int nScans, int deviceBacklog,
+		       int LJMBacklog)
+{
+	if (!fRunning) return;
+
+	fReads++;
+	fScans += nScans;
+	if (deviceBacklog > fMaxDeviceBacklog) fMaxDeviceBacklog = deviceBacklog;
+	if (LJMBacklog > fMaxLJMBacklog) fMaxLJMBacklog = LJMBacklog;
+
+	const int n = fChannels;
+	double *shift = &fShift[0], *sum = &fSum[0], *sum2 = &fSum2[0];
+	double *lo = &fMin[0], *hi = &fMax[0];
+	uint64_t *samples = &fSamples[0];
+
+	for (int i = 0; i < nScans; i++) {
+
+		const double *x = scans + (size_t)i * n;
+
+		// LJM skips whole scans.
+		if (x[0] == LJM_DUMMY_VALUE) {
+
+			fSkipped++;
+			continue;
+
+		}
+
+		for (int c = 0; c < n; c++) {
+
+			if (samples[c] == 0) shift[c] = x[c];
+
+			double d = x[c] - shift[c];
+			sum[c] += d;
+			sum2[c] += d * d;
+			if (x[c] < lo[c]) lo[c] = x[c];
+			if (x[c] > hi[c]) hi[c] = x[c];
+			samples[c]++;
+
+		}
+
+	}
+}
+
+/*-- Results -------------------------------------------------------*/
+
+double LJRunSummary::Seconds() const
+{
+	return fStop - fStart;
+}
+
+double LJRunSummary::Mean(int c) const
+{
+	if (fSamples[c] == 0) return 0;
+
+	return fShift[c] + fSum[c] / fSamples[c];
+}
+
+double LJRunSummary::Std(int c) const
+{
+	if (fSamples[c] == 0) return 0;
+
+	double m = fSum[c] / fSamples[c];
+	double var = fSum2[c] / fSamples[c] - m * m;
+
+	return var > 0 ? sqrt(var) : 0;
+}
+
+double LJRunSummary::EffectiveRate(int c) const
+{
+	double seconds = Seconds();
+
+	return seconds > 0 ? fSamples[c] / seconds : 0;
+}
+
+void LJRunSummary::Write(double *out) const
+{
+	*out++ = fRun;
+	*out++ = fStart;
+	*out++ = Seconds();
+	*out++ = fScans;
+	*out++ = fSkipped;
+	*out++ = fReads;
+	*out++ = fErrors;
+	*out++ = fRateChanges;
+	*out++ = fMaxDeviceBacklog;
+	*out++ = fMaxLJMBacklog;
+	*out++ = fChannels;
+
+	for (int c = 0; c < fChannels; c++) {
+
+		*out++ = Mean(c);
+		*out++ = Std(c);
+		*out++ = Min(c);
+		*out++ = Max(c);
+		*out++ = fSamples[c];
+		*out++ = EffectiveRate(c);
+
+	}
+}
@@ -0,0 +1,101 @@
+/********************************************************************\
+ Labjack run summary
+
+ Totals over a whole run, kept up to date read by read so that they are
+ ready the moment the run ends, for a quick look at the quality of the
+ data without going through the run file:
+
+   * the length of the run, the scans read and how many were skipped,
+     the reads, the read errors and rate changes, and the largest device
+     and LJM backlogs;
+   * for every channel, the mean, STD, minimum and maximum of all its
+     samples, the number of samples and the effective rate, which is the
+     samples over the length of the run. Below the scan rate, scans were
+     lost or the rate was lowered.
+
+ The statistics are taken over the raw scans, leaving out skipped ones
+ (-9999). The sums are taken relative to the first sample of each
+ channel, which keeps the STD precise over the many samples of a run.
+\********************************************************************/
+
+#ifndef LJRUNSUMMARY_H
+#define LJRUNSUMMARY_H
+
+#include <stdint.h>
+#include <vector>
+
+class LJRunSummary {
+
+public:
+
+	// Values written by Write() for the run, and for every channel.
+	enum { RUN_VALUES = 11, CHANNEL_VALUES = 6 };
+
+	LJRunSummary();
+
+	// Forgets the previous run and starts run at the given unix time.
+	void Start(int run, int nChannels, double time);
+
+	// Adds a read of nScans interleaved scans, with the backlogs after it.
+	void Add(const double *scans, int nScans, int deviceBacklog,
+		 int LJMBacklog);
+
+	void CountError() { if (fRunning) fErrors++; }
+	void CountRateChange() { if (fRunning) fRateChanges++; }
+
+	// Ends the run at the given unix time. Nothing is added after this.
+	void Stop(double time);
+
+	bool Running() const { return fRunning; }
+	int Run() const { return fRun; }
+	int Channels() const { return fChannels; }
+
+	// The length of the run, once it has been stopped.
+	double Seconds() const;
+	uint64_t Scans() const { return fScans; }
+	uint64_t Skipped() const { return fSkipped; }
+	uint64_t Reads() const { return fReads; }
+	uint64_t Errors() const { return fErrors; }
+	uint64_t RateChanges() const { return fRateChanges; }
+
+	// Per channel; all 0 for a channel without samples.
+	double Mean(int c) const;
+	double Std(int c) const;
+	double Min(int c) const { return fSamples[c] ? fMin[c] : 0; }
+	double Max(int c) const { return fSamples[c] ? fMax[c] : 0; }
+	uint64_t Samples(int c) const { return fSamples[c]; }
+	double EffectiveRate(int c) const;
+
+	// Writes, for the LBSM bank, the run number, start time, length (s),
+	// scans, skipped scans, reads, read errors, rate changes, largest
+	// device and LJM backlogs and number of channels, followed by the
+	// mean, STD, minimum, maximum, samples and effective rate of every
+	// channel. out needs room for Values() doubles.
+	int Values() const { return RUN_VALUES + CHANNEL_VALUES * fChannels; }
+	void Write(double *out) const;
+
+private:
+
+	bool fRunning;
+	int fRun;
+	int fChannels;
+	double fStart;
+	double fStop;
+
+	uint64_t fScans;
+	uint64_t fSkipped;
+	uint64_t fReads;
+	uint64_t fErrors;
+	uint64_t fRateChanges;
+	int fMaxDeviceBacklog;
+	int fMaxLJMBacklog;
+
+	std::vector<uint64_t> fSamples;
+	std::vector<double> fShift;
+	std::vector<double> fSum;
+	std::vector<double> fSum2;
+	std::vector<double> fMin;
+	std::vector<double> fMax;
+};
+
+#endif
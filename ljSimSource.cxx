@@ -0,0 +1,143 @@
+/********************************************************************\
+ Labjack simulation
+\********************************************************************/
+
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ljSimSource.h"
+#include "ljStreamConfig.h"
+
+// AIN registers are at addresses 0 to 2 * 254; everything above is taken
+// to be a digital state.
+static const int MAX_AIN_ADDRESS = 1000;
+
+static double Now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+LJSimSource::LJSimSource()
+	: fTriggerDIO(-1), fTriggerEdge(LJ_EDGE_RISING), fScansPerRead(0),
+	  fScanRate(1), fStartTime(0), fFirstScanTime(0), fScans(0),
+	  fRandom(12345), fGauss(0, 1)
+{
+}
+
+/*-- Cycle line ----------------------------------------------------*/
+
+double LJSimSource::SinceCycle(double t) const
+{
+	if (fConfig.cyclePeriod <= 0) return -1;
+
+	double x = t - fConfig.cyclePeriod / 2;
+	if (x < 0) return x;
+
+	return fmod(x, fConfig.cyclePeriod);
+}
+
+bool LJSimSource::Line(double t) const
+{
+	double since = SinceCycle(t);
+	return since >= 0 && since < fConfig.pulseWidth;
+}
+
+double LJSimSource::TriggerTime() const
+{
+	if (fTriggerDIO < 0) return 0;
+	if (fTriggerDIO != fConfig.cycleDIO || fConfig.cyclePeriod <= 0)
+		return -1;
+
+	// The line first rises half a period in, and falls a pulse later.
+	double rise = fConfig.cyclePeriod / 2;
+	return fTriggerEdge == LJ_EDGE_FALLING ? rise + fConfig.pulseWidth : rise;
+}
+
+/*-- Stream --------------------------------------------------------*/
+
+int LJSimSource::Start(int scansPerRead, int nAddresses, const int *addresses,
+		       double *scanRate)
+{
+	fScansPerRead = scansPerRead;
+	fScanRate = *scanRate > 0 ? *scanRate : 1;
+
+	// Every analog channel gets its own offset, and its own share of the
+	// kick, so that they can be told apart.
+	fDigital.resize(nAddresses);
+	fOffset.resize(nAddresses);
+	fKickGain.resize(nAddresses);
+
+	for (int i = 0; i < nAddresses; i++) {
+
+		fDigital[i] = addresses[i] >= MAX_AIN_ADDRESS;
+		fOffset[i] = 0.1 * (i + 1);
+		fKickGain[i] = (i % 3 + 1) / 3.0 * (i % 2 ? -1 : 1);
+
+	}
+
+	fScans = 0;
+	fStartTime = Now();
+	fFirstScanTime = TriggerTime();
+
+	return 0;
+}
+
+int LJSimSource::Read(double *data, int *deviceScanBacklog, int *LJMScanBacklog)
+{
+	*deviceScanBacklog = 0;
+	*LJMScanBacklog = 0;
+
+	// A trigger that never comes.
+	if (fFirstScanTime < 0) return LJ_STREAM_WAITING;
+
+	double speed = fConfig.speed;
+	double elapsed = (Now() - fStartTime) * (speed > 0 ? speed : 1);
+
+	// Until the trigger, nothing is read, as with a triggered T7.
+	if (speed > 0 && fScans == 0 && elapsed < fFirstScanTime)
+		return LJ_STREAM_WAITING;
+
+	int nChannels = fDigital.size();
+	int mask = 1 << fConfig.cycleDIO;
+
+	for (int i = 0; i < fScansPerRead; i++) {
+
+		double t = fFirstScanTime + (fScans + i) / fScanRate;
+		double since = SinceCycle(t);
+		double kick = since >= 0 && fConfig.kickTau > 0 ?
+			fConfig.kick * exp(-since / fConfig.kickTau) : 0;
+
+		double *scan = data + (size_t)i * nChannels;
+
+		for (int c = 0; c < nChannels; c++) {
+
+			if (fDigital[c]) scan[c] = Line(t) ? mask : 0;
+			else scan[c] = fOffset[c] + fKickGain[c] * kick +
+				fConfig.noise * fGauss(fRandom);
+
+		}
+
+	}
+
+	fScans += fScansPerRead;
+
+	if (speed <= 0) return 0;
+
+	// The block is delivered when its last scan would have been taken. If
+	// that has already passed, the frontend is behind.
+	double due = fStartTime + (fFirstScanTime + fScans / fScanRate) / speed;
+	double now = Now();
+
+	if (due > now) usleep((useconds_t)((due - now) * 1e6));
+	else *LJMScanBacklog = (int)((now - due) * fScanRate * speed);
+
+	return 0;
+}
+
+int LJSimSource::Stop()
+{
+	return 0;
+}
@@ -0,0 +1,110 @@
+/********************************************************************\
+ Labjack simulation
+
+ A stream source which makes up the scans of a T7 instead of reading
+ one, for working on the frontend without the DAQ box. It behaves as LJM
+ does in the ways the frontend depends on:
+
+   * analog channels (addresses of AIN registers) read a fixed offset
+     each, white noise, and a kick at every cycle which decays away, as a
+     magnet ramp would leave on the fluxgates;
+   * a digital state address (any other register, e.g. FIO_EIO_STATE)
+     reads a simulated cycle line on one DIO: high for the pulse width at
+     the start of every cycle period, low otherwise;
+   * a triggered stream waits for the simulated trigger edge, returning
+     LJ_STREAM_WAITING until then, and its first scan is at the edge. A
+     trigger on a DIO other than the simulated line never comes;
+   * the blocks are delivered at the scan rate (times the speed), and
+     the LJM backlog counts the scans which are ready but not read yet.
+
+ The simulated time starts at 0 when the stream is started, and the
+ first cycle starts half a period later.
+\********************************************************************/
+
+#ifndef LJSIMSOURCE_H
+#define LJSIMSOURCE_H
+
+#include <stdint.h>
+#include <random>
+#include <vector>
+
+#include "ljStreamSource.h"
+
+struct LJSimConfig {
+
+	LJSimConfig()
+		: noise(1e-4), cyclePeriod(10), pulseWidth(0.01), cycleDIO(0),
+		  kick(0.05), kickTau(1), speed(1) {}
+
+	// RMS of the noise on every channel, in V.
+	double noise;
+
+	// The cycle line: a pulse of pulseWidth s every cyclePeriod s on
+	// cycleDIO. No pulses for a period of 0.
+	double cyclePeriod;
+	double pulseWidth;
+	int cycleDIO;
+
+	// Amplitude in V (scaled per channel) and decay time in s of the kick
+	// at the start of every cycle.
+	double kick;
+	double kickTau;
+
+	// A multiple of the scan rate, 0 for as fast as possible.
+	double speed;
+};
+
+class LJSimSource : public LJStreamSource {
+
+public:
+
+	LJSimSource();
+
+	void Configure(const LJSimConfig &config) { fConfig = config; }
+	const LJSimConfig &Config() const { return fConfig; }
+
+	// The stream trigger, as in LJStreamConfig (-1 for none). Takes
+	// effect at the next Start().
+	void SetTrigger(int dio, int edge) { fTriggerDIO = dio; fTriggerEdge = edge; }
+
+	// Scans delivered since Start().
+	uint64_t Scans() const { return fScans; }
+
+	virtual int Start(int scansPerRead, int nAddresses, const int *addresses,
+			  double *scanRate);
+	virtual int Read(double *data, int *deviceScanBacklog,
+			 int *LJMScanBacklog);
+	virtual int Stop();
+
+private:
+
+	// The simulated time of the first edge of the trigger, or -1 if
+	// there is none.
+	double TriggerTime() const;
+
+	// The simulated state of the line and the time since the last cycle
+	// started (negative before the first) at time t.
+	bool Line(double t) const;
+	double SinceCycle(double t) const;
+
+	LJSimConfig fConfig;
+	int fTriggerDIO;
+	int fTriggerEdge;
+
+	int fScansPerRead;
+	double fScanRate;
+	std::vector<bool> fDigital;
+	std::vector<double> fOffset;
+	std::vector<double> fKickGain;
+
+	// The wall clock time the stream was started at, and the simulated
+	// time of its first scan.
+	double fStartTime;
+	double fFirstScanTime;
+	uint64_t fScans;
+
+	std::mt19937 fRandom;
+	std::normal_distribution<double> fGauss;
+};
+
+#endif
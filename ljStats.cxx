@@ -0,0 +1,330 @@
+/********************************************************************\
+ Labjack block statistics
+\********************************************************************/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "ljStats.h"
+#include "ljChannels.h"
+
+/*-- Mean and STD --------------------------------------------------*/
+
+void LJMeanStd(const double *data, int nChannels, int nScans,
+	       double *mean, double *std)
+{
+	for (int channel = 0; channel < nChannels; channel++) {
+
+		mean[channel] = 0;
+		std[channel] = 0;
+
+		if (nScans <= 0) continue;
+
+		double sum = 0;
+		for (int i = 0; i < nScans; i++)
+			sum += data[channel + nChannels * i];
+
+		mean[channel] = sum / nScans;
+
+		double sum2 = 0;
+		for (int i = 0; i < nScans; i++) {
+
+			double d = data[channel + nChannels * i] - mean[channel];
+			sum2 += d * d;
+
+		}
+
+		std[channel] = sqrt(sum2 / nScans);
+
+	}
+}
+
+// Four accumulators, so that the additions don't each wait for the
+// previous one and the compiler can use vector registers.
+static void MeanStdChannel(const double *x, int n, double &mean, double &std)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int i = 0;
+
+	for (; i + 3 < n; i += 4) {
+
+		s0 += x[i];
+		s1 += x[i + 1];
+		s2 += x[i + 2];
+		s3 += x[i + 3];
+
+	}
+
+	for (; i < n; i++) s0 += x[i];
+
+	mean = ((s0 + s1) + (s2 + s3)) / n;
+
+	double q0 = 0, q1 = 0, q2 = 0, q3 = 0;
+	i = 0;
+
+	for (; i + 3 < n; i += 4) {
+
+		double d0 = x[i] - mean;
+		double d1 = x[i + 1] - mean;
+		double d2 = x[i + 2] - mean;
+		double d3 = x[i + 3] - mean;
+		q0 += d0 * d0;
+		q1 += d1 * d1;
+		q2 += d2 * d2;
+		q3 += d3 * d3;
+
+	}
+
+	for (; i < n; i++) {
+
+		double d = x[i] - mean;
+		q0 += d * d;
+
+	}
+
+	std = sqrt(((q0 + q1) + (q2 + q3)) / n);
+}
+
+void LJMeanStd(const LJChannelBlock &block, double *mean, double *std)
+{
+	for (int channel = 0; channel < block.Channels(); channel++) {
+
+		mean[channel] = 0;
+		std[channel] = 0;
+
+		if (block.Scans() <= 0) continue;
+
+		MeanStdChannel(block.Channel(channel), block.Scans(),
+			       mean[channel], std[channel]);
+
+	}
+}
+
+/*-- Kernel table --------------------------------------------------*/
+
+// Mean and STD of interleaved scans of N channels, innermost over the
+// channels of a scan.
+template <int N>
+static bool MeanStdScans(const double *scans, int, int nScans,
+			 LJChannelBlock &, double *mean, double *std,
+			 int stride)
+{
+	double sum[N] = {0};
+	double sum2[N] = {0};
+	double m[N];
+
+	if (nScans <= 0) {
+
+		for (int c = 0; c < N; c++) mean[stride * c] = std[stride * c] = 0;
+		return false;
+
+	}
+
+	for (int i = 0; i < nScans; i++) {
+
+		const double *x = scans + (size_t)i * N;
+		for (int c = 0; c < N; c++) sum[c] += x[c];
+
+	}
+
+	for (int c = 0; c < N; c++) m[c] = sum[c] / nScans;
+
+	for (int i = 0; i < nScans; i++) {
+
+		const double *x = scans + (size_t)i * N;
+		for (int c = 0; c < N; c++) {
+
+			double d = x[c] - m[c];
+			sum2[c] += d * d;
+
+		}
+
+	}
+
+	for (int c = 0; c < N; c++) {
+
+		mean[stride * c] = m[c];
+		std[stride * c] = sqrt(sum2[c] / nScans);
+
+	}
+
+	return false;
+}
+
+// De-interleaves, then the per-channel kernel for N channels.
+template <int N>
+static bool MeanStdBlock(const double *scans, int, int nScans,
+			 LJChannelBlock &block, double *mean, double *std,
+			 int stride)
+{
+	block.Load(scans, N, nScans);
+
+	for (int c = 0; c < N; c++) {
+
+		double m = 0, s = 0;
+		if (nScans > 0) MeanStdChannel(block.Channel(c), nScans, m, s);
+
+		mean[stride * c] = m;
+		std[stride * c] = s;
+
+	}
+
+	return true;
+}
+
+static bool MeanStdGeneric(const double *scans, int nChannels, int nScans,
+			   LJChannelBlock &block, double *mean, double *std,
+			   int stride)
+{
+	block.Load(scans, nChannels, nScans);
+
+	for (int c = 0; c < nChannels; c++) {
+
+		double m = 0, s = 0;
+		if (nScans > 0) MeanStdChannel(block.Channel(c), nScans, m, s);
+
+		mean[stride * c] = m;
+		std[stride * c] = s;
+
+	}
+
+	return true;
+}
+
+// Which of the two mean/STD kernels a channel count gets was decided with
+// bench/benchStats.cxx (meanstd/kernel).
+static const LJStatsKernel KERNELS[] = {
+	{ 3, MeanStdBlock<3> },
+	{ 15, MeanStdBlock<15> },
+	{ 30, MeanStdScans<30> },
+	{ 32, MeanStdScans<32> },
+};
+
+static const LJStatsKernel GENERIC = { 0, MeanStdGeneric };
+
+const LJStatsKernel &LJStatsKernelFor(int nChannels)
+{
+	for (size_t i = 0; i < sizeof(KERNELS) / sizeof(KERNELS[0]); i++)
+		if (KERNELS[i].nChannels == nChannels) return KERNELS[i];
+
+	return GENERIC;
+}
+
+/*-- Robust statistics ---------------------------------------------*/
+
+// The MAD of Gaussian noise is its STD divided by this.
+static const double MAD_TO_SIGMA = 1.4826;
+
+// The median of x[0..n), which is reordered. For an even n it's the mean
+// of the two middle values; the lower one is the largest of the lower
+// half once nth_element has put the upper one in place.
+static double Median(double *x, int n)
+{
+	int half = n / 2;
+	std::nth_element(x, x + half, x + n);
+
+	if (n % 2) return x[half];
+
+	return 0.5 * (x[half] + *std::max_element(x, x + half));
+}
+
+LJRobustStats::LJRobustStats()
+	: fClipSigma(3), fIterations(3)
+{
+}
+
+void LJRobustStats::Configure(double clipSigma, int iterations)
+{
+	fClipSigma = clipSigma > 0 ? clipSigma : 3;
+	fIterations = iterations > 0 ? iterations : 1;
+}
+
+void LJRobustStats::Compute(const LJChannelBlock &block, double *out)
+{
+	if ((int)fScratch.size() < block.Scans()) fScratch.resize(block.Scans());
+
+	for (int channel = 0; channel < block.Channels(); channel++) {
+
+		double *o = out + VALUES * channel;
+		for (int v = 0; v < VALUES; v++) o[v] = 0;
+
+		if (block.Scans() <= 0) continue;
+
+		ComputeChannel(block.Channel(channel), block.Scans(), o);
+
+	}
+}
+
+void LJRobustStats::ComputeChannel(const double *x, int n, double *out)
+{
+	double *work = &fScratch[0];
+
+	std::copy(x, x + n, work);
+	double median = Median(work, n);
+
+	for (int i = 0; i < n; i++) work[i] = fabs(x[i] - median);
+	double mad = MAD_TO_SIGMA * Median(work, n);
+
+	// The first pass clips around the median at the MAD. Quantized, quiet
+	// channels can have a MAD of 0, which would reject every scan off the
+	// median, so those start from the plain STD instead.
+	double centre = median;
+	double sigma = mad;
+
+	if (sigma == 0) {
+
+		double mean, std;
+		MeanStdChannel(x, n, mean, std);
+		sigma = std;
+
+	}
+
+	double mean = median, std = 0;
+	int kept = n, lastKept = -1;
+
+	for (int pass = 0; pass < fIterations && kept != lastKept; pass++) {
+
+		double limit = fClipSigma * sigma;
+		double sum = 0;
+		int count = 0;
+
+		for (int i = 0; i < n; i++) {
+
+			if (fabs(x[i] - centre) > limit) continue;
+			sum += x[i];
+			count++;
+
+		}
+
+		// Nothing within the limit (only possible if sigma is 0 and
+		// the median isn't a scan): the median is kept as the mean.
+		if (count == 0) break;
+
+		double m = sum / count;
+		double sum2 = 0;
+
+		for (int i = 0; i < n; i++) {
+
+			if (fabs(x[i] - centre) > limit) continue;
+			double d = x[i] - m;
+			sum2 += d * d;
+
+		}
+
+		lastKept = kept;
+		kept = count;
+		mean = m;
+		std = sqrt(sum2 / count);
+
+		centre = mean;
+		sigma = std;
+
+	}
+
+	out[0] = median;
+	out[1] = mad;
+	out[2] = mean;
+	out[3] = std;
+	out[4] = n - kept;
+}
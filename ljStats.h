@@ -0,0 +1,117 @@
+/********************************************************************\
+ Labjack block statistics
+
+ The mean and standard deviation of every channel over a block of
+ interleaved scans (scan i, channel c at data[c + nChannels * i]), as
+ written to the LBJK bank. The standard deviation is the population one,
+ sqrt(sum((x - mean)^2) / nScans), taken in a second pass over the block
+ so that it doesn't lose precision on channels with a large offset.
+
+ This is the kernel read_labjack_event runs on every block; it is kept
+ in its own module so that the benchmarks in bench/ time the same code.
+
+ The frontend doesn't call the kernels directly but through the kernel
+ table (LJStatsKernelFor), which has versions compiled for a fixed
+ number of channels, so that the channel loops have a known trip count
+ and are unrolled and vectorized:
+
+   * for 30 and 32 channels the mean and STD are taken straight from the
+     interleaved scans, with the loop over the channels of a scan, which
+     is contiguous, innermost. This is quicker than de-interleaving.
+   * for 3 and 15 channels, too few for that to vectorize well, the 
+     block is de-interleaved and the per-channel kernel is run on it.
+   * any other number of channels, e.g. a layout from the ODB, gets the
+     generic version, which de-interleaves as well.
+
+ The kernels write their results with a stride, so that they can go
+ straight into the LBJK bank as mean/STD pairs.
+
+ Single spikes, e.g. from the MUX80 switching, pull the mean and blow up
+ the STD of a block. LJRobustStats gives, for every channel of a
+ de-interleaved block, statistics which a few outliers don't move:
+
+   median	   the middle scan (the mean of the two middle ones for an
+		   even number of scans)
+   MAD		   the median absolute deviation from the median, scaled
+		   by 1.4826 so that it estimates the STD for Gaussian noise
+   clipped mean    the mean and STD of the scans within clipSigma of the
+   clipped STD	   centre, starting from the median and MAD and then
+		   iterating with the clipped mean and STD
+   rejected	   the number of scans clipped in the last iteration
+
+ The medians are found with std::nth_element on a copy of the channel,
+ which is linear in the number of scans rather than a sort. That is
+ still a lot slower than the mean and STD, but cheap next to the scan
+ rate (bench/benchStats.cxx, robust).
+\********************************************************************/
+
+#ifndef LJSTATS_H
+#define LJSTATS_H
+
+#include <vector>
+
+class LJChannelBlock;
+
+// Fills mean and std, nChannels values each. Both are 0 for nScans <= 0.
+void LJMeanStd(const double *data, int nChannels, int nScans,
+	       double *mean, double *std);
+
+// The same for a de-interleaved block (see ljChannels.h), where the loops
+// run over contiguous, aligned arrays and vectorize. The sums are split
+// over four accumulators for that, so the results can differ from the
+// interleaved version in the last bit.
+void LJMeanStd(const LJChannelBlock &block, double *mean, double *std);
+
+struct LJStatsKernel {
+
+	// Channel count the kernel is compiled for, 0 for the generic one.
+	int nChannels;
+
+	// Takes the mean and STD of nScans interleaved scans, writing those
+	// of channel c to mean[stride * c] and std[stride * c]. With a stride
+	// of 2 and std = mean + 1 they are the pairs of the LBJK bank, which
+	// the frontend has them written into straight away. Returns true if
+	// it de-interleaved the scans into block on the way, false if block
+	// was left alone.
+	bool (*meanStd)(const double *scans, int nChannels, int nScans,
+			LJChannelBlock &block, double *mean, double *std,
+			int stride);
+};
+
+// The kernels for nChannels channels; the generic ones if there are no
+// specialized ones.
+const LJStatsKernel &LJStatsKernelFor(int nChannels);
+
+class LJRobustStats {
+
+public:
+
+	// Values per channel written by Compute().
+	enum { VALUES = 5 };
+
+	LJRobustStats();
+
+	// Clips at clipSigma times the STD, for at most iterations passes
+	// (fewer once a pass rejects as many scans as the one before).
+	void Configure(double clipSigma, int iterations);
+
+	// Writes median, MAD, clipped mean, clipped STD and rejected for each
+	// channel of the block to out, VALUES * block.Channels() doubles. All
+	// are 0 for an empty block.
+	void Compute(const LJChannelBlock &block, double *out);
+
+	double ClipSigma() const { return fClipSigma; }
+	int Iterations() const { return fIterations; }
+
+private:
+
+	void ComputeChannel(const double *x, int n, double *out);
+
+	double fClipSigma;
+	int fIterations;
+
+	// The copy of a channel the medians are selected in.
+	std::vector<double> fScratch;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/********************************************************************\
+ Labjack stream configuration helpers
+\********************************************************************/
+
+#include <stddef.h>
+
+#include "ljStreamConfig.h"
+
+// Maximum stream sample rates of the T7 in samples/s, following the tables
+// in appendix A-1 of the T7 datasheet. Rows are resolution index 1 to 8,
+// columns are the +/-10, +/-1, +/-0.1 and +/-0.01 V ranges. The smaller
+// ranges are slower because of the extra settling of the gain stage. Where
+// the datasheet gives a range of values, the conservative one is used.
+static const double T7_STREAM_RATES[T7_MAX_STREAM_RESOLUTION_INDEX][4] = {
+	{100000, 48000, 11000, 2500},
+	{ 48000, 35000, 11000, 2500},
+	{ 22000, 18000, 10000, 2500},
+	{ 11000, 10000,  7000, 2400},
+	{  5500,  5000,  4000, 2000},
+	{  2500,  2400,  2000, 1500},
+	{  1200,  1200,  1100,  900},
+	{   600,   600,   550,  500}
+};
+
+/*-- Range to table column -----------------------------------------*/
+
+// The T7 picks the smallest range which still contains the requested one,
+// so e.g. a request of 5 V gives the +/-10 V range.
+static int RangeColumn(double range)
+{
+	if (range <= 0 || range > 1)	return 0;
+	if (range > 0.1)		return 1;
+	if (range > 0.01)		return 2;
+	return 3;
+}
+
+/*-- Single channel sample rate -------------------------------------*/
+
+double T7MaxSampleRate(int resolutionIndex, double range, double settlingUS)
+{
+	// Index 0 is the stream default, which is index 1.
+	if (resolutionIndex == 0) resolutionIndex = 1;
+
+	if (resolutionIndex < 1 || resolutionIndex > T7_MAX_STREAM_RESOLUTION_INDEX)
+		return 0;
+
+	double rate = T7_STREAM_RATES[resolutionIndex - 1][RangeColumn(range)];
+
+	// A fixed settling time is waited on top of the conversion itself.
+	if (settlingUS > 0)
+		rate = 1.0 / (1.0 / rate + settlingUS * 1e-6);
+
+	return rate;
+}
+
+/*-- Whole scan rate -----------------------------------------------*/
+
+double T7MaxScanRate(const LJStreamConfig &config)
+{
+	if (config.range.empty()) return 0;
+
+	// Add up the time it takes to sample each channel once.
+	double scanTime = config.digitalChannels / T7_MAX_SAMPLE_RATE;
+	for (size_t i = 0; i < config.range.size(); i++) {
+
+		double rate = T7MaxSampleRate(config.resolutionIndex,
+					config.range[i], config.settlingUS);
+		if (rate <= 0) return 0;
+
+		scanTime += 1.0 / rate;
+	}
+
+	// The combined sample rate can never exceed the hardware limit.
+	double scanRate = 1.0 / scanTime;
+	double limit = T7_MAX_SAMPLE_RATE / 
+		(config.range.size() + config.digitalChannels);
+
+	return scanRate < limit ? scanRate : limit;
+}
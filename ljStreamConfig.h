@@ -0,0 +1,85 @@
+/********************************************************************\
+ Labjack stream configuration helpers
+
+ Per-channel analog input settings (range and negative channel), the
+ stream-wide resolution and settling time, and how the stream is started
+ and clocked, along with the maximum scan rate the T7 can sustain for a
+ given configuration. Nothing in here talks to the device: the frontend
+ reads the settings from the ODB, uses these functions to check them, and
+ then writes them with LJM.
+\********************************************************************/
+
+#ifndef LJSTREAMCONFIG_H
+#define LJSTREAMCONFIG_H
+
+#include <vector>
+
+// The T7 hardware sample rate limit (all channels combined), in samples/s.
+#define T7_MAX_SAMPLE_RATE 100000.0
+
+// The largest STREAM_RESOLUTION_INDEX the T7 accepts while streaming.
+#define T7_MAX_STREAM_RESOLUTION_INDEX 8
+
+// The DIO lines which can trigger a stream, DIO0 and DIO1: only their
+// extended features (DIO0_EF, DIO1_EF) include the frequency and pulse
+// width inputs the trigger uses.
+#define T7_MAX_TRIGGER_DIO 1
+
+// STREAM_CLOCK_SOURCE values.
+#define T7_CLOCK_INTERNAL	0
+#define T7_CLOCK_EXTERNAL	2	// on CIO3
+
+// Edges of a digital line, for the stream trigger and the cycle edges.
+enum { LJ_EDGE_RISING = 0, LJ_EDGE_FALLING = 1, LJ_EDGE_BOTH = 2 };
+
+struct LJStreamConfig {
+
+	LJStreamConfig()
+		: resolutionIndex(0), settlingUS(0), digitalChannels(0),
+		  triggerDIO(-1), triggerEdge(LJ_EDGE_RISING),
+		  clockSource(T7_CLOCK_INTERNAL), clockDivisor(1) {}
+
+	// STREAM_RESOLUTION_INDEX: 0 is the default, which is the same as 1.
+	// Larger values give lower noise but longer sample times.
+	int resolutionIndex;
+
+	// STREAM_SETTLING_US: 0 selects automatic settling.
+	double settlingUS;
+
+	// AIN#_RANGE for each channel in the scan list, in volts (+/-). The
+	// T7 supports 10, 1, 0.1 and 0.01; 0 selects the default (+/-10 V).
+	std::vector<double> range;
+
+	// AIN#_NEGATIVE_CH for each channel in the scan list. LJM_GND (199)
+	// gives single-ended readings.
+	std::vector<int> negativeChannel;
+
+	// Number of digital inputs (e.g. FIO_EIO_STATE) in the scan list
+	// after the analog channels. They need no configuration, but take a
+	// sample each at the full rate.
+	int digitalChannels;
+
+	// The DIO line whose triggerEdge starts the stream, or -1 to start as
+	// soon as the stream is enabled. The first scan is taken at the edge.
+	int triggerDIO;
+	int triggerEdge;
+
+	// STREAM_CLOCK_SOURCE and, for the external clock, 
+	// STREAM_EXTERNAL_CLOCK_DIVISOR: a scan every clockDivisor edges on
+	// CIO3. With the external clock, the scan rate the stream is started 
+	// with is only what is expected from it.
+	int clockSource;
+	int clockDivisor;
+};
+
+// Maximum sample rate (samples/s) of a single channel with the given range
+// at the given resolution index and settling time. Returns 0 if the
+// resolution index cannot be used in stream mode.
+double T7MaxSampleRate(int resolutionIndex, double range, double settlingUS);
+
+// Maximum scan rate (scans/s) for the whole scan list. Each scan has to fit
+// one sample of every channel, so mixed ranges are accounted for channel by
+// channel. Returns 0 if the configuration cannot be streamed.
+double T7MaxScanRate(const LJStreamConfig &config);
+
+#endif
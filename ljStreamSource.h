@@ -0,0 +1,49 @@
+/********************************************************************\
+ Labjack stream source
+
+ The interface through which the frontend starts, reads and stops the
+ stream. It has the same shape as LJM_eStreamStart, LJM_eStreamRead and
+ LJM_eStreamStop, and returns LJM error codes (0 for no error), so that
+ the stream can come from the Labjack or from somewhere else, e.g. a
+ replay of recorded data (see ljReplay.h), without the rest of the
+ frontend knowing the difference.
+\********************************************************************/
+
+#ifndef LJSTREAMSOURCE_H
+#define LJSTREAMSOURCE_H
+
+// Returned by Read() when a source other than the Labjack has no more
+// data. LJM error codes are all positive.
+#define LJ_STREAM_END	-1
+
+// Returned by Read() while a triggered stream hasn't been triggered yet,
+// so there are no scans to read. The read can be tried again later.
+#define LJ_STREAM_WAITING	-2
+
+// The samples of skipped scans are filled with this, by LJM and by the
+// other sources alike. The definition is the one in LabJackM.h, which is
+// repeated here for the modules built without LJM, e.g. in the analyzer.
+#ifndef LJM_DUMMY_VALUE
+#define LJM_DUMMY_VALUE -9999
+#endif
+
+class LJStreamSource {
+
+public:
+
+	virtual ~LJStreamSource() {}
+
+	// Starts streaming the nAddresses addresses at *scanRate, to be read
+	// scansPerRead scans at a time. *scanRate is set to the actual rate.
+	virtual int Start(int scansPerRead, int nAddresses, const int *addresses,
+			  double *scanRate) = 0;
+
+	// Reads scansPerRead interleaved scans into data, waiting for them if
+	// needed, and returns the scan backlogs left in the device and in LJM.
+	virtual int Read(double *data, int *deviceScanBacklog,
+			 int *LJMScanBacklog) = 0;
+
+	virtual int Stop() = 0;
+};
+
+#endif
@@ -0,0 +1,375 @@
+/********************************************************************\
+ Labjack data tap
+\********************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "ljTap.h"
+
+static_assert(sizeof(LJTapFrameHeader) == 56, "tap frame header layout");
+static_assert(sizeof(LJTapShmHeader) == 56, "tap shared memory header layout");
+
+// Space for the channel names after the shared memory header.
+static const size_t MAX_NAMES =
+	(LJ_TAP_HEADER_SIZE - sizeof(LJTapShmHeader)) / LJ_TAP_NAME_LENGTH;
+
+LJTap::LJTap()
+	: fShm(NULL), fShmSize(0), fHeader(NULL), fRing(NULL), fListen(-1),
+	  fArchive(NULL)
+{
+}
+
+LJTap::~LJTap()
+{
+	Close();
+}
+
+/*-- Shared memory -------------------------------------------------*/
+
+bool LJTap::OpenSharedMemory(const char *name, size_t size,
+			     const std::vector<std::string> &channelNames,
+			     std::string &error)
+{
+	if (channelNames.size() > MAX_NAMES) {
+
+		error = "too many channels for the tap header";
+		return false;
+
+	}
+
+	fNames = channelNames;
+
+	// The ring is a whole number of 8 byte words.
+	size_t capacity = (size / 8) * 8;
+	fShmSize = LJ_TAP_HEADER_SIZE + capacity;
+
+	int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+
+		error = std::string("shm_open: ") + strerror(errno);
+		return false;
+
+	}
+
+	if (ftruncate(fd, fShmSize) != 0) {
+
+		error = std::string("ftruncate: ") + strerror(errno);
+		close(fd);
+		return false;
+
+	}
+
+	fShm = mmap(NULL, fShmSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (fShm == MAP_FAILED) {
+
+		error = std::string("mmap: ") + strerror(errno);
+		fShm = NULL;
+		return false;
+
+	}
+
+	fShmName = name;
+	fHeader = (LJTapShmHeader *)fShm;
+	fRing = (char *)fShm + LJ_TAP_HEADER_SIZE;
+
+	// Readers of an older ring see the version go to 0 while the header
+	// is rewritten, and the magic only appears once it is complete.
+	memset(fShm, 0, LJ_TAP_HEADER_SIZE);
+	fHeader->version = LJ_TAP_VERSION;
+	fHeader->headerSize = LJ_TAP_HEADER_SIZE;
+	fHeader->capacity = capacity;
+	fHeader->nChannels = fNames.size();
+
+	char *names = (char *)fShm + sizeof(LJTapShmHeader);
+	for (size_t i = 0; i < fNames.size(); i++)
+		strncpy(names + i * LJ_TAP_NAME_LENGTH, fNames[i].c_str(),
+			LJ_TAP_NAME_LENGTH - 1);
+
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(fHeader->magic, "LJTAP", 6);
+
+	return true;
+}
+
+void LJTap::WriteShm(const LJTapFrameHeader &header, const double *data)
+{
+	uint64_t capacity = fHeader->capacity;
+	uint64_t end = fHeader->writeEnd;
+
+	// Frames larger than half the ring couldn't be read reliably.
+	if (header.size > capacity / 2) return;
+
+	uint64_t remaining = capacity - end % capacity;
+
+	if (header.size > remaining) {
+
+		// A pad frame marks the rest of the ring as unused, if there is
+		// room for its header. Readers skip less than that by themselves.
+		if (remaining >= sizeof(LJTapFrameHeader)) {
+
+			LJTapFrameHeader pad;
+			memset(&pad, 0, sizeof(pad));
+			pad.magic = LJ_TAP_FRAME_MAGIC;
+			pad.type = LJ_TAP_PAD;
+			pad.size = remaining;
+
+			__atomic_store_n(&fHeader->writeBegin, end + remaining,
+					 __ATOMIC_RELEASE);
+			memcpy(fRing + end % capacity, &pad, sizeof(pad));
+
+		}
+
+		end += remaining;
+
+	}
+
+	// Announce the region being overwritten before touching it, so that
+	// readers can tell whether what they copied is still intact.
+	__atomic_store_n(&fHeader->writeBegin, end + header.size, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	char *dst = fRing + end % capacity;
+	memcpy(dst, &header, sizeof(header));
+	memcpy(dst + sizeof(header), data,
+	       sizeof(double) * header.nScans * header.nChannels);
+
+	__atomic_store_n(&fHeader->lastFrame, end, __ATOMIC_RELEASE);
+	__atomic_store_n(&fHeader->writeEnd, end + header.size, __ATOMIC_RELEASE);
+}
+
+/*-- Sockets -------------------------------------------------------*/
+
+bool LJTap::OpenSocket(const char *address, std::string &error)
+{
+	if (strncmp(address, "unix:", 5) == 0) {
+
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address + 5, sizeof(addr.sun_path) - 1);
+
+		// A socket file left over from a previous run is removed.
+		unlink(addr.sun_path);
+
+		fListen = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fListen < 0 ||
+		    bind(fListen, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+
+			error = std::string("bind ") + address + ": " + strerror(errno);
+			Close();
+			return false;
+
+		}
+
+		fSocketPath = addr.sun_path;
+
+	}
+
+	else if (strncmp(address, "tcp:", 4) == 0) {
+
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(atoi(address + 4));
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		int one = 1;
+		fListen = socket(AF_INET, SOCK_STREAM, 0);
+		if (fListen >= 0)
+			setsockopt(fListen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+		if (fListen < 0 ||
+		    bind(fListen, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+
+			error = std::string("bind ") + address + ": " + strerror(errno);
+			Close();
+			return false;
+
+		}
+
+	}
+
+	else {
+
+		error = std::string("unknown tap socket address ") + address;
+		return false;
+
+	}
+
+	// The listening socket is polled for new clients with every block.
+	if (listen(fListen, 8) != 0 ||
+	    fcntl(fListen, F_SETFL, O_NONBLOCK) != 0) {
+
+		error = std::string("listen: ") + strerror(errno);
+		Close();
+		return false;
+
+	}
+
+	return true;
+}
+
+void LJTap::AcceptClients()
+{
+	int fd;
+
+	while ((fd = accept(fListen, NULL, NULL)) >= 0) {
+
+		// A client that can't keep up is disconnected rather than allowed
+		// to hold up the tap thread for more than this.
+		struct timeval timeout = {0, 200000};
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		SendNames(fd);
+		fClients.push_back(fd);
+
+	}
+}
+
+// Sends the whole buffer, returning false on error or timeout.
+static bool SendAll(int fd, const void *buffer, size_t size)
+{
+	const char *p = (const char *)buffer;
+
+	while (size > 0) {
+
+		ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+		if (n <= 0) return false;
+
+		p += n;
+		size -= n;
+
+	}
+
+	return true;
+}
+
+void LJTap::NamesFrame(LJTapFrameHeader &header, std::vector<char> &names)
+{
+	names.assign(fNames.size() * LJ_TAP_NAME_LENGTH, 0);
+	for (size_t i = 0; i < fNames.size(); i++)
+		strncpy(&names[i * LJ_TAP_NAME_LENGTH], fNames[i].c_str(),
+			LJ_TAP_NAME_LENGTH - 1);
+
+	// LJ_TAP_NAME_LENGTH is a multiple of 8, so no padding is needed.
+	memset(&header, 0, sizeof(header));
+	header.magic = LJ_TAP_FRAME_MAGIC;
+	header.type = LJ_TAP_NAMES;
+	header.size = sizeof(header) + names.size();
+	header.nChannels = fNames.size();
+}
+
+void LJTap::SendNames(int fd)
+{
+	LJTapFrameHeader header;
+	std::vector<char> names;
+	NamesFrame(header, names);
+
+	SendAll(fd, &header, sizeof(header));
+	if (!names.empty()) SendAll(fd, &names[0], names.size());
+}
+
+/*-- Archive -------------------------------------------------------*/
+
+bool LJTap::OpenArchive(const char *path, std::string &error)
+{
+	fArchive = fopen(path, "ab");
+	if (!fArchive) {
+
+		error = std::string("fopen ") + path + ": " + strerror(errno);
+		return false;
+
+	}
+
+	LJTapFrameHeader header;
+	std::vector<char> names;
+	NamesFrame(header, names);
+
+	fwrite(&header, sizeof(header), 1, fArchive);
+	if (!names.empty()) fwrite(&names[0], 1, names.size(), fArchive);
+
+	return true;
+}
+
+/*-- Close ---------------------------------------------------------*/
+
+void LJTap::Close()
+{
+	for (size_t i = 0; i < fClients.size(); i++) close(fClients[i]);
+	fClients.clear();
+
+	if (fListen >= 0) close(fListen);
+	fListen = -1;
+
+	if (!fSocketPath.empty()) unlink(fSocketPath.c_str());
+	fSocketPath.clear();
+
+	if (fArchive) fclose(fArchive);
+	fArchive = NULL;
+
+	// The shared memory itself is left in place, so that readers notice
+	// the frontend has stopped by the positions no longer moving, rather
+	// than by crashing. It is reused by the next OpenSharedMemory().
+	if (fShm) munmap(fShm, fShmSize);
+	fShm = NULL;
+	fHeader = NULL;
+	fRing = NULL;
+}
+
+/*-- Process -------------------------------------------------------*/
+
+void LJTap::Process(const LJBlock &block)
+{
+	LJTapFrameHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = LJ_TAP_FRAME_MAGIC;
+	header.type = LJ_TAP_DATA;
+	header.size = sizeof(header) + sizeof(double) * block.nScans * block.nChannels;
+	header.nChannels = block.nChannels;
+	header.sequence = block.sequence;
+	header.time = block.time;
+	header.scanRate = block.scanRate;
+	header.nScans = block.nScans;
+	header.deviceBacklog = block.deviceBacklog;
+	header.ljmBacklog = block.ljmBacklog;
+
+	if (fHeader) WriteShm(header, &block.data[0]);
+
+	if (fArchive) {
+
+		fwrite(&header, sizeof(header), 1, fArchive);
+		fwrite(&block.data[0], 1, header.size - sizeof(header), fArchive);
+
+	}
+
+	if (fListen < 0) return;
+
+	AcceptClients();
+
+	for (size_t i = 0; i < fClients.size(); ) {
+
+		if (SendAll(fClients[i], &header, sizeof(header)) &&
+		    SendAll(fClients[i], &block.data[0], header.size - sizeof(header))) {
+
+			i++;
+			continue;
+
+		}
+
+		close(fClients[i]);
+		fClients.erase(fClients.begin() + i);
+
+	}
+}
@@ -0,0 +1,166 @@
+/********************************************************************\
+ Labjack data tap
+
+ A block bus consumer which makes the live scans available to other
+ programs on the same host, so that diagnostics don't need to open the
+ Labjack themselves (which they can't while the frontend has it open).
+ The blocks are written to
+
+   * a POSIX shared memory ring, which any number of readers can follow
+     without the frontend knowing about them, and optionally
+   * a Unix or local TCP socket, with one stream per connected client,
+   * an archive file, for replaying later (see ljReplay.h).
+
+ All use the same frames, described below. All values are little-endian
+ (the byte order of the DAQ host). src/LabJackTap.py is a matching client.
+
+ Frame (56 byte header, followed by the payload, padded to 8 bytes):
+
+   offset  type      field
+   0       uint32    magic, LJ_TAP_FRAME_MAGIC ("LJTF")
+   4       uint16    type: LJ_TAP_DATA, LJ_TAP_NAMES or LJ_TAP_PAD
+   6       uint16    reserved
+   8       uint32    size of the whole frame in bytes
+   12      uint32    number of channels
+   16      uint64    block sequence number
+   24      double    unix time of the read
+   32      double    scan rate in Hz
+   40      uint32    number of scans
+   44      int32     device scan backlog
+   48      int32     LJM scan backlog
+   52      uint32    reserved
+   56      payload:  LJ_TAP_DATA:  nScans * nChannels doubles, interleaved
+                                   as ch0, ch1, ... chN, ch0, ...
+                     LJ_TAP_NAMES: nChannels names of LJ_TAP_NAME_LENGTH
+                                   bytes, null padded
+                     LJ_TAP_PAD:   nothing, skip to the end of the ring
+
+ Shared memory layout: a LJ_TAP_HEADER_SIZE byte header, followed by
+ the ring of frames.
+
+   offset  type      field
+   0       char[8]   magic, "LJTAP" and null padding
+   8       uint32    version, LJ_TAP_VERSION
+   12      uint32    header size
+   16      uint64    capacity of the ring in bytes
+   24      uint64    write begin: end of the data being written
+   32      uint64    write end: end of the data completely written
+   40      uint64    start of the most recent complete frame
+   48      uint32    number of channels
+   52      uint32    reserved
+   56      char[][]  channel names, LJ_TAP_NAME_LENGTH bytes each
+
+ The positions are byte counts since the ring was created; the place in
+ the ring is the position modulo the capacity. A frame never wraps: if
+ it doesn't fit before the end of the ring, a LJ_TAP_PAD frame fills the
+ rest (or, if less than a frame header is left, that space is skipped)
+ and the frame starts at the beginning.
+
+ A reader starts at the most recent frame, and follows frames until it
+ reaches write end. After copying a frame which started at position p,
+ it must check that write begin - p <= capacity; otherwise the writer
+ has overwritten the frame while it was being copied, and the reader
+ should start over from the most recent frame.
+\********************************************************************/
+
+#ifndef LJTAP_H
+#define LJTAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "ljBlockBus.h"
+
+#define LJ_TAP_VERSION		1
+#define LJ_TAP_FRAME_MAGIC	0x46544A4C
+#define LJ_TAP_HEADER_SIZE	4096
+#define LJ_TAP_NAME_LENGTH	16
+
+enum { LJ_TAP_DATA = 0, LJ_TAP_NAMES = 1, LJ_TAP_PAD = 2 };
+
+struct LJTapFrameHeader {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t reserved;
+	uint32_t size;
+	uint32_t nChannels;
+	uint64_t sequence;
+	double time;
+	double scanRate;
+	uint32_t nScans;
+	int32_t deviceBacklog;
+	int32_t ljmBacklog;
+	uint32_t reserved2;
+};
+
+struct LJTapShmHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+	uint64_t capacity;
+	uint64_t writeBegin;
+	uint64_t writeEnd;
+	uint64_t lastFrame;
+	uint32_t nChannels;
+	uint32_t reserved;
+};
+
+class LJTap : public LJConsumer {
+
+public:
+
+	LJTap();
+	virtual ~LJTap();
+
+	// Creates the shared memory ring /name (e.g. "/labjack02_tap") with a
+	// capacity of size bytes, for the given channel names. Returns false
+	// and fills error if it can't be set up.
+	bool OpenSharedMemory(const char *name, size_t size,
+			      const std::vector<std::string> &channelNames,
+			      std::string &error);
+
+	// Listens on "unix:/path/to/socket" or "tcp:port" (bound to the
+	// loopback interface only). Returns false and fills error on failure.
+	bool OpenSocket(const char *address, std::string &error);
+
+	// Appends every block to the file at path: the channel names frame,
+	// then a data frame per block. Returns false and fills error if it
+	// can't be opened.
+	bool OpenArchive(const char *path, std::string &error);
+
+	void Close();
+
+	// Writes the block to the ring and to every connected client.
+	virtual void Process(const LJBlock &block);
+
+	// Number of connected socket clients.
+	int Clients() const { return (int)fClients.size(); }
+
+private:
+
+	void WriteShm(const LJTapFrameHeader &header, const double *data);
+	void AcceptClients();
+	void SendNames(int fd);
+	void NamesFrame(LJTapFrameHeader &header, std::vector<char> &names);
+
+	std::vector<std::string> fNames;
+
+	// Shared memory.
+	std::string fShmName;
+	void *fShm;
+	size_t fShmSize;
+	LJTapShmHeader *fHeader;
+	char *fRing;
+
+	// Sockets.
+	std::string fSocketPath;
+	int fListen;
+	std::vector<int> fClients;
+
+	// Archive.
+	FILE *fArchive;
+};
+
+#endif
@@ -0,0 +1,137 @@
+/********************************************************************\
+ Labjack software trigger
+\********************************************************************/
+
+#include <math.h>
+
+#include "ljTrigger.h"
+#include "ljStreamSource.h"
+
+LJTrigger::LJTrigger()
+	: fChannels(0), fSensors(0), fScanRate(0), fPrevLength(1),
+	  fHavePrev(false), fHavePrevBlock(false), fFiredChannel(-1)
+{
+	fConfig.window = 1;
+}
+
+/*-- Configure -----------------------------------------------------*/
+
+void LJTrigger::Configure(const LJTriggerConfig &config, int nChannels,
+			  double scanRate)
+{
+	fConfig = config;
+	fChannels = nChannels;
+	fSensors = nChannels / 3;
+	fScanRate = scanRate;
+
+	if (fConfig.window < 1) fConfig.window = 1;
+
+	// Missing entries disable the condition for that channel or sensor.
+	fConfig.threshold.resize(fChannels, 0);
+	fConfig.slewLimit.resize(fChannels, 0);
+	fConfig.magnitudeChange.resize(fSensors, 0);
+
+	fMean.assign(fChannels, 0);
+	fPrevMean.assign(fChannels, 0);
+	fPrevMagnitude.assign(fSensors, 0);
+	fMagnitudeSum.assign(fSensors, 0);
+
+	fPrevLength = fConfig.window;
+	fHavePrev = false;
+	fHavePrevBlock = false;
+	fFiredChannel = -1;
+}
+
+/*-- Evaluate ------------------------------------------------------*/
+
+int LJTrigger::Evaluate(const double *scans, int nScans)
+{
+	int fired = 0;
+	int nWindows = 0;
+
+	fFiredChannel = -1;
+
+	for (int s = 0; s < fSensors; s++) fMagnitudeSum[s] = 0;
+
+	for (int start = 0; start < nScans; start += fConfig.window) {
+
+		int length = nScans - start;
+		if (length > fConfig.window) length = fConfig.window;
+
+		// Window mean of each channel, leaving out skipped scans.
+		for (int ch = 0; ch < fChannels; ch++) {
+
+			double sum = 0;
+			int n = 0;
+
+			for (int i = start; i < start + length; i++) {
+
+				double value = scans[ch + fChannels*i];
+				if (value == LJM_DUMMY_VALUE) continue;
+
+				sum += value;
+				n++;
+
+			}
+
+			// A window of only skipped scans repeats the last mean.
+			fMean[ch] = n > 0 ? sum / n : fPrevMean[ch];
+
+		}
+
+		// The time between the centres of this and the previous window.
+		double dt = 0.5 * (fPrevLength + length) / fScanRate;
+
+		for (int ch = 0; ch < fChannels; ch++) {
+
+			int bit = 0;
+
+			if (fConfig.threshold[ch] > 0 &&
+			    fabs(fMean[ch]) > fConfig.threshold[ch])
+				bit |= LJ_TRIGGER_THRESHOLD;
+
+			if (fHavePrev && fConfig.slewLimit[ch] > 0 &&
+			    fabs(fMean[ch] - fPrevMean[ch]) > fConfig.slewLimit[ch] * dt)
+				bit |= LJ_TRIGGER_SLEW;
+
+			if (bit && fFiredChannel < 0) fFiredChannel = ch;
+			fired |= bit;
+
+		}
+
+		for (int s = 0; s < fSensors; s++) {
+
+			const double *b = &fMean[3*s];
+			double magnitude = sqrt(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]);
+
+			// The reference is the mean magnitude of the previous block,
+			// so slow drifts do not fire but steps and transients do.
+			if (fHavePrevBlock && fConfig.magnitudeChange[s] > 0 &&
+			    fabs(magnitude - fPrevMagnitude[s]) > fConfig.magnitudeChange[s]) {
+
+				if (fFiredChannel < 0) fFiredChannel = 3*s;
+				fired |= LJ_TRIGGER_MAGNITUDE;
+
+			}
+
+			fMagnitudeSum[s] += magnitude;
+
+		}
+
+		fPrevMean.swap(fMean);
+		fPrevLength = length;
+		nWindows++;
+		fHavePrev = true;
+
+	}
+
+	if (nWindows > 0) {
+
+		for (int s = 0; s < fSensors; s++)
+			fPrevMagnitude[s] = fMagnitudeSum[s] / nWindows;
+		fHavePrevBlock = true;
+
+	}
+
+	return fired;
+}
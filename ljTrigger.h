@@ -0,0 +1,92 @@
+/********************************************************************\
+ Labjack software trigger
+
+ Decides, block by block, whether anything interesting happened in the
+ raw scans. The block is cut into short windows of a few scans, and the
+ mean of each channel over a window is checked against
+
+   * a threshold on |V| per channel,
+   * a slew limit on |dV/dt| per channel, between consecutive windows,
+   * a limit on the change of the vector magnitude of each x/y/z sensor,
+     relative to its mean magnitude over the previous block.
+
+ Averaging over a window keeps the sample-to-sample noise from firing
+ the slew and magnitude conditions at full scan rate. The last window of
+ each block is carried over, so conditions are also checked across block
+ boundaries.
+\********************************************************************/
+
+#ifndef LJTRIGGER_H
+#define LJTRIGGER_H
+
+#include <vector>
+
+// Bits of the mask returned by LJTrigger::Evaluate().
+#define LJ_TRIGGER_THRESHOLD	0x1
+#define LJ_TRIGGER_SLEW		0x2
+#define LJ_TRIGGER_MAGNITUDE	0x4
+
+struct LJTriggerConfig {
+
+	// |V| above which a channel fires, 0 to disable. One per channel.
+	std::vector<double> threshold;
+
+	// |dV/dt| in V/s above which a channel fires, 0 to disable. One per
+	// channel.
+	std::vector<double> slewLimit;
+
+	// Change of sqrt(x^2 + y^2 + z^2) in V which fires, 0 to disable. One
+	// per sensor; sensor s is channels 3s, 3s+1 and 3s+2.
+	std::vector<double> magnitudeChange;
+
+	// Number of scans averaged into one window.
+	int window;
+};
+
+class LJTrigger {
+
+public:
+
+	LJTrigger();
+
+	// Sets the conditions for nChannels channels streamed at scanRate, and
+	// forgets the previous block.
+	void Configure(const LJTriggerConfig &config, int nChannels,
+		       double scanRate);
+
+	// Checks one block of interleaved scans. Returns a mask of the
+	// LJ_TRIGGER_* conditions which fired, 0 if none did.
+	int Evaluate(const double *scans, int nScans);
+
+	// The first channel (for magnitude changes: the first channel of the
+	// sensor) which fired in the last call to Evaluate(), or -1.
+	int FiredChannel() const { return fFiredChannel; }
+
+private:
+
+	LJTriggerConfig fConfig;
+
+	int fChannels;
+	int fSensors;
+	double fScanRate;
+
+	// Window means, the means of the previous window, and the mean
+	// magnitude of each sensor over the previous block.
+	std::vector<double> fMean;
+	std::vector<double> fPrevMean;
+	std::vector<double> fPrevMagnitude;
+	std::vector<double> fMagnitudeSum;
+
+	// The number of scans in the previous window, which may be in the
+	// previous block, and shorter than the window when the block isn't a
+	// whole number of windows.
+	int fPrevLength;
+
+	// Whether there is a previous window (for the slew) and a previous
+	// block (for the magnitude) to compare with.
+	bool fHavePrev;
+	bool fHavePrevBlock;
+	int fFiredChannel;
+};
+
+#endif
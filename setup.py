@@ -0,0 +1,31 @@
+# Builds the LabJackT7 package from src/, with the _ljcore extension: the
+# C++ readout core of feLabjack02 (see src/ljCore.cxx). It links to the
+# LJM library, which labjack-ljm needs anyway.
+#
+# The extension is optional: if pybind11 is missing or it fails to build,
+# the package is installed without it, and only reads recorded data (see
+# LabJackCore).
+
+from setuptools import setup
+
+try:
+    from pybind11.setup_helpers import Pybind11Extension
+except ImportError:
+    Pybind11Extension = None
+
+ext_modules = []
+if Pybind11Extension is not None:
+    ext_modules.append(Pybind11Extension('LabJackT7._ljcore',
+                                         ['src/ljCore.cxx',
+                                          'ljLabjack.cxx',
+                                          'ljStreamConfig.cxx',
+                                          'ljChannels.cxx',
+                                          'ljStats.cxx'],
+                                         include_dirs=['.'],
+                                         libraries=['LabJackM'],
+                                         cxx_std=11,
+                                         optional=True))
+
+setup(packages=['LabJackT7'],
+      package_dir={'LabJackT7': 'src'},
+      ext_modules=ext_modules)
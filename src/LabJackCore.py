@@ -0,0 +1,79 @@
+# The readout core used by LabJackT7 and LabJackSession.
+#
+# This is the _ljcore extension, the C++ core of feLabjack02 (see
+# ljCore.cxx). If it can't be imported, e.g. because it wasn't built at
+# install or the LJM library it links against is missing, the package
+# still imports, so that recorded data (CSV files, sessions, the tap) can
+# be read, but nothing is streamed or reduced: an interactive read that
+# isn't set up and reduced as production is would quietly stop matching
+# it. A warning says why the extension is missing, and streaming, the
+# statistics and max_scan_rate raise a RuntimeError.
+#
+# NATIVE tells whether the extension is in use, and IMPORT_ERROR why it
+# couldn't be imported.
+
+import os
+import re
+import warnings
+
+try:
+    from ._ljcore import (FLUXGATE_CHANNELS, SKIPPED_SAMPLE, mean_std,
+                          robust_stats, max_scan_rate, Stream)
+    NATIVE = True
+    IMPORT_ERROR = None
+
+except ImportError as err:
+    NATIVE = False
+    IMPORT_ERROR = err
+
+    warnings.warn(f'The _ljcore extension could not be imported ({err}), '
+                  'so the LabJack can not be streamed; recorded data can '
+                  'still be read', RuntimeWarning)
+
+def require():
+    """
+        Raise a RuntimeError if the extension isn't there
+    """
+    if not NATIVE:
+        raise RuntimeError('This needs the _ljcore extension, which could not '
+                           f'be imported ({IMPORT_ERROR}); reinstall the '
+                           'package with a C++ compiler, pybind11 and LJM')
+
+if not NATIVE:
+
+    def _channel_table():
+        """
+            LJ_FLUXGATE_CHANNELS from ljLabjack.cxx, next to src/ in the
+            repository the package is installed from, or [] if it isn't there
+        """
+        path = os.path.join(os.path.dirname(os.path.dirname(os.path.realpath(__file__))),
+                            'ljLabjack.cxx')
+        try:
+            with open(path, 'r') as fid:
+                text = fid.read()
+        except OSError:
+            return []
+
+        table = re.search(r'LJ_FLUXGATE_CHANNELS\[\]\s*=\s*\{(.*?)\};', text, re.S)
+        if table is None:
+            return []
+        return re.findall(r'"(\w+)"', table.group(1))
+
+    # all possible channels, x, y, z of CH1, then CH2, ...
+    FLUXGATE_CHANNELS = _channel_table()
+
+    # LJM_DUMMY_VALUE, the value of every sample of a skipped scan
+    SKIPPED_SAMPLE = -9999.0
+
+    def mean_std(scans):
+        require()
+
+    def robust_stats(scans, clip_sigma=3.0, iterations=3):
+        require()
+
+    def max_scan_rate(resolution_index, ranges, settling_us=0.0):
+        require()
+
+    class Stream(object):
+        def __init__(self, handle):
+            require()
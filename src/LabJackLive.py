@@ -0,0 +1,248 @@
+# Live plotting of a continuous stream of scans.
+#
+# The scans go into a ring of min/max envelopes rather than a ring of the
+# scans themselves: every bin of scans which shares a pixel column of the
+# plot is reduced to its minimum and maximum as it arrives, so a frame only
+# draws a point per column and channel, however fast the channels are
+# scanned. Each channel is drawn as a line through the middle of its bins
+# over a filled band of the envelope, which Agg draws several times faster
+# than a line zigzagging between the minima and maxima. Acquisition and drawing are decoupled: a thread reads blocks
+# into the ring as fast as they come, and the plot is redrawn at a fixed
+# frame rate from whatever the ring holds then.
+
+import threading
+import time
+
+from matplotlib.collections import PolyCollection
+import matplotlib.pyplot as plt
+import numpy as np
+
+SKIPPED_SAMPLE = -9999.0
+
+class EnvelopeRing(object):
+    """
+        Ring of the min/max envelope of the last window of a stream
+
+        ATTRIBUTES
+
+        bin_scans       int, number of scans reduced to each bin
+        nbins           int, number of bins in the ring
+        nchannels       int, number of channels
+        scans           int, total number of scans added
+    """
+
+    def __init__(self, nchannels, window_scans, nbins):
+        """
+            nchannels:      number of channels
+            window_scans:   number of scans in the window shown
+            nbins:          number of bins to reduce the window to, e.g. the
+                            width of the plot in pixels
+        """
+
+        self.nchannels = nchannels
+        self.bin_scans = max(1, int(np.ceil(window_scans/nbins)))
+        self.nbins = int(np.ceil(window_scans/self.bin_scans))
+        self.scans = 0
+
+        self._min = np.full((nchannels, self.nbins), np.nan)
+        self._max = np.full((nchannels, self.nbins), np.nan)
+        self._bins = 0                                  # complete bins added
+
+        # scans of the bin being filled
+        self._pending = np.empty((nchannels, self.bin_scans))
+        self._npending = 0
+
+    def append(self, block):
+        """
+            Add a block of scans, of shape (nchannels, nscans). Skipped samples
+            (-9999) leave a gap.
+        """
+
+        block = np.where(block == SKIPPED_SAMPLE, np.nan, block)
+        nscans = block.shape[1]
+        self.scans += nscans
+
+        # complete the pending bin first
+        start = 0
+        if self._npending:
+            n = min(self.bin_scans - self._npending, nscans)
+            self._pending[:, self._npending:self._npending+n] = block[:, :n]
+            self._npending += n
+            start = n
+            if self._npending == self.bin_scans:
+                self._push(self._pending[:, None, :])
+                self._npending = 0
+
+        # then as many whole bins as there are, reduced at once
+        nfull = (nscans - start) // self.bin_scans
+        if nfull:
+            end = start + nfull*self.bin_scans
+            self._push(block[:, start:end].reshape(self.nchannels, nfull, self.bin_scans))
+            start = end
+
+        rest = nscans - start
+        if rest:
+            self._pending[:, :rest] = block[:, start:]
+            self._npending = rest
+
+    def _push(self, bins):
+        """Reduce bins of shape (nchannels, n, bin_scans) into the ring"""
+
+        # fmin/fmax ignore the skipped samples, unless the whole bin is skipped
+        lo = np.fmin.reduce(bins, axis=2)
+        hi = np.fmax.reduce(bins, axis=2)
+
+        n = lo.shape[1]
+        if n > self.nbins:
+            lo, hi = lo[:, -self.nbins:], hi[:, -self.nbins:]
+            self._bins += n - self.nbins
+            n = self.nbins
+
+        pos = self._bins % self.nbins
+        first = min(n, self.nbins - pos)
+        self._min[:, pos:pos+first] = lo[:, :first]
+        self._max[:, pos:pos+first] = hi[:, :first]
+        self._min[:, :n-first] = lo[:, first:]
+        self._max[:, :n-first] = hi[:, first:]
+        self._bins += n
+
+    def envelope(self):
+        """
+            Return the bins in time order as (min, max), each of shape
+            (nchannels, nbins); bins not filled yet are nan
+        """
+
+        pos = self._bins % self.nbins
+        order = np.r_[pos:self.nbins, 0:pos]
+        return (self._min[:, order], self._max[:, order])
+
+class LivePlot(object):
+    """
+        Live plot of the last window of a stream, redrawn at a fixed frame rate
+
+        ATTRIBUTES
+
+        channel_ids     list of strings, legend of the channels
+        fps             float, frames per second drawn
+        ring            EnvelopeRing, the envelopes shown
+        scan_rate       float, Hz
+    """
+
+    def __init__(self, read, channel_ids, scan_rate, window=1, fps=30, width=1000):
+        """
+            read:           function returning the next block of scans, of shape
+                            (nchannels, nscans). It is called from a thread of its
+                            own, and should release the GIL while it waits.
+            channel_ids:    names of the channels, for the legend
+            scan_rate:      Hz
+            window:         s, length of the window shown
+            fps:            frames per second drawn
+            width:          number of min/max bins across the window
+        """
+
+        self.channel_ids = channel_ids
+        self.scan_rate = scan_rate
+        self.fps = fps
+        self.ring = EnvelopeRing(len(channel_ids), int(scan_rate*window), width)
+
+        self._read = read
+        self._lock = threading.Lock()
+        self._running = False
+        self._error = None
+
+        # each bin is drawn at its start
+        self._t = np.arange(self.ring.nbins) * self.ring.bin_scans / scan_rate
+
+    def _acquire(self):
+        try:
+            while self._running:
+                block = self._read()
+                with self._lock:
+                    self.ring.append(block)
+        except Exception as err:
+            self._error = err
+            self._running = False
+
+    def _band(self, lo, hi):
+        """
+            Polygons of the envelope of a channel, one per run of bins which
+            aren't nan (a nan would break the polygon)
+        """
+
+        good = np.isfinite(lo)
+        edges = np.flatnonzero(np.diff(np.r_[False, good, False]))
+        t = self._t
+        return [np.c_[np.r_[t[a:b], t[a:b][::-1]], np.r_[lo[a:b], hi[a:b][::-1]]]
+                for a, b in zip(edges[0::2], edges[1::2])]
+
+    def run(self):
+        """
+            Start acquiring and draw until the figure is closed. Returns the
+            number of scans read.
+        """
+
+        plt.clf()
+        fig = plt.gcf()
+        ax = plt.gca()
+        lines = [ax.plot(self._t, np.full(self._t.shape, np.nan), label=c, animated=True)[0]
+                 for c in self.channel_ids]
+        bands = [ax.add_collection(PolyCollection([], facecolors=line.get_color(),
+                                                  alpha=0.3, linewidths=0, animated=True))
+                 for line in lines]
+        ax.set_xlim(self._t[0], self._t[-1])
+        ax.set_ylim(-1, 1)
+        ax.legend(loc='upper left')
+        title = ax.set_title('')
+        ax.set_xlabel('Time in window (s)')
+        plt.show(block=False)
+
+        self._running = True
+        thread = threading.Thread(target=self._acquire, daemon=True)
+        thread.start()
+
+        background = None
+        period = 1/self.fps
+
+        try:
+            while self._running and plt.fignum_exists(fig.number):
+                start = time.time()
+                with self._lock:
+                    ylo, yhi = self.ring.envelope()
+
+                for line, band, lo, hi in zip(lines, bands, ylo, yhi):
+                    line.set_ydata((lo + hi)/2)
+                    band.set_verts(self._band(lo, hi))
+
+                # a full redraw only when the axes have to change, otherwise
+                # only the lines are drawn over the saved background
+                ymin, ymax = ax.get_ylim()
+                if np.isfinite(ylo).any():
+                    lo, hi = np.nanmin(ylo), np.nanmax(yhi)
+                else:
+                    lo, hi = ymin, ymax
+                if background is None or lo < ymin or hi > ymax:
+                    margin = 0.1*(hi - lo) if hi > lo else 0.1
+                    ax.set_ylim(lo - margin, hi + margin)
+                    title.set_text(f'{self.scan_rate:g} Hz, {self.ring.bin_scans} scans per point')
+                    fig.canvas.draw()
+                    background = fig.canvas.copy_from_bbox(ax.bbox)
+                else:
+                    fig.canvas.restore_region(background)
+
+                for band, line in zip(bands, lines):
+                    ax.draw_artist(band)
+                    ax.draw_artist(line)
+                fig.canvas.blit(ax.bbox)
+                fig.canvas.flush_events()
+
+                # draws at the frame rate, not at the rate the blocks come in
+                plt.pause(max(period - (time.time() - start), 1e-3))
+
+        finally:
+            self._running = False
+            thread.join(timeout=5)
+
+        if self._error is not None:
+            raise self._error
+
+        return self.ring.scans
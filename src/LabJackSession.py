@@ -0,0 +1,238 @@
+# On-disk store for long LabJackT7 capture sessions.
+#
+# LabJackT7.read keeps every stream in memory, which a multi-hour session
+# doesn't fit in. A session instead appends every stream to disk as it is
+# read, and keeps only an index of where each stream is; streams are read
+# back one at a time when they are asked for.
+#
+# A session is a directory of chunk files, each of which is a tap archive
+# (see ljTap.h): a names frame, then a data frame per stream, with the raw
+# scans as read from the device. A chunk is therefore also a recording the
+# frontend can replay (see ljReplay.h). A new chunk is started when the
+# current one reaches the chunk size, so no single file grows without bound.
+
+from datetime import datetime
+import glob
+import os
+
+import numpy as np
+import pandas as pd
+
+from . import LabJackCore as ljcore
+from .LabJackTap import LabJackTap, DATA, NAMES, FRAME_MAGIC, NAME_LENGTH
+
+def channel_id(name):
+    """
+        Human-readable id of an AIN channel, e.g. CH1x for AIN73, or the name
+        itself if it isn't a fluxgate input
+    """
+    if name not in ljcore.FLUXGATE_CHANNELS:
+        return name
+    i = ljcore.FLUXGATE_CHANNELS.index(name)
+    return f'CH{i//3+1}{"xyz"[i%3]}'
+
+class LabJackSession(object):
+    """
+        Chunked on-disk store of the streams of a capture session
+
+        ATTRIBUTES
+
+        channel_ids     list of strings, formated as CH1x, corresponding to channel_names
+        channel_names   list of strings, AIN channel of each column of the scans
+        chunk_bytes     int, size at which a new chunk file is started
+        path            string, directory of the chunk files
+
+        Streams are numbered in the order they were appended, over all chunks.
+    """
+
+    FRAME = LabJackTap.FRAME
+    CHUNK = 'chunk%05d.tap'
+
+    def __init__(self, path, channel_names=None, chunk_mb=256):
+        """
+            Open a session
+
+            path:           directory of the session. Existing chunks in it are
+                            indexed, and new streams are appended after them.
+            channel_names:  AIN channels of the streams to append. If None, they
+                            are taken from the existing chunks, and the session
+                            can only be appended to with the same channels.
+            chunk_mb:       size of a chunk file in MB
+        """
+
+        self.path = path
+        self.chunk_bytes = int(chunk_mb*1024*1024)
+        self.channel_names = channel_names
+
+        # per stream: (chunk, offset of the scans, nscans, time, scan_rate,
+        # device_backlog, ljm_backlog)
+        self._index = []
+        self._chunks = []
+        self._fid = None
+
+        os.makedirs(path, exist_ok=True)
+        for chunk in sorted(glob.glob(os.path.join(path, self.CHUNK.replace('%05d', '*')))):
+            self._index_chunk(chunk)
+
+        if self.channel_names is None:
+            raise RuntimeError(f'No channels given and no chunks in {path}')
+
+        self.channel_ids = [channel_id(name) for name in self.channel_names]
+
+    def __len__(self):          return len(self._index)
+    def __getitem__(self, idx): return self.stream(idx)
+
+    def __iter__(self):
+        for i in range(len(self)):
+            yield self.stream(i)
+
+    def __enter__(self):        return self
+    def __exit__(self, *args):  self.close()
+
+    def _index_chunk(self, chunk):
+        """
+            Add the streams of a chunk to the index, reading only the frame
+            headers. A frame cut short (e.g. by a crash while writing) ends it.
+        """
+
+        size = os.path.getsize(chunk)
+        chunk_id = len(self._chunks)
+        self._chunks.append(chunk)
+
+        with open(chunk, 'rb') as fid:
+            offset = 0
+            while offset + self.FRAME.size <= size:
+                fid.seek(offset)
+                header = self.FRAME.unpack(fid.read(self.FRAME.size))
+
+                if (header[0] != FRAME_MAGIC or header[3] < self.FRAME.size
+                        or offset + header[3] > size):
+                    break
+
+                if header[1] == NAMES:
+                    names = fid.read(header[4]*NAME_LENGTH)
+                    names = [names[i*NAME_LENGTH:(i+1)*NAME_LENGTH].rstrip(b'\0').decode()
+                             for i in range(header[4])]
+                    if self.channel_names is None:
+                        self.channel_names = names
+                    elif names != list(self.channel_names):
+                        raise RuntimeError(f'{chunk} has channels {names}, not {self.channel_names}')
+
+                elif header[1] == DATA:
+                    self._index.append((chunk_id, offset + self.FRAME.size, header[8],
+                                        header[6], header[7], header[9], header[10]))
+
+                offset += header[3]
+
+    def _frame(self, type, nchannels, nscans=0, time=0, scan_rate=0,
+               device_backlog=0, ljm_backlog=0, payload=0):
+        return self.FRAME.pack(FRAME_MAGIC, type, 0, self.FRAME.size + payload,
+                               nchannels, len(self), time, scan_rate, nscans,
+                               device_backlog, ljm_backlog, 0)
+
+    def _new_chunk(self):
+
+        if self._fid is not None:
+            self._fid.close()
+
+        chunk = os.path.join(self.path, self.CHUNK % len(self._chunks))
+        self._chunks.append(chunk)
+        self._fid = open(chunk, 'wb')
+
+        names = b''.join(name.encode()[:NAME_LENGTH].ljust(NAME_LENGTH, b'\0')
+                         for name in self.channel_names)
+        self._fid.write(self._frame(NAMES, len(self.channel_names), payload=len(names)))
+        self._fid.write(names)
+
+    def append(self, time, scan_rate, data, device_backlog=0, ljm_backlog=0):
+        """
+            Write a stream to the session, and return its number
+
+            time:           unix time of the read
+            scan_rate:      Hz
+            data:           raw scans, of shape (nchannels, nscans) as returned by
+                            LabJackCore.Stream.read
+        """
+
+        data = np.asarray(data)
+        nchannels, nscans = data.shape
+        if nchannels != len(self.channel_names):
+            raise RuntimeError(f'Stream has {nchannels} channels, the session {len(self.channel_names)}')
+
+        if self._fid is None or self._fid.tell() >= self.chunk_bytes:
+            self._new_chunk()
+
+        scans = np.ascontiguousarray(data.T, dtype='<f8')
+        self._fid.write(self._frame(DATA, nchannels, nscans, time, scan_rate,
+                                    device_backlog, ljm_backlog, scans.nbytes))
+        offset = self._fid.tell()
+        scans.tofile(self._fid)
+
+        # streams written so far stay readable if the session dies
+        self._fid.flush()
+
+        self._index.append((len(self._chunks)-1, offset, nscans, time, scan_rate,
+                            device_backlog, ljm_backlog))
+        return len(self) - 1
+
+    def close(self):
+        """
+            Close the chunk being written. The session can still be read.
+        """
+        if self._fid is not None:
+            self._fid.close()
+            self._fid = None
+
+    @property
+    def index(self):
+        """
+            pd.DataFrame with a row per stream: start time, scan rate, number of
+            scans, backlogs after the read, and where it is stored
+        """
+        columns = ['chunk', 'offset', 'nscans', 'time', 'scan_rate',
+                   'device_backlog', 'ljm_backlog']
+        df = pd.DataFrame(self._index, columns=columns)
+        df['chunk'] = [os.path.basename(self._chunks[c]) for c in df['chunk']]
+        df['time'] = pd.to_datetime(df['time'], unit='s')
+        return df
+
+    @property
+    def stream_times(self):
+        """
+            Start time of each stream, as in LabJackT7.stream_times
+        """
+        return [str(datetime.fromtimestamp(entry[3])) for entry in self._index]
+
+    def scans(self, idx, mmap=False):
+        """
+            Raw scans of a stream, as np.array of shape (nscans, nchannels)
+
+            mmap:   if True, map the scans from the chunk file rather than read them
+        """
+
+        chunk, offset, nscans = self._index[idx][:3]
+        shape = (nscans, len(self.channel_names))
+
+        if self._fid is not None:
+            self._fid.flush()
+
+        if mmap:
+            return np.memmap(self._chunks[chunk], dtype='<f8', mode='r',
+                             offset=offset, shape=shape)
+
+        with open(self._chunks[chunk], 'rb') as fid:
+            fid.seek(offset)
+            return np.fromfile(fid, dtype='<f8', count=shape[0]*shape[1]).reshape(shape)
+
+    def stream(self, idx):
+        """
+            Load a stream as a pd.DataFrame, as in LabJackT7.data
+        """
+
+        scan_rate = self._index[idx][4]
+        scans = self.scans(idx)
+
+        df = pd.DataFrame(-1*scans, columns=self.channel_ids,   # the sign flip of LabJackT7.read
+                          index=np.arange(scans.shape[0])/scan_rate)
+        df.index.name = 'dt (s)'
+        return df
@@ -16,7 +16,9 @@
 """
 
 from labjack import ljm
-import matplotlib.pyplot as plt
+from . import LabJackCore as ljcore
+from .LabJackSession import LabJackSession
+from .LabJackLive import LivePlot
 from datetime import datetime
 import numpy as np
 import pandas as pd
@@ -39,11 +41,21 @@ class LabJackT7(object):
         IP              string, IP address of device
         lj_handle       handle address for labjack object
         MAX_SAMPLE_RATE float, max rate, specific to device type
+        max_scan_rate   float, max scan rate for the channels and STREAM_SETTINGS, None
+                        without the _ljcore extension
         n_addresses     length of channel_names
         
         scan_list       list of addresses for each name      
         scan_rate       float, scan rate of stream read
+        session         LabJackSession, if not None the streams are saved to 
+                        disk there instead of to self.data
+        stream          LabJackCore.Stream, the native stream of the frontend
         stream_times    list of strings, start times of each stream in self.data
+        
+        The stream is configured, read and de-interleaved by the C++ core of 
+        the feLabjack02 frontend (the _ljcore extension), so that a read here
+        is set up exactly as production is. Without the extension it goes 
+        through the ljm package instead (see LabJackCore).
     """
     
     # device settings
@@ -53,7 +65,8 @@ class LabJackT7(object):
     IP = "142.90.100.26"         # IP address of device VLAN1
     MAX_SAMPLE_RATE = 1e5       # for T7
     
-    # stream settings from feLabjack02
+    # stream settings, written by the same code as in feLabjack02. The
+    # trigger and clock source are fixed there, as here.
     STREAM_SETTINGS = { 'STREAM_TRIGGER_INDEX':     0,                  # Controls when stream scanning will start. 0 = Start when stream is enabled
                         'STREAM_CLOCK_SOURCE':      0,                  # Controls which clock source will be used to run the main stream clock. 0 = Internal crystal, 2 = External clock source on CIO3.
                         'STREAM_RESOLUTION_INDEX':  0,                  # The resolution index for stream readings. A larger resolution index generally results in lower noise and longer sample times
@@ -62,18 +75,9 @@ class LabJackT7(object):
                         'AIN_ALL_NEGATIVE_CH':      ljm.constants.GND,  #  write to this global parameter affects all AIN. Writing 1 will set all AINs to differential. Writing 199 (GND) will set all AINs to single-ended. A read will return 1 if all AINs are set to differential and 199 if all AINs are set to single-ended. If AIN configurations are not consistent 0xFFFF will be returned.
                       }
                       
-    # all possible channels  x        y        z		
-    CHANNEL_NAMES = [	    "AIN73", "AIN75", "AIN77",  # CH1
-                            "AIN72", "AIN74", "AIN76",  # CH2
-                            "AIN79", "AIN81", "AIN83",  # CH3
-                            "AIN78", "AIN80", "AIN82",  # CH4
-                            "AIN99", "AIN101","AIN103", # CH5
-                            "AIN96", "AIN98", "AIN100", # CH6
-                            "AIN107","AIN109","AIN110", # CH7
-                            "AIN102","AIN104","AIN106", # CH8
-                            "AIN115","AIN117","AIN119", # CH9
-                            "AIN108","AIN111","AIN113"  # CH10
-                    ]
+    # all possible channels, x, y, z of CH1, then CH2, ... (LJ_FLUXGATE_CHANNELS 
+    # in ljLabjack.cxx)
+    CHANNEL_NAMES = list(ljcore.FLUXGATE_CHANNELS)
 
     def __init__(self, channel_list=None): 
         """
@@ -83,6 +87,8 @@ class LabJackT7(object):
         """
         
         # set up channel names and ids
+        if not self.CHANNEL_NAMES:
+            ljcore.require()
         self.channel_names = [self.CHANNEL_NAMES[(i-1)*3:i*3] for i in channel_list]
         self.channel_names = np.concatenate(self.channel_names).tolist()
         self.channel_ids = []
@@ -95,11 +101,16 @@ class LabJackT7(object):
         # get ready for stream configuration
         self.n_addresses = len(self.channel_names)
         self.scan_list = ljm.namesToAddresses(self.n_addresses, self.channel_names)[0]        
-        self.max_scan_rate = self.MAX_SAMPLE_RATE/self.n_addresses
+        self.max_scan_rate = None
+        if ljcore.NATIVE:
+            self.max_scan_rate = ljcore.max_scan_rate(self.STREAM_SETTINGS['STREAM_RESOLUTION_INDEX'],
+                                                       self._ranges(),
+                                                       self.STREAM_SETTINGS['STREAM_SETTLING_US'])
         
         # initilize results
         self.data = []
         self.stream_times = []
+        self.session = None
 
     def connect(self):
         """
@@ -111,8 +122,12 @@ class LabJackT7(object):
         device, connection, serial, IP, port, bytesperMB = ljm.getHandleInfo(self.lj_handle)
         
         # set stream settings
-        for key, value in self.STREAM_SETTINGS.items():
-            ljm.eWriteName(self.lj_handle, key, value)
+        self.stream = ljcore.Stream(self.lj_handle)
+        self.stream.configure(self.channel_names, 
+                              resolution_index = self.STREAM_SETTINGS['STREAM_RESOLUTION_INDEX'],
+                              settling_us = self.STREAM_SETTINGS['STREAM_SETTLING_US'],
+                              ranges = self._ranges(),
+                              negative_channels = [self.STREAM_SETTINGS['AIN_ALL_NEGATIVE_CH']]*self.n_addresses)
         
         if DEBUG:
             print_lines = ( f"Opened a LabJack",
@@ -129,65 +144,92 @@ class LabJackT7(object):
         """
             Stop connection
         """        
+        self.stream = None
         ljm.close(self.lj_handle)
         
     
-    def draw(self, scan_rate=1500, scan_duration=1):
+    def draw(self, scan_rate=1500, scan_duration=1, fps=30, width=1000):
         """
-            Draw the result in realtime
+            Draw the stream in realtime, until the figure is closed
             
             scan rate in hz
-            scan duration in s
+            scan duration in s, length of the window shown
+            fps:    frames per second drawn
+            width:  number of points across the window; each is the min and 
+                    max of the scans it covers (see LabJackLive)
+            
+            The stream runs continuously while drawing, and is read in blocks 
+            of about a frame, independently of the drawing.
         """
         
-        # get initial data
-        _, data = self.read(scan_rate, int(scan_rate*scan_duration), save=False)
-        data = data[0]
-        
-        plt.clf()
-        fig = plt.gcf()
-        lines = [plt.plot(data.index, data[c], label=c)[0] for c in data.columns]
-        plt.legend()
-        plt.xlabel('Time after trigger (s)')
-        plt.show(block=False)
-        plt.pause(scan_duration*0.01)
-
-        try:
-            while True:
-                _, data = self.read(scan_rate, int(scan_rate*scan_duration), save=False)
-                data = data[0]
-                
-                for line, c in zip(lines, data.columns):
-                    line.set_ydata(data[c])
-                fig.canvas.draw()  
-                plt.pause(scan_duration*0.01)
+        # check input
+        ljcore.require()
+        if scan_rate > self.max_scan_rate:
+            raise RuntimeError(f"scan_rate ({scan_rate}) exceeds max_scan_rate ({self.max_scan_rate}).")
+        
+        if getattr(self, 'stream', None) is None:
+            self.connect()
+        
+        scan_rate = self.stream.start(self.channel_names, 
+                                      max(1, int(scan_rate/fps)), 
+                                      scan_rate)
         
+        # the sign flip of read
+        live = LivePlot(lambda: -1*self.stream.read()[0], self.channel_ids, 
+                        scan_rate, window=scan_duration, fps=fps, width=width)
+        
+        try:
+            live.run()
         finally:
+            self.stream.stop()
             self.disconnect()
         
     def get_data(self):         return self.data
     def get_stream_times(self): return self.stream_times
     
+    def _streams(self):
+        """
+            Number of saved streams and a function returning one of them, from 
+            the session if there is one
+        """
+        if self.session is not None:
+            return (len(self.session), self.session.stream)
+        return (len(self.data), self.data.__getitem__)
+    
+    def _stream_times(self):
+        if self.session is not None:
+            return self.session.stream_times
+        return self.stream_times
+    
+    def _ranges(self):
+        """
+            Range of each channel, from STREAM_SETTINGS
+        """
+        return [float(self.STREAM_SETTINGS['AIN_ALL_RANGE'])]*self.n_addresses
+    
     def read(self, scan_rate=1500, scan_length=100, nreads=1, save=True):
         """
             Read data from labjack and append to internal data structures: self.data and self.stream_times 
-            scan_rate:      Hz, must be less than 100000/(n_addreses*2)
+            scan_rate:      Hz, must be at most max_scan_rate
             scan_length:    number of measurements in each scan
             nreads:         number of stream reads to conduct before closing stream
+            
+            In a session (start_session), each stream is written to the session 
+            as soon as it is read rather than kept, and the streams returned are 
+            their numbers in self.session, to be loaded from there.
         """
         
         # check input
+        ljcore.require()
         if scan_rate > self.max_scan_rate:
             raise RuntimeError(f"scan_rate ({scan_rate}) exceeds max_scan_rate ({self.max_scan_rate}).")
         
         # configure and start stream
         try:
-            scan_rate = ljm.eStreamStart(self.lj_handle, 
-                                         scan_length, 
-                                         self.n_addresses, 
-                                         self.scan_list, 
-                                         scan_rate)
-        except ljm.LJMError as err:
+            scan_rate = self.stream.start(self.channel_names, 
+                                          scan_length, 
+                                          scan_rate)
+        except RuntimeError as err:
             if '1224' in str(err):
                 self.connect()
                 return self.read(scan_rate, scan_length, nreads)
@@ -205,15 +247,19 @@ class LabJackT7(object):
             print("\nPerforming %i stream reads." % nreads)
             print('')
             
+        spill = save and self.session is not None
         all_data = {}
+        session_streams = []
+        times_all = []
         for i in tqdm(range(1, nreads+1), desc='Stream reads', leave=DEBUG):
                        
             # read data
             start_date = datetime.now()
             start = ljm.getHostTick()
-            ret = ljm.eStreamRead(self.lj_handle)
+            ret = self.stream.read()
             end = ljm.getHostTick()
 
+            # de-interleaved by the native reader, shape (n_addresses, scan_length)
             data = ret[0]            
             
             if DEBUG:
@@ -222,13 +268,13 @@ class LabJackT7(object):
                 
                 # get scan rate
                 t = (end-start)/1e6
-                scan_rate_measured = len(data)/t/self.n_addresses
-                scans = len(data)/self.n_addresses
+                scan_rate_measured = data.size/t/self.n_addresses
+                scans = data.shape[1]
                         
                 # Count the skIPped samples which are indicated by -9999 values. Missed
                 # samples occur after a device's stream buffer overflows and are
                 # reported after auto-recover mode ends.
-                current_skipped = data.count(-9999.0)
+                current_skipped = np.count_nonzero(data == ljcore.SKIPPED_SAMPLE)
                 
                 # print summary
                 print(f'  measured scan rate:   {scan_rate_measured} Hz')
@@ -237,20 +283,28 @@ class LabJackT7(object):
                 print(f'  scan backlogs:        Device ({ret[1]}), LJM ({ret[2]})')
                 print(f'  start:                {start_date}')
             
-            all_data[str(start_date)] = data
+            if spill:
+                session_streams.append(self.session.append(start_date.timestamp(), 
+                                                           scan_rate, data, 
+                                                           ret[1], ret[2]))
+                times_all.append(str(start_date))
+            else:
+                all_data[str(start_date)] = data
             
-        ljm.eStreamStop(self.lj_handle)
+        self.stream.stop()
         
         if DEBUG:
             print('\nStream stopped')
+            
+        if spill:
+            self.scan_rate = scan_rate
+            return (times_all, session_streams)
 
         # process data: split into arrays, save as data frame
         index = np.arange(0, scan_length/scan_rate, 1/scan_rate)
         df_all = []
-        times_all = []
-        for date, data in all_data.items():
-            df = {ch: data[i::self.n_addresses] for i, ch in enumerate(self.channel_names)}
-            df = pd.DataFrame(df, index=index)
+        for date, channels in all_data.items():
+            df = pd.DataFrame(dict(zip(self.channel_names, channels)), index=index)
             df = -1*df #correcting for weird negative that all the data seems to get
             df.rename(columns={n:i for n, i in zip(self.channel_names, self.channel_ids)}, inplace=True)
             df.index.name = 'dt (s)'
@@ -265,12 +319,62 @@ class LabJackT7(object):
         
         return (times_all, df_all)
         
+    def stats(self, idx=-1, robust=False):
+        """
+            Statistics of each channel of a saved stream (in self.data, or in 
+            the session if there is one), taken with the kernels of the frontend
+            
+            idx:    index of the stream
+            robust: if False, return the mean and std as in the LBJK bank, 
+                    otherwise the median, MAD, clipped mean, clipped std and
+                    number of rejected scans as in the LBRS bank
+                    
+            returns pd.DataFrame with a row per channel
+        """
+        
+        df = self._streams()[1](idx)
+        scans = np.ascontiguousarray(df.to_numpy(dtype=float))
+        
+        if robust:
+            values = ljcore.robust_stats(scans)
+            columns = ['median', 'mad', 'clipped_mean', 'clipped_std', 'rejected']
+            return pd.DataFrame(values, index=df.columns, columns=columns)
+        
+        mean, std = ljcore.mean_std(scans)
+        return pd.DataFrame({'mean': mean, 'std': std}, index=df.columns)
+        
     def reset(self):
         """
-            Erase internal data lists
+            Erase internal data lists. A session is stopped, but its files are kept.
         """
         self.data = []
         self.stream_times = []
+        self.stop_session()
+        
+    def start_session(self, path, chunk_mb=256):
+        """
+            Save the streams of the following reads to disk rather than to 
+            self.data, for sessions too long to keep in memory
+            
+            path:       directory of the session, see LabJackSession. If it 
+                        already holds a session with the same channels, the 
+                        streams are appended to it.
+            chunk_mb:   size of the chunk files in MB
+            
+            returns the LabJackSession, also in self.session
+        """
+        self.stop_session()
+        self.session = LabJackSession(path, self.channel_names, chunk_mb)
+        return self.session
+        
+    def stop_session(self):
+        """
+            Close the session. Its streams stay in the files, and can be opened 
+            with LabJackSession(path).
+        """
+        if self.session is not None:
+            self.session.close()
+            self.session = None
         
     def to_csv(self, filename, idx=-2):
         """
@@ -280,11 +384,14 @@ class LabJackT7(object):
             if idx < 0, then write all streams to file, else write stream of that index to file
         """
         
-        if len(self.data) == 1:
+        nstreams, stream = self._streams()
+        stream_times = self._stream_times()
+        
+        if nstreams == 1:
             idx = 0
         
         # check that data exists
-        if len(self.data) == 0:
+        if nstreams == 0:
             raise RuntimeError('No data saved')
         
         # write file header
@@ -313,15 +420,15 @@ class LabJackT7(object):
         # write a single stream
         if idx >= -1:
             with open(filename, 'a+') as fid:
-                fid.write(f'# START stream {self.stream_times[idx]}\n#\n')
-            self.data[idx].to_csv(filename, mode='a+')
+                fid.write(f'# START stream {stream_times[idx]}\n#\n')
+            stream(idx).to_csv(filename, mode='a+')
             
-        # write a set of streams
+        # write a set of streams, loading one at a time
         else:
-            for dat, start in zip(self.data, self.stream_times):
+            for i, start in enumerate(stream_times):
                 with open(filename, 'a+') as fid:
                     fid.write(f'START stream {start}\n')
-                dat.to_csv(filename, mode='a+')
+                stream(i).to_csv(filename, mode='a+')
         
 def from_csv(filename):
     """
@@ -0,0 +1,223 @@
+# Reads the live data tap of the feLabjack02 MIDAS frontend.
+#
+# While the frontend is running it holds the connection to the LabJack, so
+# LabJackT7 can't open the device. The frontend instead publishes every
+# block it reads to a shared memory ring (and optionally a local socket),
+# which this class reads. The binary layout is documented in ljTap.h.
+
+from datetime import datetime
+import mmap
+import os
+import socket
+import struct
+import time
+
+import numpy as np
+import pandas as pd
+
+# frame types
+DATA = 0
+NAMES = 1
+PAD = 2
+
+FRAME_MAGIC = 0x46544A4C
+NAME_LENGTH = 16
+
+class LabJackTap(object):
+    """
+        Reader for the live data tap of the feLabjack02 frontend
+
+        ATTRIBUTES
+
+        address         string, socket address if reading from a socket
+        channel_names   list of strings, names of the channels in each block
+        shm             string, name of the shared memory ring
+
+        Blocks are returned as dicts with keys:
+
+        data            np.array of shape (nscans, nchannels), in volts
+        device_backlog  int, device scan backlog after the read
+        ljm_backlog     int, LJM scan backlog after the read
+        scan_rate       float, Hz
+        sequence        int, block number since the frontend started
+        time            float, unix time of the read
+    """
+
+    FRAME = struct.Struct('<IHHIIQddIiiI')
+    SHM_HEADER = struct.Struct('<8sIIQQQQII')
+
+    def __init__(self, shm='/labjack02_tap', address=None):
+        """
+            Initialize object
+
+            shm:        name of the shared memory ring, as in the Tap/SharedMemory
+                        setting of the frontend
+            address:    if not None, read from this socket instead of the shared
+                        memory: "unix:/path/to/socket" or "tcp:port"
+        """
+
+        self.shm = shm
+        self.address = address
+        self.channel_names = []
+
+        if address is None: self._open_shm()
+        else:               self._open_socket()
+
+    def _open_shm(self):
+
+        with open(os.path.join('/dev/shm', self.shm.lstrip('/')), 'rb') as fid:
+            self._mm = mmap.mmap(fid.fileno(), 0, access=mmap.ACCESS_READ)
+
+        magic, version, header_size, capacity, _, _, last, nchannels, _ = \
+                                        self.SHM_HEADER.unpack_from(self._mm, 0)
+
+        if magic.rstrip(b'\0') != b'LJTAP':
+            raise RuntimeError(f'{self.shm} is not a LabJack tap')
+        if version != 1:
+            raise RuntimeError(f'Unsupported tap version {version}')
+
+        self._header_size = header_size
+        self._capacity = capacity
+        self._pos = last
+
+        names = self._mm[self.SHM_HEADER.size:self.SHM_HEADER.size+nchannels*NAME_LENGTH]
+        self.channel_names = self._split_names(names, nchannels)
+
+    def _open_socket(self):
+
+        if self.address.startswith('unix:'):
+            self._sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self._sock.connect(self.address[5:])
+        elif self.address.startswith('tcp:'):
+            self._sock = socket.create_connection(('127.0.0.1', int(self.address[4:])))
+        else:
+            raise RuntimeError(f'Unknown tap address {self.address}')
+
+    def _split_names(self, names, nchannels):
+        return [bytes(names[i*NAME_LENGTH:(i+1)*NAME_LENGTH]).rstrip(b'\0').decode()
+                for i in range(nchannels)]
+
+    def _positions(self):
+        """Return write begin, write end and last frame positions"""
+        return struct.unpack_from('<QQQ', self._mm, 24)
+
+    def _block(self, header, data):
+        return {'sequence':         header[5],
+                'time':             header[6],
+                'scan_rate':        header[7],
+                'device_backlog':   header[9],
+                'ljm_backlog':      header[10],
+                'data':             data.reshape(header[8], header[4]),
+               }
+
+    def _read_shm(self, timeout, copy):
+
+        header_size = self.FRAME.size
+        capacity = self._capacity
+        start = time.time()
+
+        while True:
+            begin, end, last = self._positions()
+
+            # fell behind by more than the ring: skip to the most recent frame
+            if end - self._pos > capacity or self._pos > end:
+                self._pos = last
+
+            # wait for new data
+            if self._pos >= end:
+                if time.time() - start > timeout:
+                    raise TimeoutError('No data from the tap. Is the frontend running?')
+                time.sleep(0.001)
+                continue
+
+            # too little space left for a frame: it starts at the beginning
+            offset = self._pos % capacity
+            if capacity - offset < header_size:
+                self._pos += capacity - offset
+                continue
+
+            header = self.FRAME.unpack_from(self._mm, self._header_size + offset)
+
+            if header[0] != FRAME_MAGIC:
+                self._pos = last
+                continue
+
+            if header[1] != DATA:
+                self._pos += header[3]
+                continue
+
+            data = np.frombuffer(self._mm, dtype='<f8', count=header[8]*header[4],
+                                 offset=self._header_size + offset + header_size)
+            if copy:
+                data = data.copy()
+
+            # check that the writer hasn't overwritten the frame in the meantime
+            begin = self._positions()[0]
+            if begin - self._pos > capacity:
+                self._pos = last
+                continue
+
+            self._pos += header[3]
+            return self._block(header, data)
+
+    def _recv(self, size):
+
+        buffer = bytearray(size)
+        view = memoryview(buffer)
+        while size > 0:
+            n = self._sock.recv_into(view[len(buffer)-size:], size)
+            if n == 0:
+                raise ConnectionError('Tap connection closed by the frontend')
+            size -= n
+        return buffer
+
+    def _read_socket(self, timeout):
+
+        self._sock.settimeout(timeout)
+
+        while True:
+            header = self.FRAME.unpack(self._recv(self.FRAME.size))
+
+            if header[0] != FRAME_MAGIC:
+                raise RuntimeError('Lost framing on the tap socket')
+
+            payload = self._recv(header[3] - self.FRAME.size)
+
+            if header[1] == NAMES:
+                self.channel_names = self._split_names(payload, header[4])
+            elif header[1] == DATA:
+                data = np.frombuffer(payload, dtype='<f8', count=header[8]*header[4])
+                return self._block(header, data)
+
+    def close(self):
+        """
+            Close the shared memory or socket
+        """
+        if self.address is None: self._mm.close()
+        else:                    self._sock.close()
+
+    def read(self, timeout=5, copy=True):
+        """
+            Return the next block from the tap. The first block read is the most
+            recent one. If the reader falls behind by more than the shared memory
+            ring, it skips ahead to the most recent block.
+
+            timeout:    s, raise TimeoutError if no block arrives within this time
+            copy:       if False, the data of a shared memory block is a view of
+                        the ring rather than a copy. It is only valid until the
+                        frontend overwrites it, about a ring length later.
+        """
+        if self.address is None:  return self._read_shm(timeout, copy)
+        else:                     return self._read_socket(timeout)
+
+    def to_dataframe(self, block):
+        """
+            Convert a block to a pd.DataFrame in the style of LabJackT7.read, with
+            columns named by channel and index in seconds from the start of the
+            block. Returns (start time string, DataFrame).
+        """
+        nscans = block['data'].shape[0]
+        index = np.arange(nscans) / block['scan_rate']
+        df = pd.DataFrame(block['data'], index=index, columns=self.channel_names)
+        df.index.name = 'dt (s)'
+        return (str(datetime.fromtimestamp(block['time'])), df)
@@ -1,2 +1,4 @@
-__all__=['LabJackT7']
-from .LabJackT7777777 import LabJackT7
+__all__=['LabJackT7', 'LabJackTap', 'LabJackSession']
+from .LabJackT7 import LabJackT7
+from .LabJackTap import LabJackTap
+from .LabJackSession import LabJackSession
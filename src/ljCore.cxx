@@ -0,0 +1,256 @@
+/********************************************************************\
+ Labjack Python core
+
+ The _ljcore extension of the LabJackT7 package: the C++ readout core of
+ the feLabjack02 frontend, for LabJackT7 to configure, stream and reduce
+ with the same code as production rather than a Python copy of it.
+
+   FLUXGATE_CHANNELS	       the AIN channels of the fluxgate inputs
+   max_scan_rate(...)	       T7MaxScanRate for a configuration
+   mean_std(scans)	       the frontend's mean/STD kernel (ljStats.h)
+   robust_stats(scans, ...)    LJRobustStats
+   Stream(handle)	       configures and streams a device opened with
+			       ljm.openS, through LJMStreamSource
+
+ Scans are numpy arrays of shape (nscans, nchannels), as LJM interleaves
+ them; they are used in place if they are C-contiguous doubles. A
+ Stream read returns the block de-interleaved, as an array of shape
+ (nchannels, nscans) whose memory is the LJChannelBlock it was
+ de-interleaved into, so it isn't copied again on its way to Python.
+\********************************************************************/
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "LabJackM.h"
+#include "ljLabjack.h"
+#include "ljStreamConfig.h"
+#include "ljChannels.h"
+#include "ljStats.h"
+
+namespace py = pybind11;
+
+typedef py::array_t<double, py::array::c_style | py::array::forcecast> Scans;
+
+/*-- Helpers -------------------------------------------------------*/
+
+// Raises an LJM error as a RuntimeError, with the code in the message.
+static void Check(int err, const char *what)
+{
+	if (err == LJME_NOERROR) return;
+
+	char message[LJM_MAX_NAME_SIZE];
+	LJM_ErrorToString(err, message);
+
+	throw std::runtime_error(std::string(what) + ": " + message + " (" +
+				 std::to_string(err) + ")");
+}
+
+static int Channels(const Scans &scans)
+{
+	if (scans.ndim() != 2)
+		throw std::invalid_argument("scans must have shape (nscans, nchannels)");
+
+	return (int)scans.shape(1);
+}
+
+/*-- Statistics ----------------------------------------------------*/
+
+static py::tuple MeanStd(Scans scans)
+{
+	int nChannels = Channels(scans);
+	int nScans = (int)scans.shape(0);
+
+	py::array_t<double> mean(nChannels), std(nChannels);
+	LJChannelBlock block;
+
+	LJStatsKernelFor(nChannels).meanStd(scans.data(), nChannels, nScans,
+					    block, mean.mutable_data(),
+					    std.mutable_data(), 1);
+
+	return py::make_tuple(mean, std);
+}
+
+static py::array_t<double> RobustStats(Scans scans, double clipSigma,
+				       int iterations)
+{
+	int nChannels = Channels(scans);
+	int nScans = (int)scans.shape(0);
+
+	LJChannelBlock block;
+	block.Load(scans.data(), nChannels, nScans);
+
+	LJRobustStats robust;
+	robust.Configure(clipSigma, iterations);
+
+	py::array_t<double> out({nChannels, (int)LJRobustStats::VALUES});
+	robust.Compute(block, out.mutable_data());
+
+	return out;
+}
+
+static double MaxScanRate(int resolutionIndex, std::vector<double> ranges,
+			  double settlingUS)
+{
+	LJStreamConfig config;
+	config.resolutionIndex = resolutionIndex;
+	config.settlingUS = settlingUS;
+	config.range = ranges;
+	config.negativeChannel.assign(ranges.size(), LJM_GND);
+
+	return T7MaxScanRate(config);
+}
+
+/*-- Stream --------------------------------------------------------*/
+
+// A device stream, for a handle opened in Python.
+class LJPyStream {
+
+public:
+
+	explicit LJPyStream(int handle)
+		: fSource(handle), fScansPerRead(0), fRunning(false) {}
+
+	~LJPyStream()
+	{
+		if (fRunning) fSource.Stop();
+	}
+
+	void Configure(std::vector<std::string> names, int resolutionIndex,
+		       double settlingUS, std::vector<double> ranges,
+		       std::vector<int> negativeChannels)
+	{
+		LJStreamConfig config;
+		config.resolutionIndex = resolutionIndex;
+		config.settlingUS = settlingUS;
+		config.range = ranges;
+		config.negativeChannel = negativeChannels;
+
+		std::vector<const char *> pointers;
+		for (size_t i = 0; i < names.size(); i++)
+			pointers.push_back(names[i].c_str());
+
+		std::string failed;
+		int err = LJWriteStreamConfig(fSource.Handle(), config,
+					      pointers.data(), names.size(), failed);
+		Check(err, failed.c_str());
+	}
+
+	double Start(std::vector<std::string> names, int scansPerRead,
+		     double scanRate)
+	{
+		std::vector<const char *> pointers;
+		for (size_t i = 0; i < names.size(); i++)
+			pointers.push_back(names[i].c_str());
+
+		fAddresses.resize(names.size());
+		Check(LJM_NamesToAddresses(names.size(), pointers.data(),
+					   fAddresses.data(), NULL),
+		      "LJM_NamesToAddresses");
+
+		Check(fSource.Start(scansPerRead, fAddresses.size(),
+				    fAddresses.data(), &scanRate),
+		      "LJM_eStreamStart");
+
+		fScansPerRead = scansPerRead;
+		fScans.resize((size_t)scansPerRead * fAddresses.size());
+		fRunning = true;
+
+		return scanRate;
+	}
+
+	// Waits for the next block, without holding the GIL, and returns it
+	// de-interleaved with the device and LJM scan backlogs.
+	py::tuple Read()
+	{
+		if (!fRunning) throw std::runtime_error("The stream isn't running");
+
+		int deviceBacklog = 0, ljmBacklog = 0, err;
+		{
+			py::gil_scoped_release release;
+			err = fSource.Read(fScans.data(), &deviceBacklog,
+					   &ljmBacklog);
+		}
+		Check(err, "LJM_eStreamRead");
+
+		int nChannels = fAddresses.size();
+
+		LJChannelBlock *block = new LJChannelBlock;
+		block->Load(fScans.data(), nChannels, fScansPerRead);
+
+		py::capsule owner(block, [](void *p) {
+			delete (LJChannelBlock *)p;
+		});
+
+		py::array_t<double> channels(
+			{nChannels, fScansPerRead},
+			{(py::ssize_t)(block->Stride() * sizeof(double)),
+			 (py::ssize_t)sizeof(double)},
+			block->Channel(0), owner);
+
+		return py::make_tuple(channels, deviceBacklog, ljmBacklog);
+	}
+
+	void Stop()
+	{
+		if (!fRunning) return;
+
+		fRunning = false;
+		Check(fSource.Stop(), "LJM_eStreamStop");
+	}
+
+private:
+
+	LJMStreamSource fSource;
+	std::vector<int> fAddresses;
+	std::vector<double> fScans;
+	int fScansPerRead;
+	bool fRunning;
+};
+
+/*-- Module --------------------------------------------------------*/
+
+PYBIND11_MODULE(_ljcore, m)
+{
+	m.doc() = "C++ readout core of the feLabjack02 frontend";
+
+	std::vector<std::string> channels(LJ_FLUXGATE_CHANNELS,
+		LJ_FLUXGATE_CHANNELS + 3 * LJ_FLUXGATE_INPUTS);
+	m.attr("FLUXGATE_CHANNELS") = channels;
+	m.attr("SKIPPED_SAMPLE") = (double)LJM_DUMMY_VALUE;
+
+	m.def("mean_std", &MeanStd, py::arg("scans"),
+	      "Mean and std of every channel of scans (nscans, nchannels), "
+	      "with the kernel the frontend uses");
+
+	m.def("robust_stats", &RobustStats, py::arg("scans"),
+	      py::arg("clip_sigma") = 3.0, py::arg("iterations") = 3,
+	      "Median, MAD, clipped mean, clipped std and rejected scans of "
+	      "every channel, shape (nchannels, 5)");
+
+	m.def("max_scan_rate", &MaxScanRate, py::arg("resolution_index"),
+	      py::arg("ranges"), py::arg("settling_us") = 0.0,
+	      "Maximum scan rate in Hz for the ranges of the channels in the "
+	      "scan list, 0 if it can't be streamed");
+
+	py::class_<LJPyStream>(m, "Stream")
+		.def(py::init<int>(), py::arg("handle"))
+		.def("configure", &LJPyStream::Configure, py::arg("names"),
+		     py::arg("resolution_index") = 0, py::arg("settling_us") = 0.0,
+		     py::arg("ranges") = std::vector<double>(),
+		     py::arg("negative_channels") = std::vector<int>(),
+		     "Writes the stream and channel configuration, as the "
+		     "frontend does")
+		.def("start", &LJPyStream::Start, py::arg("names"),
+		     py::arg("scans_per_read"), py::arg("scan_rate"),
+		     "Starts streaming the channels, returns the actual scan rate")
+		.def("read", &LJPyStream::Read,
+		     "Reads a block: (data of shape (nchannels, nscans), device "
+		     "backlog, LJM backlog)")
+		.def("stop", &LJPyStream::Stop);
+}